@@ -6,6 +6,7 @@ CONFIG += c++17
 
 INCLUDEPATH += /home/greg/openssl-3/include
 LIBS += -L/home/greg/openssl-3/lib64 -lssl -lcrypto
+LIBS += -lcrypt
 
 QMAKE_LFLAGS += -Wl,-rpath,/home/greg/openssl-3/lib64
 
@@ -15,14 +16,63 @@ QMAKE_LFLAGS += -Wl,-rpath,/home/greg/openssl-3/lib64
 
 SOURCES += \
     Installwizard.cpp \
+    accountmanager.cpp \
+    blockdevice.cpp \
+    bootloaderstrategy.cpp \
+    commandrunner.cpp \
+    configeditor.cpp \
+    filesystemstrategy.cpp \
+    formatter.cpp \
+    fstabgenerator.cpp \
+    initramfsprofile.cpp \
+    installengine.cpp \
     installerworker.cpp \
+    installjournal.cpp \
+    jobexecutor.cpp \
+    keyringcache.cpp \
+    logmodel.cpp \
+    memoryconfig.cpp \
+    metricsexporter.cpp \
+    mountmanager.cpp \
+    partitionhelpers.cpp \
+    perfbaseline.cpp \
+    progressmodel.cpp \
+    resizeplanner.cpp \
+    sharedinstallsource.cpp \
+    storagetuning.cpp \
     systemworker.cpp \
+    tracer.cpp \
     main.cpp
 
 HEADERS += \
     Installwizard.h \
+    accountmanager.h \
+    blockdevice.h \
+    bootloaderstrategy.h \
+    canceltoken.h \
+    commandrunner.h \
+    configeditor.h \
+    filesystemstrategy.h \
+    formatter.h \
+    fstabgenerator.h \
+    initramfsprofile.h \
+    installengine.h \
     installerworker.h \
-    systemworker.h
+    installjournal.h \
+    jobexecutor.h \
+    keyringcache.h \
+    logmodel.h \
+    memoryconfig.h \
+    metricsexporter.h \
+    mountmanager.h \
+    partitionhelpers.h \
+    perfbaseline.h \
+    progressmodel.h \
+    resizeplanner.h \
+    sharedinstallsource.h \
+    storagetuning.h \
+    systemworker.h \
+    tracer.h
 
 FORMS += \
     Installwizard.ui
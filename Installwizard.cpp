@@ -1,7 +1,17 @@
 #include "Installwizard.h"
+#include "commandrunner.h"
+#include "filesystemstrategy.h"
+#include "formatter.h"
+#include "installengine.h"
 #include "installerworker.h"
-#include "systemworker.h"
+#include "jobexecutor.h"
+#include "logmodel.h"
+#include "metricsexporter.h"
+#include "mountmanager.h"
+#include "partitionhelpers.h"
+#include "tracer.h"
 #include "ui_Installwizard.h"
+#include <QApplication>
 #include <QDir>
 #include <QFile>
 #include <QFileDialog>
@@ -9,16 +19,13 @@
 #include <QMessageBox>
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
-#include <QProcess>
 #include <QRegularExpression>
-#include <QStandardPaths>
 #include <QTextStream>
-#include <QThread>
 #include <QComboBox>
 #include <QTreeWidget>
 #include <QTreeWidgetItem>
-#include <QSet>
 #include <algorithm>
+#include <memory>
 #include <unistd.h>
 
 Installwizard::Installwizard(QWidget *parent)
@@ -26,6 +33,42 @@ Installwizard::Installwizard(QWidget *parent)
   ui->setupUi(this);
   setWindowTitle("Arch Linux Installer");
 
+  // All three log views show the same log; see LogModel
+  logModel = new LogModel(LogModel::DefaultCapacity, this);
+  logModel->setLogFile();
+  logModel->attach(ui->logView1);
+  logModel->attach(ui->logView2);
+  logModel->attach(ui->logWidget3);
+
+  // Disk and package work runs off the GUI thread; see JobExecutor
+  jobs = new JobExecutor(4, this);
+  connect(jobs, &JobExecutor::logMessage, logModel, &LogModel::append,
+          Qt::DirectConnection);
+  connect(jobs, &JobExecutor::jobProgress, this,
+          [this](int, const QString &name, int, const QString &text) {
+            appendLog(name + ": " + text);
+          });
+  // Abort stops the running command and unmounts the target
+  setButtonText(QWizard::CustomButton1, tr("Abort"));
+  connect(this, &QWizard::customButtonClicked, this, [this](int which) {
+    if (which == QWizard::CustomButton1) {
+      appendLog(tr("Aborting..."));
+      jobs->cancelAll();
+    }
+  });
+  connect(jobs, &JobExecutor::busyChanged, this, [this](bool busy) {
+    // No second destructive action while disk work is queued or running
+    ui->prepareButton->setEnabled(!busy);
+    ui->createPartButton->setEnabled(!busy);
+    ui->installButton->setEnabled(!busy);
+    setOption(QWizard::HaveCustomButton1, busy);
+    if (busy)
+      QApplication::setOverrideCursor(Qt::BusyCursor);
+    else
+      QApplication::restoreOverrideCursor();
+  });
+  connect(this, &QWizard::rejected, jobs, &JobExecutor::cancelAll);
+
   // Initially disable navigation buttons until each page completes its work
   // setWizardButtonEnabled(QWizard::NextButton, false);
   setWizardButtonEnabled(QWizard::FinishButton, false);
@@ -49,6 +92,8 @@ Installwizard::Installwizard(QWidget *parent)
             }
           });
 
+  ui->comboRootFilesystem->addItems(FilesystemStrategy::available());
+
   connect(ui->treePartitions, &QTreeWidget::itemClicked, this,
           [this](QTreeWidgetItem *item, int) {
             if (item)
@@ -161,23 +206,6 @@ Installwizard::Installwizard(QWidget *parent)
       splitPartitionForEfi(selectedPartition);
     } else {
       prepareForEfi(drive);
-
-
-
-  };
-    if (!drive.isEmpty()) {
-      setWizardButtonEnabled(QWizard::NextButton, false);
-      if (installMode == InstallerWorker::InstallMode::UsePartition) {
-        if (selectedPartition.isEmpty()) {
-          QMessageBox::warning(this, "Error",
-                               "Please select a partition in the table.");
-          setWizardButtonEnabled(QWizard::NextButton, true);
-          return;
-        }
-        splitPartitionForEfi(selectedPartition);
-      } else {
-        prepareForEfi(drive);
-      }
     }
   });
 
@@ -194,72 +222,6 @@ Installwizard::Installwizard(QWidget *parent)
           };
 }
 
-static QString getPartitionTableType(const QString &drive) {
-    QProcess p;
-    QString device = QString("/dev/%1").arg(drive);
-    p.start("lsblk", QStringList() << "-no" << "PTTYPE" << device);
-    p.waitForFinished();
-    return QString(p.readAllStandardOutput()).trimmed();
-}
-
-static bool hasBiosBootPartition(const QString &drive,
-                                 const QString &excludePart = QString()) {
-    QProcess p;
-    QString device = QString("/dev/%1").arg(drive);
-    p.start("lsblk",
-            QStringList() << "-o" << "NAME,PARTFLAGS,PARTTYPE" << "-nr" << device);
-    p.waitForFinished();
-    QString out = QString(p.readAllStandardOutput());
-    for (const QString &line : out.split('\n', Qt::SkipEmptyParts)) {
-        QStringList cols = line.split(QRegularExpression("\\s+"), Qt::SkipEmptyParts);
-        if (cols.size() < 3)
-            continue;
-        QString name = cols.at(0);
-        if (!excludePart.isEmpty() && name == excludePart)
-            continue;
-        QString flags = cols.at(1);
-        QString type = cols.at(2);
-
-        if (cols.size() < 2)
-            continue;
-       
-        QString name = cols.at(0);
-        if (!excludePart.isEmpty() && name == excludePart)
-            continue;
-        QString flags = cols.at(1);
-        QString type = cols.at(2);
-        if (flags.contains("bios_grub") ||
-            type.contains("21686148-6449-6E6F-744E-656564454649", Qt::CaseInsensitive))
-            return true;
-    }
-    return false;
-}
-
-static bool mbrPrimaryPartitionLimitReached(const QString &drive) {
-    QProcess p;
-    QString device = QString("/dev/%1").arg(drive);
-    p.start("lsblk", QStringList() << "-o" << "TYPE" << "-nr" << device);
-    p.waitForFinished();
-    QString out = QString(p.readAllStandardOutput());
-    int count = 0;
-    for (const QString &line : out.split('\n', Qt::SkipEmptyParts)) {
-        if (line.trimmed() == "part")
-            count++;
-    }
-    return count >= 4;
-}
-
-static bool waitForPartition(const QString &partPath, int timeoutSeconds = 10) {
-    QFileInfo fi(partPath);
-    int elapsed = 0;
-    while (!fi.exists() && elapsed < timeoutSeconds) {
-        QThread::sleep(1);
-        fi.refresh();
-        elapsed++;
-    }
-    return fi.exists();
-}
-
 QString Installwizard::getUserHome() {
   QString userHome;
 
@@ -270,10 +232,7 @@ QString Installwizard::getUserHome() {
     QByteArray userEnv = qgetenv("SUDO_USER");
     if (!userEnv.isEmpty()) {
       QString sudoUser = QString(userEnv);
-      QProcess proc;
-      proc.start("getent", QStringList() << "passwd" << sudoUser);
-      proc.waitForFinished();
-      QString output = proc.readAllStandardOutput();
+      QString output = CommandRunner::capture({"getent", "passwd", sudoUser});
       QStringList fields = output.split(':');
       if (fields.size() >= 6)
         userHome = fields[5]; // Home directory from /etc/passwd
@@ -287,18 +246,6 @@ QString Installwizard::getUserHome() {
   return userHome;
 }
 
-static QString locatePartedBinary() {
-  QString p = QStandardPaths::findExecutable("parted");
-  if (!p.isEmpty())
-    return p;
-  const QStringList fallbacks{"/usr/sbin/parted", "/sbin/parted"};
-  for (const QString &path : fallbacks)
-    if (QFileInfo::exists(path))
-      return path;
-  return QString();
-}
-
-
 void Installwizard::downloadISO(QProgressBar *progressBar) {
   QNetworkAccessManager *networkManager = new QNetworkAccessManager(this);
   QUrl url(
@@ -319,6 +266,25 @@ void Installwizard::downloadISO(QProgressBar *progressBar) {
   }
   appendLog("Downloading ISO...");
 
+  // One span for the whole download plus one per 64 MiB segment, so
+  // mirror stalls show up on the timeline
+  auto downloadSpan = std::make_shared<TraceSpan>("download", url.fileName());
+  auto segment = std::make_shared<TraceEvent>();
+  segment->category = "download";
+  segment->name = "segment";
+  segment->tid = Tracer::currentThreadId();
+  segment->startUs = Tracer::instance().nowUs();
+  segment->bytes = 0;
+  auto recordSegment = [segment]() {
+    Tracer &tracer = Tracer::instance();
+    if (!tracer.isEnabled() || segment->bytes <= 0)
+      return;
+    segment->durationUs = tracer.nowUs() - segment->startUs;
+    tracer.record(*segment);
+    segment->startUs += segment->durationUs;
+    segment->bytes = 0;
+  };
+
   connect(reply, &QNetworkReply::downloadProgress, this,
           [progressBar](qint64 bytesReceived, qint64 bytesTotal) {
             if (bytesTotal > 0) {
@@ -327,15 +293,24 @@ void Installwizard::downloadISO(QProgressBar *progressBar) {
             }
           });
 
-  connect(reply, &QNetworkReply::readyRead, this, [file, reply]() {
+  connect(reply, &QNetworkReply::readyRead, this, [file, reply, segment, recordSegment]() {
     if (file->isOpen()) {
-      file->write(reply->readAll());
+      QByteArray chunk = reply->readAll();
+      file->write(chunk);
+      segment->bytes += chunk.size();
+      if (segment->bytes >= 64 * 1024 * 1024)
+        recordSegment();
     }
   });
 
   connect(
       reply, &QNetworkReply::finished, this,
-      [this, file, reply, finalIsoPath]() {
+      [this, file, reply, finalIsoPath, downloadSpan, recordSegment]() {
+        recordSegment();
+        MetricsExporter::instance().addDownloadBytes(reply->url().host(), file->size());
+        downloadSpan->setBytes(file->size());
+        downloadSpan->setExitCode(reply->error());
+        downloadSpan->end();
         file->close();
 
         if (reply->error() == QNetworkReply::NoError) {
@@ -372,7 +347,12 @@ void Installwizard::downloadISO(QProgressBar *progressBar) {
           });
 }
 
-Installwizard::~Installwizard() { delete ui; }
+Installwizard::~Installwizard() {
+  // Running jobs log through logModel, so they have to finish first
+  jobs->cancelAll();
+  jobs->waitForDone();
+  delete ui;
+}
 
 void Installwizard::setWizardButtonEnabled(QWizard::WizardButton which,
                                            bool enabled) {
@@ -383,7 +363,6 @@ void Installwizard::setWizardButtonEnabled(QWizard::WizardButton which,
 
 void Installwizard::installDependencies() {
 
-  QProcess process;
   QStringList packages = {
       "arch-install-scripts", // includes arch-chroot, pacstrap
       "parted",
@@ -407,447 +386,263 @@ void Installwizard::installDependencies() {
     }
   }
 
-  QString installCmd;
+  QStringList installCmd;
   if (distro == "fedora") {
-    installCmd = "pkexec dnf install -y " + packages.join(" ");
+    installCmd = QStringList{"dnf", "install", "-y"} + packages;
   } else if (distro == "arch" || distro == "archlinux") {
-    installCmd = "pkexec pacman -S --noconfirm " + packages.join(" ");
+    installCmd = QStringList{"pacman", "-S", "--noconfirm"} + packages;
   } else {
-    installCmd = "pkexec apt install -y " + packages.join(" ");
+    installCmd = QStringList{"apt", "install", "-y"} + packages;
   }
 
   qDebug() << "Installing dependencies:" << installCmd;
   appendLog("Installing dependencies:...");
 
-  process.start("/bin/bash", QStringList() << "-c" << installCmd);
-  process.waitForFinished(-1);
-
-  QString output = process.readAllStandardOutput();
-  QString error = process.readAllStandardError();
-
-  qDebug() << "Dependency Install Output:" << output;
-  qDebug() << "Dependency Install Errors:" << error;
-
-  if (process.exitCode() != 0) {
-    QMessageBox::critical(this, "Error",
-                          "Failed to install required dependencies:\n" + error);
-    return;
-  }
-
-  appendLog("Dependencies installed, click next to proceed.");
-
-  // Allow user to advance to partitioning page
-  setWizardButtonEnabled(QWizard::NextButton, true);
-
-  getAvailableDrives();
-}
-
-QStringList Installwizard::getAvailableDrives() {
-  QProcess process;
-
-  // Use lsblk from PATH for better portability
-  process.start("lsblk", QStringList()
-                             << "-o" << "NAME,SIZE,TYPE" << "-d" << "-n");
-  process.waitForFinished();
-
-    // Use lsblk from PATH for better portability
-    process.start("lsblk", QStringList() << "-o" << "NAME,SIZE,TYPE" << "-d" << "-n");
-    process.waitForFinished();
-
-  QString output = process.readAllStandardOutput();
-
-  QStringList drives;
-
-  // Split output into lines and process each line
-  for (const QString &line : output.split('\n', Qt::SkipEmptyParts)) {
-    QStringList tokens = line.split(QRegularExpression("\\s+"),
-                                    Qt::SkipEmptyParts); // Split by whitespace
-
-    if (tokens.size() >= 3 && tokens[2] == "disk") { // Ensure it’s a disk
-      QString deviceName = tokens[0];
-      if (!deviceName.startsWith("loop")) { // Skip loop devices
-        drives << deviceName;               // Add the drive name (e.g., "sdb")
-      }
-    }
-  }
-
-  return drives;
+  jobs->submit(tr("Install dependencies"), QString(),
+               [installCmd](JobContext &ctx) {
+                 QString error;
+                 CommandRunner runner([&error](const QString &line, bool isStderr) {
+                   qDebug() << "Dependency Install:" << line;
+                   if (isStderr)
+                     error += line + '\n';
+                 });
+                 if (!runner.run(CommandRunner::privileged(installCmd)).ok())
+                   ctx.fail(error);
+               },
+               [this](const JobResult &r) {
+                 if (r.canceled)
+                   return;
+                 if (!r.ok) {
+                   QMessageBox::critical(this, "Error",
+                                         "Failed to install required dependencies:\n" + r.error);
+                   return;
+                 }
+
+                 appendLog("Dependencies installed, click next to proceed.");
+
+                 // Allow user to advance to partitioning page
+                 setWizardButtonEnabled(QWizard::NextButton, true);
+
+                 populateDrives();
+               });
 }
 
 void Installwizard::populateDrives() {
-  ui->driveDropdown->clear();                // Clear existing items
-  QStringList drives = getAvailableDrives(); // Get available drives
-
-  if (drives.isEmpty()) {
-    ui->driveDropdown->addItem("No drives found");
-  } else {
-    for (const QString &drive : std::as_const(drives)) {
-      ui->driveDropdown->addItem(
-          QString("/dev/%1").arg(drive)); // Add "/dev/" prefix
-    }
-  }
-
-  qDebug() << "Drives added to ComboBox:"
-           << drives; // Debug: Confirm drives in ComboBox
+  auto drives = std::make_shared<QStringList>();
+  jobs->submit(tr("List drives"), QString(),
+               [drives](JobContext &) { *drives = availableDrives(); },
+               [this, drives](const JobResult &r) {
+                 if (r.canceled)
+                   return;
+                 ui->driveDropdown->clear(); // Clear existing items
+
+                 if (drives->isEmpty()) {
+                   ui->driveDropdown->addItem("No drives found");
+                 } else {
+                   for (const QString &drive : std::as_const(*drives)) {
+                     ui->driveDropdown->addItem(
+                         QString("/dev/%1").arg(drive)); // Add "/dev/" prefix
+                   }
+                 }
+
+                 qDebug() << "Drives added to ComboBox:"
+                          << *drives; // Debug: Confirm drives in ComboBox
+               });
 }
 
 
-void Installwizard::unmountDrive(const QString &drive) {
-  QProcess process;
-  process.start("lsblk", QStringList() << "-nr" << "-o" << "MOUNTPOINT"
-                                       << QString("/dev/%1").arg(drive));
-  process.waitForFinished();
-  QStringList points =
-      QString(process.readAllStandardOutput()).split('\n', Qt::SkipEmptyParts);
-  for (const QString &pt : points) {
-    QString trimmed = pt.trimmed();
-    if (!trimmed.isEmpty() && trimmed != "[SWAP]") {
-      QProcess::execute("sudo", {"umount", "-f", trimmed});
-    }
-  }
-}
-
 void Installwizard::appendLog(const QString &message) {
-  if (ui->logWidget3)
-    ui->logWidget3->appendPlainText(message);
-  if (ui->logView1)
-    ui->logView1->appendPlainText(message);
-  if (ui->logView2)
-    ui->logView2->appendPlainText(message);
+  logModel->append(message);
 }
 
 void Installwizard::prepareDrive(const QString &drive) {
   selectedDrive = drive;
 
-  InstallerWorker *worker = new InstallerWorker;
-  worker->setDrive(drive);
-  worker->setMode(InstallerWorker::InstallMode::WipeDrive);
-
-  QThread *thread = new QThread;
-  worker->moveToThread(thread);
-
-  connect(thread, &QThread::started, worker, &InstallerWorker::run);
-  connect(worker, &InstallerWorker::logMessage, this,
-          [this](const QString &msg) { appendLog(msg); });
-  connect(worker, &InstallerWorker::errorOccurred, this,
-          [this](const QString &msg) {
-            QMessageBox::critical(this, "Error", msg);
-          });
-
-  connect(worker, &InstallerWorker::installComplete, thread, &QThread::quit);
-  connect(worker, &InstallerWorker::installComplete, this, [this]() {
+  InstallConfig config = configFromPages();
+  config.mode = InstallerWorker::InstallMode::WipeDrive;
+  runEngine(config, InstallEngine::Stage::Disk, [this]() {
     appendLog("\xE2\x9C\x85 Drive preparation complete.");
     setWizardButtonEnabled(QWizard::NextButton, true);
   });
-
-  connect(worker, &InstallerWorker::installComplete, worker,
-          &QObject::deleteLater);
-  connect(thread, &QThread::finished, thread, &QObject::deleteLater);
-
-  thread->start();
 }
 
-bool shrinkPartitionForBiosBoot(const QString &partition, const QString &drive, int partNum) {
-    // 1 MiB = 2048 sectors (512 bytes each)
-    QProcess proc;
-    proc.start("lsblk", QStringList() << "-bnro" << "START,SIZE" << partition);
-    proc.waitForFinished();
-    QStringList vals = QString(proc.readAllStandardOutput())
-                           .split(QRegularExpression("\\s+"), Qt::SkipEmptyParts);
-    if (vals.size() < 2) return false;
-    long long startB = vals.at(0).toLongLong();
-    long long sizeB = vals.at(1).toLongLong();
-    long long startMiB = startB / (1024 * 1024);
-    long long endMiB = startMiB + sizeB / (1024 * 1024);
-
-    // Shrink by 2 MiB just to be safe
-    long long newStartMiB = startMiB + 2; // leave 2MiB for alignment
-    long long newSizeMiB = endMiB - newStartMiB;
-
-    // 1. Filesystem check
-    if (QProcess::execute("sudo", {"e2fsck", "-f", partition}) != 0)
-        return false;
-
-    // 2. Shrink filesystem
-    if (QProcess::execute("sudo", {"resize2fs", partition, QString("%1M").arg(newSizeMiB)}) != 0)
-        return false;
-
-    // 3. Move start of partition (requires parted >= 3.2)
-    QString partedBin = locatePartedBinary();
-    if (QProcess::execute("sudo", {partedBin, QString("/dev/%1").arg(drive), "--script",
-                                   "move", QString::number(partNum), QString("%1MiB").arg(newStartMiB)}) != 0)
-        return false;
-
-    // 4. Create 1MiB partition at the beginning, type EF02
-    if (QProcess::execute("sudo", {partedBin, QString("/dev/%1").arg(drive), "--script",
-                                   "mkpart", "primary", "1MiB", QString("%1MiB").arg(newStartMiB),
-                                   "set", "1", "bios_grub", "on"}) != 0)
-        return false;
-
-    // 5. Refresh partition table
-    QProcess::execute("sudo", {"partprobe", QString("/dev/%1").arg(drive)});
-    QProcess::execute("sudo", {"udevadm", "settle"});
-    QThread::sleep(1);
-
-    return true;
+InstallConfig Installwizard::configFromPages() const {
+  InstallConfig config;
+  config.drive = selectedDrive;
+  config.efi = efiInstall;
+  config.rootFilesystem = ui->comboRootFilesystem->currentText();
+  config.desktop = ui->comboDesktopEnvironment->currentText();
+  config.username = ui->lineEditUsername->text().trimmed();
+  config.password = ui->lineEditPassword->text();
+  config.rootPassword = ui->lineEditRootPassword->text();
+  return config;
 }
 
-void Installwizard::prepareExistingPartition(const QString &partition) {
-    QString myPartition = partition; // NEW: create a local copy!
-
-    // Derive the parent drive so grub-install knows where to install
-    QProcess proc;
-    proc.start("lsblk", QStringList() << "-nr" << "-o" << "PKNAME" << myPartition);
-    proc.waitForFinished();
-    QString parent = QString(proc.readAllStandardOutput()).trimmed();
-    if (!parent.isEmpty())
-        selectedDrive = parent;
-
-    // --- NEW CHECKS: Partition table and BIOS boot partition ---
-    QString tableType = getPartitionTableType(selectedDrive);
-
-    // If we're doing a BIOS (not EFI) install, check for BIOS boot partition if GPT
-    if (!efiInstall) {
-        QString partBase = QFileInfo(partition).fileName();
-        QString partBase = QFileInfo(partition).fileName();
-        if (tableType == "gpt" &&
-            !efiInstall &&
-            !hasBiosBootPartition(selectedDrive, partBase)) {
-            // 1. Ask for user confirmation
-            if (QMessageBox::question(this, "BIOS Boot Partition Needed",
-                                      "This drive uses GPT partitioning and you are installing in BIOS (legacy) mode. "
-                                      "GRUB requires a tiny BIOS Boot Partition (1MiB, type EF02). Your chosen partition will be DELETED, "
-                                      "and two new partitions (bios_grub + root) will be created in its place. ALL DATA ON THIS PARTITION WILL BE ERASED.\n\n"
-                                      "Continue?") != QMessageBox::Yes)
-                return;
-
-            // 2. Unmount partition (safe even if not mounted)
-            QProcess::execute("sudo", {"umount", partition});
-
-            // 3. Get partition number and start/end positions
-            QProcess infoProc;
-            infoProc.start("lsblk", QStringList() << "-nr" << "-o" << "NAME,PARTNUM,START,SIZE" << partition);
-            infoProc.waitForFinished();
-            QStringList infoVals = QString(infoProc.readAllStandardOutput()).split(QRegularExpression("\\s+"), Qt::SkipEmptyParts);
-            if (infoVals.size() < 4) {
-                QMessageBox::critical(this, "Partition Error", "Could not get partition info.");
-                return;
-            }
-            QString partName = infoVals[0];
-            QString partNum = infoVals[1];
-            long long partStartSector = infoVals[2].toLongLong();
-            long long partSizeSector = infoVals[3].toLongLong();
-
-            // 4. Get sector size (needed for parted)
-            QProcess sectorProc;
-            sectorProc.start("cat", QStringList() << ("/sys/block/" + selectedDrive + "/queue/hw_sector_size"));
-            sectorProc.waitForFinished();
-            long long sectorSize = QString(sectorProc.readAllStandardOutput()).trimmed().toLongLong();
-
-            // 5. Calculate start and end in MiB
-            double startMiB = (double)partStartSector * sectorSize / 1048576.0;
-            double endMiB   = startMiB + ((double)partSizeSector * sectorSize / 1048576.0);
-
-            QString partedBin = locatePartedBinary();
-
-            // Capture partition list before modifications
-            QProcess beforeProc;
-            beforeProc.start("lsblk", QStringList() << "-nr" << "-o" << "NAME" << QString("/dev/%1").arg(selectedDrive));
-            beforeProc.waitForFinished();
-            QStringList beforeList = QString(beforeProc.readAllStandardOutput()).split('\n', Qt::SkipEmptyParts);
-            // Convert list of partition names into a set for fast lookup
-            QSet<QString> beforeParts(beforeList.cbegin(), beforeList.cend());
-
-
-            QSet<QString> beforeParts;
-            for (const QString &item : beforeList)
-                beforeParts.insert(item);
-
-
-            QSet<QString> beforeParts = QSet<QString>::fromList(QString(beforeProc.readAllStandardOutput()).split('\n', Qt::SkipEmptyParts));
-
-            // 6. Delete old partition
-            QProcess::execute("sudo", {partedBin, QString("/dev/%1").arg(selectedDrive), "--script", "rm", partNum});
-            QProcess::execute("sudo", {"partprobe", QString("/dev/%1").arg(selectedDrive)});
-            QProcess::execute("sudo", {"udevadm", "settle"});
-
-            // 7. Create bios_grub (1MiB) and root (rest)
-            QString biosGrubStart = QString::number(startMiB, 'f', 2) + "MiB";
-            QString biosGrubEnd   = QString::number(startMiB + 1.0, 'f', 2) + "MiB";
-            QString rootStart     = biosGrubEnd;
-            QString rootEnd       = QString::number(endMiB, 'f', 2) + "MiB";
-
-            QProcess::execute("sudo", {partedBin, QString("/dev/%1").arg(selectedDrive), "--script",
-                                       "mkpart", "primary", biosGrubStart, biosGrubEnd});
-            QProcess::execute("sudo", {partedBin, QString("/dev/%1").arg(selectedDrive), "--script",
-                                       "mkpart", "primary", "ext4", rootStart, rootEnd});
-
-            QProcess::execute("sudo", {"partprobe", QString("/dev/%1").arg(selectedDrive)});
-            QProcess::execute("sudo", {"udevadm", "settle"});
-
-            // 8. Determine new partitions and set bios_grub flag
-            QProcess afterProc;
-            afterProc.start("lsblk", QStringList() << "-bnr" << "-o" << "NAME,SIZE,PARTNUM" << QString("/dev/%1").arg(selectedDrive));
-            afterProc.waitForFinished();
-            QStringList lines = QString(afterProc.readAllStandardOutput()).split('\n', Qt::SkipEmptyParts);
-
-            QString biosPartNum;
-            QString newRootPart;
-            for (const QString &l : lines) {
-                QStringList cols = l.split(QRegularExpression("\\s+"), Qt::SkipEmptyParts);
-                if (cols.size() < 3)
-                    continue;
-                QString name = cols.at(0);
-                if (beforeParts.contains(name))
-                    continue; // existing partition
-
-                QString sizeStr = cols.at(1);
-                bool ok = false;
-                double szMiB = sizeStr.toDouble(&ok) / 1048576.0; // bytes -> MiB
-                if (ok && qAbs(szMiB - 1.0) < 0.1)
-                    biosPartNum = cols.at(2);
-                else
-                    newRootPart = "/dev/" + name;
-            }
-
-            if (!biosPartNum.isEmpty())
-                QProcess::execute("sudo", {partedBin, QString("/dev/%1").arg(selectedDrive), "--script",
-                                           "set", biosPartNum, "bios_grub", "on"});
-
-            if (newRootPart.isEmpty()) {
-                QMessageBox::critical(this, "Partition Error", "Could not locate new root partition.");
-                return;
-            }
-
-            myPartition = newRootPart; // Use new partition for formatting
-        }
-    }
-
-    // --- END NEW CHECKS ---
-
-    InstallerWorker *worker = new InstallerWorker;
-    worker->setDrive(selectedDrive);
-    worker->setMode(InstallerWorker::InstallMode::UsePartition);
-
-    // I added this here?
-    worker->setTargetPartition(myPartition);
-
-    QThread *thread = new QThread;
-    worker->moveToThread(thread);
-
-    connect(thread, &QThread::started, worker, &InstallerWorker::run);
-    connect(worker, &InstallerWorker::logMessage, this,
-            [this](const QString &msg) { appendLog(msg); });
-    connect(worker, &InstallerWorker::errorOccurred, this,
-            [this](const QString &msg) {
-                QMessageBox::critical(this, "Error", msg);
-            });
-    connect(worker, &InstallerWorker::installComplete, thread, &QThread::quit);
-    connect(worker, &InstallerWorker::installComplete, this, [this]() {
-        appendLog("\xE2\x9C\x85 Partition prepared.");
-        setWizardButtonEnabled(QWizard::NextButton, true);
-    });
-
-    appendLog("Deleted old partition and created bios_grub and root partitions automatically.");
+// Runs one stage of the install engine as a job on the drive's queue, the
+// same engine the headless mode drives from a config file
+void Installwizard::runEngine(const InstallConfig &config, InstallEngine::Stage stage,
+                              const std::function<void()> &onSuccess) {
+  InstallEngine *engine = new InstallEngine(config);
+  connect(engine, &InstallEngine::logMessage, logModel, &LogModel::append,
+          Qt::DirectConnection);
+  connect(engine, &InstallEngine::warning, logModel,
+          [this](const QString &message) { logModel->append("\xE2\x9A\xA0 " + message); },
+          Qt::DirectConnection);
+  connect(engine, &InstallEngine::progressChanged, this,
+          [this](int permille, qint64 etaSeconds) {
+            ui->progressInstall->setValue(permille);
+            if (permille >= 1000)
+              ui->labelEta->clear();
+            else if (etaSeconds < 60)
+              ui->labelEta->setText(tr("< 1 min left"));
+            else
+              ui->labelEta->setText(tr("~%1 min left").arg((etaSeconds + 30) / 60));
+          });
 
-    connect(worker, &InstallerWorker::installComplete, worker, &QObject::deleteLater);
-    connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+  jobs->submit(stage == InstallEngine::Stage::System ? tr("Install system")
+                                                     : tr("Prepare /dev/%1").arg(config.drive),
+               config.drive,
+               [engine, stage](JobContext &ctx) {
+                 engine->setCancelToken(ctx.cancelToken());
+                 if (engine->runStage(stage) != InstallEngine::Success)
+                   ctx.fail(engine->errorString());
+               },
+               [this, engine, stage, onSuccess](const JobResult &r) {
+                 engine->deleteLater();
+                 if (r.canceled) {
+                   appendLog(tr("%1 canceled").arg(r.name));
+                   return;
+                 }
+                 if (!r.ok) {
+                   // The target's install journal keeps the finished steps
+                   QString hint = stage == InstallEngine::Stage::System
+                                      ? tr("\n\nPress Install to retry; completed steps are skipped.")
+                                      : QString();
+                   QMessageBox::critical(this, "Error", r.error + hint);
+                   return;
+                 }
+                 // It went on after these; they are in the log as well
+                 const QStringList warnings = engine->warnings();
+                 if (!warnings.isEmpty())
+                   QMessageBox::warning(this, "Completed with errors",
+                                        tr("%1 finished, but reported these errors:\n\n%2")
+                                            .arg(r.name, warnings.join('\n')));
+                 onSuccess();
+               });
+}
 
-    thread->start();
+void Installwizard::prepareExistingPartition(const QString &partition) {
+    // Inspect the disk off the GUI thread and ask before the engine, which
+    // splits off a bios_grub partition on its own when GRUB needs one
+    struct Probe {
+        QString drive;
+        QString tableType;
+        bool hasBiosBoot = false;
+    };
+    auto probe = std::make_shared<Probe>();
+    QString currentDrive = selectedDrive;
+    jobs->submit(tr("Inspect %1").arg(partition), QString(),
+                 [partition, currentDrive, probe](JobContext &) {
+                     // Derive the parent drive so grub-install knows where to install
+                     QString parent = parentDrive(partition);
+                     probe->drive = parent.isEmpty() ? currentDrive : parent;
+                     probe->tableType = getPartitionTableType(probe->drive);
+                     probe->hasBiosBoot = hasBiosBootPartition(probe->drive,
+                                                               QFileInfo(partition).fileName());
+                 },
+                 [this, partition, probe](const JobResult &r) {
+                     if (r.canceled)
+                         return;
+                     selectedDrive = probe->drive;
+
+                     // If we're doing a BIOS (not EFI) install on GPT, GRUB needs a BIOS boot partition
+                     if (!efiInstall && probe->tableType == "gpt" && !probe->hasBiosBoot
+                         && QMessageBox::question(this, "BIOS Boot Partition Needed",
+                                                  "This drive uses GPT partitioning and you are installing in BIOS (legacy) mode. "
+                                                  "GRUB requires a tiny BIOS Boot Partition (1MiB, type EF02). Your chosen partition will be DELETED, "
+                                                  "and two new partitions (bios_grub + root) will be created in its place. ALL DATA ON THIS PARTITION WILL BE ERASED.\n\n"
+                                                  "Continue?") != QMessageBox::Yes)
+                         return;
+
+                     InstallConfig config = configFromPages();
+                     config.mode = InstallerWorker::InstallMode::UsePartition;
+                     config.partition = partition;
+                     runEngine(config, InstallEngine::Stage::Disk, [this]() {
+                         appendLog("\xE2\x9C\x85 Partition prepared.");
+                         setWizardButtonEnabled(QWizard::NextButton, true);
+                     });
+                 });
 }
 
 void Installwizard::prepareFreeSpace(const QString &drive) {
     selectedDrive = drive;
 
-    // --- NEW CHECK: MBR primary partition limit ---
-    QString tableType = getPartitionTableType(drive);
-    if (tableType == "dos" && mbrPrimaryPartitionLimitReached(drive)) {
-        QMessageBox::critical(this, "Partition Error",
-                              "MBR (msdos) disks allow only 4 primary partitions. "
-                              "Cannot create a new partition. You need to delete a partition or use GPT for more.");
-        return;
-    }
-
-    InstallerWorker *worker = new InstallerWorker;
-    worker->setDrive(drive);
-    worker->setMode(InstallerWorker::InstallMode::UseFreeSpace);
-
-    QThread *thread = new QThread;
-    worker->moveToThread(thread);
-
-    connect(thread, &QThread::started, worker, &InstallerWorker::run);
-    connect(worker, &InstallerWorker::logMessage, this,
-            [this](const QString &msg) { appendLog(msg); });
-    connect(worker, &InstallerWorker::errorOccurred, this,
-            [this](const QString &msg) { QMessageBox::critical(this, "Error", msg); });
-    connect(worker, &InstallerWorker::installComplete, thread, &QThread::quit);
-    connect(worker, &InstallerWorker::installComplete, this, [this]() {
+    // The engine refuses a fifth primary partition on MBR disks
+    InstallConfig config = configFromPages();
+    config.mode = InstallerWorker::InstallMode::UseFreeSpace;
+    runEngine(config, InstallEngine::Stage::Disk, [this]() {
         appendLog("\xE2\x9C\x85 Free space partition created.");
         setWizardButtonEnabled(QWizard::NextButton, true);
     });
-    connect(worker, &InstallerWorker::installComplete, worker, &QObject::deleteLater);
-    connect(thread, &QThread::finished, thread, &QObject::deleteLater);
-
-    thread->start();
 }
 
 void Installwizard::populatePartitionTable(const QString &drive) {
   if (drive.isEmpty())
     return;
 
-  QProcess process;
+  // Queued behind any disk work on the drive so the table is read after it
   QString device = QString("/dev/%1").arg(drive);
-  process.start("lsblk", QStringList()
-                             << "-r" << "-n" << "-o"
-                             << "NAME,SIZE,TYPE,MOUNTPOINT" << device);
-  process.waitForFinished();
-  QString output = process.readAllStandardOutput();
-
-  ui->treePartitions->clear();
-  QStringList lines = output.split('\n', Qt::SkipEmptyParts);
-  for (const QString &line : lines.mid(1)) { // skip header
-    QStringList cols =
-        line.split(QRegularExpression("\\s+"), Qt::SkipEmptyParts);
-    if (cols.size() >= 4) {
-      QTreeWidgetItem *item = new QTreeWidgetItem(ui->treePartitions);
-      item->setText(0, cols.at(0));
-      item->setText(1, cols.at(1));
-      item->setText(2, cols.at(2));
-      item->setText(3, cols.at(3));
-    }
-  }
+  int generation = ++partitionTableGeneration;
+  auto output = std::make_shared<QString>();
+  jobs->submit(tr("Read partitions of %1").arg(device), drive,
+               [device, output](JobContext &) {
+                 *output = CommandRunner::capture({"lsblk", "-r", "-n", "-o",
+                                                   "NAME,SIZE,TYPE,MOUNTPOINT", device});
+               },
+               [this, generation, output](const JobResult &r) {
+                 // A newer refresh (possibly of another drive) supersedes this one
+                 if (r.canceled || generation != partitionTableGeneration)
+                   return;
+                 ui->treePartitions->clear();
+                 QStringList lines = output->split('\n', Qt::SkipEmptyParts);
+                 for (const QString &line : lines.mid(1)) { // skip header
+                   QStringList cols =
+                       line.split(QRegularExpression("\\s+"), Qt::SkipEmptyParts);
+                   if (cols.size() >= 4) {
+                     QTreeWidgetItem *item = new QTreeWidgetItem(ui->treePartitions);
+                     item->setText(0, cols.at(0));
+                     item->setText(1, cols.at(1));
+                     item->setText(2, cols.at(2));
+                     item->setText(3, cols.at(3));
+                   }
+                 }
+               });
 }
 
 void Installwizard::prepareForEfi(const QString &drive) {
   efiInstall = true; // remember choice for grub
   selectedDrive = drive;
-  unmountDrive(drive);
-
-  QString device = QString("/dev/%1").arg(drive);
-
-  QString partedBin = locatePartedBinary();
-  if (partedBin.isEmpty()) {
-    QMessageBox::critical(this, "Partition Error", "parted not found");
-    return;
-  }
-
-  // Run all partition commands in a single parted invocation so the kernel
-  // sees the new table before we name and flag the ESP
-  QStringList args{partedBin, device,  "--script", "mklabel", "gpt",  "mkpart",
-                   "primary", "fat32", "1MiB",     "513MiB",  "name", "1",
-                   "ESP",     "set",   "1",        "esp",     "on",   "mkpart",
-                   "primary", "ext4",  "513MiB",   "100%"};
-  if (QProcess::execute("sudo", args) != 0) {
-    QMessageBox::critical(this, "Partition Error", tr("Failed to run parted."));
-    return;
-  }
-
-  QProcess::execute("sudo", {"partprobe", device});
-  QProcess::execute("sudo", {"udevadm", "settle"});
 
-  populatePartitionTable(drive);
-  appendLog("\xE2\x9C\x85 Partitions ready for EFI install.");
-  setWizardButtonEnabled(QWizard::NextButton, true);
+  jobs->submit(tr("Partition /dev/%1 for EFI").arg(drive), drive,
+               [drive](JobContext &ctx) {
+                 QString error;
+                 auto log = [&ctx](const QString &msg) { ctx.log(msg); };
+                 // Left over from an earlier install into /mnt
+                 MountManager::unmountAll("/mnt", QString(), log);
+                 if (!createEfiLayout(drive, log, &error))
+                   ctx.fail(error);
+               },
+               [this, drive](const JobResult &r) {
+                 if (r.canceled)
+                   return;
+                 if (!r.ok) {
+                   QMessageBox::critical(this, "Partition Error", r.error);
+                   return;
+                 }
+                 populatePartitionTable(drive);
+                 appendLog("\xE2\x9C\x85 Partitions ready for EFI install.");
+                 setWizardButtonEnabled(QWizard::NextButton, true);
+               });
 }
 
 void Installwizard::handleDriveChange(const QString &text) {
@@ -877,122 +672,27 @@ void Installwizard::splitPartitionForEfi(const QString &partition) {
   int partNum = m.captured(2).toInt();
   selectedDrive = drive;
 
-  // Make sure nothing from the drive is mounted
-  unmountDrive(drive);
-
-  QProcess proc;
-  proc.start("lsblk",
-             QStringList() << "-bnro" << "START,SIZE" << QString("/dev/%1").arg(part));
-  proc.waitForFinished();
-  QStringList vals = QString(proc.readAllStandardOutput())
-                          .split(QRegularExpression("\\s+"), Qt::SkipEmptyParts);
-  if (vals.size() < 2) {
-    QMessageBox::critical(this, "Partition Error",
-                         "Could not query partition info.");
-    return;
-  }
-
-  long long startB = vals.at(0).toLongLong();
-  long long sizeB = vals.at(1).toLongLong();
-  long long startMiB = startB / (1024 * 1024);
-  long long endMiB = startMiB + sizeB / (1024 * 1024);
-
-  if (endMiB - startMiB <= 600) {
-    QMessageBox::warning(this, "Partition Error",
-                         "Partition too small to split for EFI.");
-    return;
-  }
-
-  long long newEnd = endMiB - 512; // leave 512MiB for ESP
-  QString device = QString("/dev/%1").arg(drive);
-  QString partedBin = locatePartedBinary();
-  if (partedBin.isEmpty()) {
-    QMessageBox::critical(this, "Partition Error", "parted not found");
-    return;
-  }
-
-  QString partPath = QString("/dev/%1").arg(part);
-  long long newSize = newEnd - startMiB;
-
-  // Shrink the filesystem before resizing the partition
-  if (QProcess::execute("sudo", {"e2fsck", "-f", partPath}) != 0) {
-    QMessageBox::critical(this, "Partition Error",
-                         "Filesystem check failed before resize.");
-    return;
-  }
-  if (QProcess::execute("sudo", {"resize2fs", partPath,
-                                  QString("%1M").arg(newSize)}) != 0) {
-    QMessageBox::critical(this, "Partition Error",
-                         "Failed to shrink filesystem.");
-    return;
-  }
-
-  // Resize the existing partition
-  if (QProcess::execute("sudo",
-                        {partedBin, device, "--script", "resizepart",
-                         QString::number(partNum), QString("%1MiB").arg(newEnd)}) != 0) {
-    QMessageBox::critical(this, "Partition Error",
-                         "Failed to resize selected partition.");
-    return;
-  }
-
-  // Create the ESP in the freed space
-  if (QProcess::execute("sudo",
-                        {partedBin, device, "--script", "mkpart", "primary",
-                         "fat32", QString("%1MiB").arg(newEnd),
-                         QString("%1MiB").arg(endMiB)}) != 0) {
-    QMessageBox::critical(this, "Partition Error",
-                         "Failed to create EFI partition.");
-    return;
-  }
-
-  QProcess::execute("sudo", {"partprobe", device});
-  QProcess::execute("sudo", {"udevadm", "settle"});
-
-  // Determine new partition name (assume highest number)
-  proc.start("lsblk", QStringList() << "-nr" << "-o" << "NAME" << device);
-  proc.waitForFinished();
-  QStringList names = QString(proc.readAllStandardOutput()).split('\n', Qt::SkipEmptyParts);
-  QString newPart = names.last();
-  QProcess::execute("sudo",
-                    {"mkfs.fat", "-F32", QString("/dev/%1").arg(newPart)});
-
-  QProcess::execute("sudo",
-                    {partedBin, device, "--script", "name",
-                     QString::number(partNum + 1), "ESP"});
-  QProcess::execute("sudo",
-                    {partedBin, device, "--script", "set",
-                     QString::number(partNum + 1), "esp", "on"});
-
-  populatePartitionTable(drive);
-  appendLog("\xE2\x9C\x85 Partition adjusted for EFI.");
-  setWizardButtonEnabled(QWizard::NextButton, true);
+  jobs->submit(tr("Adjust %1 for EFI").arg(partition), drive,
+               [drive, partNum](JobContext &ctx) {
+                 QString error;
+                 if (carveEspFromPartition(drive, partNum, [&ctx](const QString &msg) { ctx.log(msg); },
+                                           &error).isEmpty())
+                   ctx.fail(error);
+               },
+               [this, drive](const JobResult &r) {
+                 if (r.canceled)
+                   return;
+                 if (!r.ok) {
+                   QMessageBox::critical(this, "Partition Error", r.error);
+                   return;
+                 }
+                 populatePartitionTable(drive);
+                 appendLog("\xE2\x9C\x85 Partition adjusted for EFI.");
+                 setWizardButtonEnabled(QWizard::NextButton, true);
+               });
 }
 
 
-void formatRootPartitionWithCheck(const QString &rootPart, const QString &device, std::function<void(const QString&)> appendLog) {
-    // Refresh kernel's partition table
-    QProcess::execute("sudo", {"partprobe", device});
-    QProcess::execute("sudo", {"udevadm", "settle"});
-    QThread::sleep(1);
-
-    // Wait for root partition to appear
-    if (!waitForPartition(rootPart)) {
-        QMessageBox::critical(nullptr, "Partition Error", "Newly created partition did not appear in time!");
-        return;
-    }
-
-    // Format ext4
-    int code = QProcess::execute("sudo", {"mkfs.ext4", "-F", rootPart});
-    if (code != 0) {
-        QMessageBox::critical(nullptr, "Partition Error", "Failed to format partition as ext4.");
-        return;
-    }
-    QProcess::execute("sudo", {"e2fsck", "-f", rootPart});
-
-    appendLog("Root partition formatted and checked successfully.");
-}
-
 void Installwizard::on_installButton_clicked() {
 
 
@@ -1025,33 +725,16 @@ void Installwizard::on_installButton_clicked() {
     return;
   }
 
-  SystemWorker *worker = new SystemWorker;
-  worker->setParameters(selectedDrive, username, password, rootPassword,
-                        desktopEnv, efiInstall);
+  InstallConfig config = configFromPages();
+  config.desktop = desktopEnv;
 
   // Prevent finishing until the background install completes
   setWizardButtonEnabled(QWizard::FinishButton, false);
 
-  QThread *thread = new QThread;
-  worker->moveToThread(thread);
   appendLog("Starting system installation…");
-
-  connect(thread, &QThread::started, worker, &SystemWorker::run);
-  connect(worker, &SystemWorker::logMessage, this,
-          [this](const QString &msg) { appendLog(msg); });
-  connect(worker, &SystemWorker::errorOccurred, this,
-          [this](const QString &msg) {
-            QMessageBox::critical(this, "Error", msg);
-          });
-
-  connect(worker, &SystemWorker::finished, this, [this]() {
+  runEngine(config, InstallEngine::Stage::System, [this]() {
     appendLog("\xE2\x9C\x85 Installation complete.");
     setWizardButtonEnabled(QWizard::FinishButton, true);
     QMessageBox::information(this, "Complete", "System installation finished.");
   });
-  connect(worker, &SystemWorker::finished, thread, &QThread::quit);
-  connect(worker, &SystemWorker::finished, worker, &QObject::deleteLater);
-  connect(thread, &QThread::finished, thread, &QObject::deleteLater);
-
-  thread->start();
 }
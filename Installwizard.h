@@ -4,7 +4,12 @@
 #include <QWizard>
 #include <QProgressBar>
 #include <QStringList>
+#include "installengine.h"
 #include "installerworker.h"
+#include <functional>
+
+class JobExecutor;
+class LogModel;
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -22,6 +27,9 @@ public:
 private:
     void installDependencies();
     Ui::Installwizard *ui;
+    LogModel *logModel;
+    JobExecutor *jobs;
+    int partitionTableGeneration = 0;
     QString selectedDrive;  // 🧠 TRACK THE CURRENT DRIVE
     bool efiInstall = false; // track chosen boot mode
     InstallerWorker::InstallMode installMode = InstallerWorker::InstallMode::WipeDrive;
@@ -30,13 +38,14 @@ private:
     void populateDrives(); // Populate the dropdown with available drives
     void downloadISO(QProgressBar *progressBar);
     void on_installButton_clicked();
-    void unmountDrive(const QString &drive);
     void appendLog(const QString &message);
     // Declare the methods that were missing
-    QStringList getAvailableDrives();        // Detect available drives
     void prepareDrive(const QString &drive);   // Prepare the selected drive
     void prepareExistingPartition(const QString &partition);
     void prepareFreeSpace(const QString &drive);
+    InstallConfig configFromPages() const;
+    void runEngine(const InstallConfig &config, InstallEngine::Stage stage,
+                   const std::function<void()> &onSuccess);
     void splitPartitionForEfi(const QString &partition);
     void populatePartitionTable(const QString &drive); // new
     void prepareForEfi(const QString &drive); // use free space for EFI
@@ -0,0 +1,323 @@
+#include "accountmanager.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <cerrno>
+#include <crypt.h>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+AccountManager::AccountManager(const QString &r) : root(r), editor(r) {}
+
+static bool readLines(const QString &path, QStringList *lines)
+{
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+    *lines = QString::fromUtf8(f.readAll()).split('\n', Qt::SkipEmptyParts);
+    return true;
+}
+
+static QByteArray joinLines(const QStringList &lines)
+{
+    return (lines.join('\n') + '\n').toUtf8();
+}
+
+bool AccountManager::load()
+{
+    const QString files[] = {"/etc/passwd", "/etc/shadow", "/etc/group", "/etc/gshadow"};
+    QStringList *targets[] = {&passwd, &shadow, &group, &gshadow};
+    for (int i = 0; i < 4; ++i) {
+        if (!readLines(editor.hostPath(files[i]), targets[i])) {
+            error = "Cannot read " + files[i] + " in the target";
+            return false;
+        }
+    }
+
+    // Honour the target's own UID range
+    QStringList defs;
+    if (readLines(editor.hostPath("/etc/login.defs"), &defs)) {
+        static const QRegularExpression ws("\\s+");
+        for (const QString &line : std::as_const(defs)) {
+            QStringList cols = line.trimmed().split(ws);
+            if (cols.size() == 2 && cols.at(0) == "UID_MIN")
+                uidMin = cols.at(1).toInt();
+            else if (cols.size() == 2 && cols.at(0) == "UID_MAX")
+                uidMax = cols.at(1).toInt();
+        }
+    }
+    return true;
+}
+
+int AccountManager::findEntry(const QStringList &lines, const QString &name) const
+{
+    for (int i = 0; i < lines.size(); ++i)
+        if (lines.at(i).section(':', 0, 0) == name)
+            return i;
+    return -1;
+}
+
+bool AccountManager::idInUse(const QStringList &lines, int id) const
+{
+    for (const QString &line : lines)
+        if (line.section(':', 2, 2).toInt() == id && !line.section(':', 2, 2).isEmpty())
+            return true;
+    return false;
+}
+
+int AccountManager::nextFreeId(const QStringList &lines, int from) const
+{
+    int id = from;
+    while (id <= uidMax && idInUse(lines, id))
+        ++id;
+    return id <= uidMax ? id : -1;
+}
+
+QString AccountManager::hashPassword(const QString &password)
+{
+    QByteArray clear = password.toUtf8();
+    std::unique_ptr<crypt_data> data(new crypt_data());
+    QString hash;
+
+#ifdef CRYPT_GENSALT_IMPLEMENTS_AUTO_ENTROPY
+    // libxcrypt: let it pick the salt bytes from the kernel
+    char salt[CRYPT_GENSALT_OUTPUT_SIZE];
+    if (!crypt_gensalt_rn("$y$", 0, nullptr, 0, salt, sizeof(salt)) &&
+        !crypt_gensalt_rn("$6$", 0, nullptr, 0, salt, sizeof(salt)))
+        salt[0] = '\0';
+#else
+    static const char alphabet[] = "./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    unsigned char raw[16];
+    char salt[3 + 16 + 1] = "$6$";
+    if (getrandom(raw, sizeof(raw), 0) != sizeof(raw)) {
+        salt[0] = '\0';
+    } else {
+        for (int i = 0; i < 16; ++i)
+            salt[3 + i] = alphabet[raw[i] % 64];
+        salt[19] = '\0';
+    }
+#endif
+
+    if (salt[0] != '\0') {
+        const char *out = crypt_r(clear.constData(), salt, data.get());
+        // Failure is reported as NULL or a string starting with '*'
+        if (out && out[0] != '*')
+            hash = QString::fromLatin1(out);
+    }
+    explicit_bzero(clear.data(), clear.size());
+    explicit_bzero(data.get(), sizeof(crypt_data));
+    return hash;
+}
+
+bool AccountManager::isCryptHash(const QString &value)
+{
+    // $id$ followed by at least salt and hash; SHA-crypt may carry rounds=N
+    static const QRegularExpression hash("^\\$(y|gy|7|6|5|2[aby])(\\$(rounds=[0-9]+|[./0-9A-Za-z]+)){2,}$");
+    return hash.match(value).hasMatch();
+}
+
+bool AccountManager::setPassword(const QString &name, const QString &password, bool isHash)
+{
+    int idx = findEntry(shadow, name);
+    if (idx < 0) {
+        error = "No shadow entry for " + name;
+        return false;
+    }
+    if (isHash && !isCryptHash(password)) {
+        error = "The password hash for " + name + " is not a crypt hash";
+        return false;
+    }
+    QString hash = isHash ? password : hashPassword(password);
+    if (hash.isEmpty()) {
+        error = "Could not hash the password for " + name;
+        return false;
+    }
+    QStringList fields = shadow.at(idx).split(':');
+    while (fields.size() < 9)
+        fields << QString();
+    fields[1] = hash;
+    fields[2] = QString::number(std::time(nullptr) / 86400);
+    shadow[idx] = fields.join(':');
+    return true;
+}
+
+bool AccountManager::addToGroup(const QString &groupName, const QString &user)
+{
+    int gi = findEntry(group, groupName);
+    if (gi < 0) {
+        error = QString("Group %1 does not exist in the target").arg(groupName);
+        return false;
+    }
+    QStringList fields = group.at(gi).split(':');
+    while (fields.size() < 4)
+        fields << QString();
+    QStringList members = fields.at(3).split(',', Qt::SkipEmptyParts);
+    if (!members.contains(user)) {
+        members << user;
+        fields[3] = members.join(',');
+        group[gi] = fields.join(':');
+    }
+
+    int si = findEntry(gshadow, groupName);
+    if (si >= 0) {
+        QStringList sfields = gshadow.at(si).split(':');
+        while (sfields.size() < 4)
+            sfields << QString();
+        QStringList smembers = sfields.at(3).split(',', Qt::SkipEmptyParts);
+        if (!smembers.contains(user)) {
+            smembers << user;
+            sfields[3] = smembers.join(',');
+            gshadow[si] = sfields.join(':');
+        }
+    }
+    return true;
+}
+
+bool AccountManager::addUser(const UserAccount &account)
+{
+    static const QRegularExpression validName("^[a-z_][a-z0-9_-]*\\$?$");
+    if (!validName.match(account.name).hasMatch() || account.name.size() > 32) {
+        error = "Invalid user name: " + account.name;
+        return false;
+    }
+
+    int pi = findEntry(passwd, account.name);
+    if (pi >= 0) {
+        QStringList fields = passwd.at(pi).split(':');
+        if (fields.size() >= 7) {
+            fields[6] = account.shell;
+            passwd[pi] = fields.join(':');
+        }
+    } else {
+        int uid = nextFreeId(passwd, uidMin);
+        if (uid < 0) {
+            error = "No free UID left";
+            return false;
+        }
+        // User private group, with the same number when it is free
+        int gid = idInUse(group, uid) ? nextFreeId(group, uidMin) : uid;
+        if (gid < 0) {
+            error = "No free GID left";
+            return false;
+        }
+        QString home = "/home/" + account.name;
+        passwd << QString("%1:x:%2:%3:%4:%5:%6")
+                      .arg(account.name).arg(uid).arg(gid)
+                      .arg(account.fullName, home, account.shell);
+        shadow << QString("%1:!:%2:0:99999:7:::").arg(account.name).arg(std::time(nullptr) / 86400);
+        if (findEntry(group, account.name) < 0) {
+            group << QString("%1:x:%2:").arg(account.name).arg(gid);
+            gshadow << QString("%1:!::").arg(account.name);
+        }
+        if (!populateHome(home, uid, gid))
+            return false;
+    }
+
+    for (const QString &g : account.groups)
+        if (!addToGroup(g, account.name))
+            return false;
+    return setPassword(account.name, account.password, account.passwordIsHash);
+}
+
+// Copy /etc/skel into the new home and hand everything to the user. Done
+// with plain file operations since the files are few and small.
+bool AccountManager::populateHome(const QString &home, int uid, int gid)
+{
+    QString hostHome = editor.hostPath(home);
+    QString skel = editor.hostPath("/etc/skel");
+    if (!QDir().mkpath(hostHome)) {
+        error = "Cannot create " + home;
+        return false;
+    }
+
+    QStringList created{hostHome};
+    QDirIterator it(skel, QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot,
+                    QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        QString src = it.next();
+        QFileInfo info = it.fileInfo();
+        QString dst = hostHome + src.mid(skel.size());
+        if (info.isSymLink()) {
+            QByteArray link = QFile::encodeName(src);
+            char buf[4096];
+            ssize_t n = ::readlink(link.constData(), buf, sizeof(buf) - 1);
+            if (n >= 0) {
+                buf[n] = '\0';
+                ::symlink(buf, QFile::encodeName(dst).constData());
+            }
+        } else if (info.isDir()) {
+            QDir().mkpath(dst);
+            ::chmod(QFile::encodeName(dst).constData(), 0755);
+        } else {
+            QFile::remove(dst);
+            QFile::copy(src, dst);
+        }
+        created << dst;
+    }
+
+    for (const QString &path : std::as_const(created))
+        ::lchown(QFile::encodeName(path).constData(), uid, gid);
+    ::chmod(QFile::encodeName(hostHome).constData(), 0700);
+    return true;
+}
+
+bool AccountManager::save()
+{
+    // Shadow data first, so the passwd and group lines that point at it
+    // never appear without it
+    const QString files[] = {"/etc/gshadow", "/etc/shadow", "/etc/group", "/etc/passwd"};
+    const QStringList *contents[] = {&gshadow, &shadow, &group, &passwd};
+    for (int i = 0; i < 4; ++i) {
+        if (!editor.writeFile(files[i], joinLines(*contents[i]))) {
+            error = editor.errorString();
+            return false;
+        }
+    }
+    return true;
+}
+
+QList<UserAccount> AccountManager::parseBatchFile(const QString &path, QString *errorOut)
+{
+    QList<UserAccount> accounts;
+    QStringList lines;
+    if (!readLines(path, &lines)) {
+        if (errorOut)
+            *errorOut = "Cannot read " + path;
+        return accounts;
+    }
+    for (int i = 0; i < lines.size(); ++i) {
+        QString line = lines.at(i).trimmed();
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+        // Hashes contain '$' but never ':', so a plain split is safe
+        QStringList fields = line.split(':');
+        if (fields.size() < 2 || fields.at(0).isEmpty()) {
+            if (errorOut)
+                *errorOut = QString("%1:%2: expected name:password").arg(path).arg(i + 1);
+            return QList<UserAccount>();
+        }
+        UserAccount a;
+        a.name = fields.at(0);
+        a.password = fields.at(1);
+        if (a.password.startsWith('$')) {
+            if (!isCryptHash(a.password)) {
+                if (errorOut)
+                    *errorOut = QString("%1:%2: the password of %3 starts with '$' but is not a crypt hash")
+                                    .arg(path).arg(i + 1).arg(a.name);
+                return QList<UserAccount>();
+            }
+            a.passwordIsHash = true;
+        }
+        a.groups = fields.value(2).split(',', Qt::SkipEmptyParts);
+        if (!fields.value(3).isEmpty())
+            a.shell = fields.at(3);
+        accounts << a;
+    }
+    return accounts;
+}
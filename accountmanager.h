@@ -0,0 +1,63 @@
+#ifndef ACCOUNTMANAGER_H
+#define ACCOUNTMANAGER_H
+
+#include "configeditor.h"
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+struct UserAccount {
+    QString name;
+    QString password;     // clear text, or a crypt hash when passwordIsHash
+    bool passwordIsHash = false;  // only parseBatchFile sets it, after isCryptHash()
+    QStringList groups;   // supplementary groups, e.g. wheel
+    QString shell = "/bin/bash";
+    QString fullName;
+};
+
+// Creates users and sets passwords on the target by editing passwd, shadow,
+// group and gshadow directly instead of running useradd and chpasswd in a
+// chroot. Passwords are hashed in process with crypt() (yescrypt where
+// libxcrypt supports it, SHA-512 otherwise), so clear text never reaches a
+// command line or the log. Changes are collected in memory and written by
+// save(), each file atomically through ConfigEditor.
+class AccountManager {
+public:
+    explicit AccountManager(const QString &root);
+
+    QString errorString() const { return error; }
+
+    bool load();
+    // Adds the user, or updates password, shell and groups when it exists,
+    // and fills a new home directory from /etc/skel.
+    bool addUser(const UserAccount &account);
+    // Hashes password unless isHash, in which case it must pass isCryptHash()
+    bool setPassword(const QString &name, const QString &password, bool isHash = false);
+    bool save();
+
+    static QString hashPassword(const QString &password);
+    // A yescrypt, gost-yescrypt, scrypt, SHA-512, SHA-256 or bcrypt hash in
+    // crypt(5) form
+    static bool isCryptHash(const QString &value);
+
+    // One user per line: name:password[:group,group...[:shell]]. Blank lines
+    // and lines starting with # are skipped. A password starting with '$' is
+    // taken as an existing crypt hash and must be a valid one.
+    static QList<UserAccount> parseBatchFile(const QString &path, QString *error);
+
+private:
+    int findEntry(const QStringList &lines, const QString &name) const;
+    bool idInUse(const QStringList &lines, int id) const;
+    int nextFreeId(const QStringList &lines, int from) const;
+    bool addToGroup(const QString &group, const QString &user);
+    bool populateHome(const QString &home, int uid, int gid);
+
+    QString root;
+    QString error;
+    ConfigEditor editor;
+    QStringList passwd, shadow, group, gshadow;
+    int uidMin = 1000;
+    int uidMax = 60000;
+};
+
+#endif // ACCOUNTMANAGER_H
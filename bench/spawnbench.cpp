@@ -0,0 +1,66 @@
+// Compares the cost of starting a trivial command the way SystemWorker used
+// to (QProcess running bash -c with sudo in front) against CommandRunner,
+// which spawns argv directly.
+#include "commandrunner.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QProcess>
+#include <QTextStream>
+#include <algorithm>
+#include <functional>
+#include <unistd.h>
+#include <vector>
+
+static void report(QTextStream &out, const QString &label, std::vector<qint64> samples)
+{
+    std::sort(samples.begin(), samples.end());
+    qint64 sum = 0;
+    for (qint64 s : samples)
+        sum += s;
+    out << QString("%1 mean %2 us, median %3 us, p95 %4 us\n")
+               .arg(label, -28)
+               .arg(sum / qint64(samples.size()) / 1000)
+               .arg(samples[samples.size() / 2] / 1000)
+               .arg(samples[samples.size() * 95 / 100] / 1000);
+}
+
+static std::vector<qint64> measure(int iterations, const std::function<void()> &fn)
+{
+    std::vector<qint64> samples;
+    samples.reserve(iterations);
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations; ++i) {
+        timer.start();
+        fn();
+        samples.push_back(timer.nsecsElapsed());
+    }
+    return samples;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+    int iterations = argc > 1 ? QString(argv[1]).toInt() : 200;
+    if (iterations <= 0)
+        iterations = 200;
+
+    // sudo only makes sense when we are root and it will not prompt
+    QString oldCommand = geteuid() == 0 ? "sudo true" : "true";
+    out << "Spawning " << iterations << " times, old path runs: bash -c \"" << oldCommand << "\"\n";
+
+    report(out, "QProcess + bash -c", measure(iterations, [&]() {
+        QProcess p;
+        p.start("/bin/bash", {"-c", oldCommand});
+        p.waitForFinished();
+    }));
+
+    CommandRunner runner([](const QString &, bool) {});
+    report(out, "CommandRunner argv", measure(iterations, [&]() { runner.run(QStringList{"true"}); }));
+
+    ProcessSpec spec;
+    spec.argv = {"true"};
+    spec.workingDir = "/";
+    report(out, "CommandRunner argv + cwd", measure(iterations, [&]() { runner.run(spec); }));
+    return 0;
+}
@@ -0,0 +1,16 @@
+QT -= gui
+QT += core
+CONFIG += console c++17
+CONFIG -= app_bundle
+
+TARGET = spawnbench
+INCLUDEPATH += ..
+
+SOURCES += \
+    spawnbench.cpp \
+    ../commandrunner.cpp \
+    ../tracer.cpp
+
+HEADERS += \
+    ../commandrunner.h \
+    ../tracer.h
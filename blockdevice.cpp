@@ -0,0 +1,78 @@
+#include "blockdevice.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+static QString readSysfs(const QString &path)
+{
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text))
+        return QString();
+    return QString::fromLatin1(f.readAll()).trimmed();
+}
+
+static QString kernelName(const QString &device)
+{
+    // Accept "/dev/sda2", "sda2" or a /dev/disk/by-* symlink
+    QString path = device.startsWith('/') ? device : "/dev/" + device;
+    QFileInfo fi(path);
+    if (fi.isSymLink())
+        path = fi.canonicalFilePath();
+    return QFileInfo(path).fileName();
+}
+
+BlockDeviceInfo BlockDeviceInfo::probe(const QString &device)
+{
+    BlockDeviceInfo info;
+    QString sysPath = QFileInfo("/sys/class/block/" + kernelName(device)).canonicalFilePath();
+    if (sysPath.isEmpty())
+        return info;
+
+    // Partitions are subdirectories of their disk and have no queue/
+    if (!QFileInfo::exists(sysPath + "/queue"))
+        sysPath = QFileInfo(sysPath).path();
+    if (!QFileInfo::exists(sysPath + "/queue"))
+        return info;
+
+    info.name = QFileInfo(sysPath).fileName();
+    info.valid = true;
+    info.rotational = readSysfs(sysPath + "/queue/rotational") != "0";
+    info.nvme = info.name.startsWith("nvme");
+    info.sizeBytes = readSysfs(sysPath + "/size").toLongLong() * 512;
+    info.discardGranularity = readSysfs(sysPath + "/queue/discard_granularity").toLongLong();
+    info.discardMaxBytes = readSysfs(sysPath + "/queue/discard_max_bytes").toLongLong();
+    // SCSI and SATA only; NVMe queues are deep enough not to matter
+    info.queueDepth = readSysfs(sysPath + "/device/queue_depth").toInt();
+    info.readAheadKiB = readSysfs(sysPath + "/queue/read_ahead_kb").toInt();
+    return info;
+}
+
+qint64 blockDeviceSize(const QString &device)
+{
+    QString sysPath = QFileInfo("/sys/class/block/" + kernelName(device)).canonicalFilePath();
+    if (sysPath.isEmpty())
+        return 0;
+    // sysfs always reports sizes in 512 byte sectors
+    return readSysfs(sysPath + "/size").toLongLong() * 512;
+}
+
+QStringList storageDriverModules(const QString &device)
+{
+    QString sysPath = QFileInfo("/sys/class/block/" + kernelName(device)).canonicalFilePath();
+    if (sysPath.isEmpty())
+        return {};
+    if (!QFileInfo::exists(sysPath + "/queue"))
+        sysPath = QFileInfo(sysPath).path();
+
+    // Up the device tree from the disk: the disk driver (sd, nvme,
+    // virtio_blk), then the host controller it hangs off
+    QStringList modules;
+    QString path = QFileInfo(sysPath + "/device").canonicalFilePath();
+    while (path.startsWith("/sys/devices/")) {
+        QString module = QFileInfo(path + "/driver/module").canonicalFilePath();
+        if (!module.isEmpty() && !modules.contains(QFileInfo(module).fileName()))
+            modules << QFileInfo(module).fileName();
+        path = QFileInfo(path).path();
+    }
+    return modules;
+}
@@ -0,0 +1,35 @@
+#ifndef BLOCKDEVICE_H
+#define BLOCKDEVICE_H
+
+#include <QString>
+#include <QStringList>
+
+// Storage characteristics of a disk as reported by sysfs. Partitions are
+// resolved to the disk they live on, since the queue attributes only exist
+// for whole devices.
+struct BlockDeviceInfo {
+    QString name;       // kernel name of the disk, e.g. "sda" or "nvme0n1"
+    bool valid = false;
+    bool rotational = true;
+    bool nvme = false;
+    qint64 sizeBytes = 0;
+    qint64 discardGranularity = 0;
+    qint64 discardMaxBytes = 0;
+    int queueDepth = 0;         // device command queue (NCQ) depth; 0 if not reported
+    int readAheadKiB = 0;
+
+    bool isFlash() const { return valid && !rotational; }
+    bool supportsDiscard() const { return discardGranularity > 0 && discardMaxBytes > 0; }
+
+    static BlockDeviceInfo probe(const QString &device);
+};
+
+// Size in bytes of any block device node, partition or disk.
+qint64 blockDeviceSize(const QString &device);
+
+// Kernel modules of the drivers between a disk (or the disk a partition is
+// on) and the system bus, e.g. {"nvme"} or {"sd_mod", "ahci"}. Drivers
+// built into the kernel have no module and are left out.
+QStringList storageDriverModules(const QString &device);
+
+#endif // BLOCKDEVICE_H
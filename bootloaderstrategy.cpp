@@ -0,0 +1,147 @@
+#include "bootloaderstrategy.h"
+#include "commandrunner.h"
+#include "configeditor.h"
+#include <QRegularExpression>
+
+namespace {
+
+// kind is "image" or "uki"; the fallback is default without autodetect
+QString linuxPreset(const QString &kind, const QString &image, const QString &fallbackImage, bool fallback)
+{
+    QString preset = QString("# mkinitcpio preset file for the 'linux' package\n"
+                             "ALL_config=\"/etc/mkinitcpio.conf\"\n"
+                             "ALL_kver=\"/boot/vmlinuz-linux\"\n"
+                             "\n"
+                             "PRESETS=(\n"
+                             "  default\n"
+                             "%1"
+                             ")\n"
+                             "\n"
+                             "default_%2=\"%3\"\n")
+                         .arg(fallback ? "  fallback\n" : "", kind, image);
+    if (fallback)
+        preset += QString("fallback_%1=\"%2\"\n"
+                          "fallback_options=\"-S autodetect\"\n")
+                      .arg(kind, fallbackImage);
+    return preset;
+}
+
+// GRUB from the repositories. os-prober scans every partition of every
+// disk and mounts what it finds, so it is only installed when disks to
+// look at are named; systems found anywhere else are left off the menu.
+class GrubStrategy : public BootloaderStrategy {
+public:
+    explicit GrubStrategy(const QStringList &devices) : osProberDevices(devices) {}
+
+    QString name() const override { return "grub"; }
+
+    QStringList packages() const override {
+        QStringList list{"grub"};
+        if (!osProberDevices.isEmpty())
+            list << "os-prober";
+        return list;
+    }
+
+    bool configure(ConfigEditor &config, const BootTarget &) const override {
+        const QString file = "/etc/default/grub";
+        if (config.removeLines(file, QRegularExpression("2025-05-01-10-09-37-00")) < 0)
+            return false;
+        QList<QPair<QString, QString>> values{{"GRUB_DISABLE_LINUX_UUID", "false"}};
+        if (osProberDevices.isEmpty()) {
+            values.append({"GRUB_DISABLE_OS_PROBER", "true"});
+        } else {
+            values.append({"GRUB_DISABLE_OS_PROBER", "false"});
+            values.append({"GRUB_OS_PROBER_SKIP_LIST", "\"" + skippedFilesystems().join(' ') + "\""});
+        }
+        return config.setValues(file, values);
+    }
+
+    QList<QStringList> installCommands(const BootTarget &target) const override {
+        QStringList install;
+        if (target.efi)
+            install = {"grub-install", "--target=x86_64-efi", "--efi-directory=/boot", "--bootloader-id=GRUB"};
+        else
+            install = {"grub-install", "--target=i386-pc", "/dev/" + target.drive};
+        return {install, {"grub-mkconfig", "-o", "/boot/grub/grub.cfg"}};
+    }
+
+    QString installedMarker() const override { return "/boot/grub/grub.cfg"; }
+
+private:
+    // Filesystem UUIDs on every disk not named, for GRUB_OS_PROBER_SKIP_LIST
+    QStringList skippedFilesystems() const {
+        static const QRegularExpression row("PKNAME=\"([^\"]*)\" UUID=\"([^\"]*)\"");
+        QStringList uuids;
+        const QStringList lines = CommandRunner::capture({"lsblk", "-nP", "-o", "PKNAME,UUID"}).split('\n');
+        for (const QString &line : lines) {
+            QRegularExpressionMatch m = row.match(line);
+            if (m.hasMatch() && !m.captured(2).isEmpty() && !osProberDevices.contains(m.captured(1)))
+                uuids << m.captured(2);
+        }
+        return uuids;
+    }
+
+    QStringList osProberDevices;
+};
+
+// systemd-boot, which is part of systemd and so already installed, loading
+// unified kernel images: kernel, initramfs and command line in one EFI
+// binary that mkinitcpio writes to the ESP, where systemd-boot finds it
+// without a config of its own. UEFI only.
+class SystemdBootStrategy : public BootloaderStrategy {
+public:
+    QString name() const override { return "systemd-boot"; }
+    bool supportsBios() const override { return false; }
+    QStringList packages() const override { return {}; }
+
+    QString mkinitcpioPreset(bool fallback) const override {
+        return linuxPreset("uki", "/boot/EFI/Linux/arch-linux.efi", "/boot/EFI/Linux/arch-linux-fallback.efi",
+                           fallback);
+    }
+    QString initramfsImage() const override { return "/boot/EFI/Linux/arch-linux.efi"; }
+
+    // Embedded in the images, so it has to exist before mkinitcpio runs
+    bool prepareInitramfs(ConfigEditor &config, const BootTarget &target) const override {
+        return config.writeFile("/etc/kernel/cmdline",
+                                QString("root=UUID=%1 rootfstype=%2 rw\n")
+                                    .arg(target.rootUuid, target.rootFsType)
+                                    .toUtf8());
+    }
+
+    bool configure(ConfigEditor &config, const BootTarget &) const override {
+        return config.writeFile("/boot/loader/loader.conf",
+                                "default arch-linux.efi\n"
+                                "timeout 3\n"
+                                "editor no\n");
+    }
+
+    QList<QStringList> installCommands(const BootTarget &) const override {
+        return {{"bootctl", "--esp-path=/boot", "install"},
+                // Updates the ESP copy when the systemd package is upgraded
+                {"systemctl", "enable", "systemd-boot-update.service"}};
+    }
+
+    QString installedMarker() const override { return "/boot/EFI/systemd/systemd-bootx64.efi"; }
+};
+
+} // namespace
+
+QString BootloaderStrategy::mkinitcpioPreset(bool fallback) const
+{
+    return linuxPreset("image", "/boot/initramfs-linux.img", "/boot/initramfs-linux-fallback.img", fallback);
+}
+
+std::unique_ptr<BootloaderStrategy> BootloaderStrategy::create(const QString &name,
+                                                               const QStringList &osProberDevices)
+{
+    if (name == "grub")
+        return std::make_unique<GrubStrategy>(osProberDevices);
+    if (name == "systemd-boot")
+        return std::make_unique<SystemdBootStrategy>();
+    return nullptr;
+}
+
+QStringList BootloaderStrategy::available()
+{
+    return {"grub", "systemd-boot"};
+}
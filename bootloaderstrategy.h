@@ -0,0 +1,52 @@
+#ifndef BOOTLOADERSTRATEGY_H
+#define BOOTLOADERSTRATEGY_H
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <memory>
+
+class ConfigEditor;
+
+// What a bootloader is installed for
+struct BootTarget {
+    QString drive;      // disk for a BIOS install, e.g. "sda"
+    bool efi = false;   // the ESP is mounted on /boot
+    QString rootUuid;   // of the root filesystem
+    QString rootFsType;
+};
+
+// Everything the installer needs to know about one bootloader: what it
+// installs, how the initramfs has to look for it, which files it needs and
+// which commands put it in place. Commands run inside the target; files are
+// written through the ConfigEditor of the target.
+class BootloaderStrategy {
+public:
+    virtual ~BootloaderStrategy() = default;
+
+    virtual QString name() const = 0;
+    virtual bool supportsBios() const { return true; }
+    virtual QStringList packages() const = 0;
+
+    // The kernel's mkinitcpio preset, with or without the fallback image. A
+    // bootloader that boots unified kernel images has mkinitcpio build them
+    // instead of a bare initramfs, so the images are generated once.
+    virtual QString mkinitcpioPreset(bool fallback) const;
+    // Written by mkinitcpio with the preset; checked when resuming
+    virtual QString initramfsImage() const { return "/boot/initramfs-linux.img"; }
+    // Files mkinitcpio reads, written before it runs
+    virtual bool prepareInitramfs(ConfigEditor &, const BootTarget &) const { return true; }
+
+    virtual bool configure(ConfigEditor &config, const BootTarget &target) const = 0;
+    virtual QList<QStringList> installCommands(const BootTarget &target) const = 0;
+    // Present once the bootloader is installed; checked when resuming
+    virtual QString installedMarker() const = 0;
+
+    // osProberDevices: disks GRUB looks for other systems on; none leaves
+    // os-prober out. Ignored by the other bootloaders.
+    static std::unique_ptr<BootloaderStrategy> create(const QString &name,
+                                                      const QStringList &osProberDevices = QStringList());
+    static QStringList available();
+};
+
+#endif // BOOTLOADERSTRATEGY_H
@@ -0,0 +1,20 @@
+#ifndef CANCELTOKEN_H
+#define CANCELTOKEN_H
+
+#include <atomic>
+#include <memory>
+
+// Shared flag long-running work polls to find out it should stop. Copies
+// share the flag. cancel() only stores to a lock-free atomic, so it may be
+// called from a signal handler.
+class CancelToken {
+public:
+    CancelToken() : flag(std::make_shared<std::atomic<bool>>(false)) {}
+    void cancel() const { flag->store(true); }
+    bool isCanceled() const { return flag->load(); }
+
+private:
+    std::shared_ptr<std::atomic<bool>> flag;
+};
+
+#endif // CANCELTOKEN_H
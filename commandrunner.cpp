@@ -0,0 +1,464 @@
+#include "commandrunner.h"
+#include "tracer.h"
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMap>
+#include <QThread>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <functional>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+extern char **environ;
+
+// A line longer than this is passed on in pieces rather than buffered
+static const int MaxLineBytes = 64 * 1024;
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))
+#define HAVE_SPAWN_CHDIR 1
+#endif
+
+namespace {
+
+class LineSplitter {
+public:
+    LineSplitter(const CommandRunner::LineFn &fn, bool isStderr) : fn(fn), isStderr(isStderr) {}
+
+    void feed(const char *data, ssize_t len) {
+        for (ssize_t i = 0; i < len; ++i) {
+            char c = data[i];
+            // pacman and friends redraw progress with \r
+            if (c == '\n' || c == '\r') {
+                flush();
+                continue;
+            }
+            partial += c;
+            if (partial.size() >= MaxLineBytes)
+                flush();
+        }
+    }
+
+    void flush() {
+        if (!partial.isEmpty())
+            fn(QString::fromLocal8Bit(partial), isStderr);
+        partial.clear();
+    }
+
+private:
+    CommandRunner::LineFn fn;
+    bool isStderr;
+    QByteArray partial;
+};
+
+// NULL terminated char* array over a list of strings, built before fork so
+// the child does not allocate.
+class CStringArray {
+public:
+    explicit CStringArray(const QStringList &list) {
+        for (const QString &s : list)
+            storage.push_back(s.toLocal8Bit());
+        for (QByteArray &b : storage)
+            pointers.push_back(b.data());
+        pointers.push_back(nullptr);
+    }
+    char **data() { return pointers.data(); }
+
+private:
+    std::vector<QByteArray> storage;
+    std::vector<char *> pointers;
+};
+
+} // namespace
+
+QString CommandResult::usageSummary() const
+{
+    return QString("%1 s wall, %2 s user, %3 s sys, max RSS %4 MiB, %5 MiB read, %6 MiB written")
+        .arg(elapsedMs / 1000.0, 0, 'f', 1)
+        .arg(userSeconds, 0, 'f', 1)
+        .arg(systemSeconds, 0, 'f', 1)
+        .arg(maxRssKiB / 1024)
+        .arg(blocksIn / 2048)
+        .arg(blocksOut / 2048);
+}
+
+QString ProcessSpec::displayString() const
+{
+    QString s = argv.join(' ');
+    if (!chrootDir.isEmpty())
+        s = QString("[chroot %1] %2").arg(chrootDir, s);
+    return s;
+}
+
+CommandRunner::CommandRunner(const LineFn &fn, int tail) : onLine(fn), tailBytes(tail) {}
+
+static thread_local const CancelToken *threadCancel = nullptr;
+
+CommandRunner::CancelScope::CancelScope(const CancelToken &t) : token(t), previous(threadCancel)
+{
+    threadCancel = &token;
+}
+
+CommandRunner::CancelScope::~CancelScope()
+{
+    threadCancel = previous;
+}
+
+bool CommandRunner::isCanceled()
+{
+    return threadCancel && threadCancel->isCanceled();
+}
+
+bool CommandRunner::sleepUnlessCanceled(int ms)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (timer.elapsed() < ms) {
+        if (isCanceled())
+            return false;
+        QThread::msleep(qMin<qint64>(250, ms - timer.elapsed()));
+    }
+    return !isCanceled();
+}
+
+QStringList CommandRunner::processTree(qint64 rootPid)
+{
+    struct Proc {
+        qint64 ppid = 0;
+        QString line;
+    };
+    QMap<qint64, Proc> procs;
+    const QStringList pids = QDir("/proc").entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const QString &name : pids) {
+        bool isPid = false;
+        qint64 pid = name.toLongLong(&isPid);
+        if (!isPid)
+            continue;
+        QFile stat("/proc/" + name + "/stat");
+        if (!stat.open(QIODevice::ReadOnly))
+            continue;
+        // pid (comm) state ppid ...; comm may itself contain ") "
+        QByteArray data = stat.readAll();
+        int start = data.indexOf('(');
+        int end = data.lastIndexOf(')');
+        if (start < 0 || end < start)
+            continue;
+        QString comm = QString::fromLocal8Bit(data.mid(start + 1, end - start - 1));
+        QList<QByteArray> fields = data.mid(end + 2).split(' ');
+        if (fields.size() < 2)
+            continue;
+        QFile wchanFile("/proc/" + name + "/wchan");
+        QString wchan = wchanFile.open(QIODevice::ReadOnly) ? QString::fromLatin1(wchanFile.readAll()) : QString();
+        QFile cmdFile("/proc/" + name + "/cmdline");
+        QString cmdline = cmdFile.open(QIODevice::ReadOnly)
+                              ? QString::fromLocal8Bit(cmdFile.read(512)).replace(QChar(0), ' ').trimmed()
+                              : QString();
+        Proc p;
+        p.ppid = fields.at(1).toLongLong();
+        p.line = QString("%1 %2 %3 [%4] %5")
+                     .arg(pid).arg(QString::fromLatin1(fields.at(0)), comm,
+                                   wchan.isEmpty() || wchan == "0" ? QString("-") : wchan, cmdline);
+        procs.insert(pid, p);
+    }
+
+    QStringList out;
+    std::function<void(qint64, int)> walk = [&](qint64 pid, int depth) {
+        if (!procs.contains(pid))
+            return;
+        out << QString(depth * 2, ' ') + procs.value(pid).line;
+        for (auto it = procs.constBegin(); it != procs.constEnd(); ++it)
+            if (it.value().ppid == pid)
+                walk(it.key(), depth + 1);
+    };
+    walk(rootPid, 0);
+    return out;
+}
+
+QStringList CommandRunner::privileged(const QStringList &argv)
+{
+    if (geteuid() == 0)
+        return argv;
+    return QStringList{"sudo"} + argv;
+}
+
+QStringList CommandRunner::chrootEnvironment()
+{
+    return {"PATH=/usr/local/sbin:/usr/local/bin:/usr/bin",
+            "HOME=/root",
+            "LANG=C.UTF-8",
+            "TERM=dumb"};
+}
+
+CommandResult CommandRunner::run(const QStringList &argv)
+{
+    ProcessSpec spec;
+    spec.argv = argv;
+    return run(spec);
+}
+
+CommandResult CommandRunner::run(const ProcessSpec &spec)
+{
+    CommandResult result;
+    QElapsedTimer timer;
+    timer.start();
+    if (spec.argv.isEmpty())
+        return result;
+    if (isCanceled()) {
+        result.canceled = true;
+        result.watchdog = "canceled";
+        return result;
+    }
+
+    // Name the span after the program, not the sudo in front of it
+    const QString &program = spec.argv.first() == "sudo" ? spec.argv.value(1) : spec.argv.first();
+    TraceSpan span("process", program.section('/', -1));
+    if (Tracer::instance().isEnabled())
+        span.setDetail(spec.displayString());
+    qint64 outputBytes = 0;
+
+    int outPipe[2], errPipe[2], inPipe[2] = {-1, -1};
+    if (pipe2(outPipe, O_CLOEXEC) != 0)
+        return result;
+    if (pipe2(errPipe, O_CLOEXEC) != 0) {
+        close(outPipe[0]);
+        close(outPipe[1]);
+        return result;
+    }
+    int stdinFd;
+    if (!spec.stdinData.isEmpty() && pipe2(inPipe, O_CLOEXEC) == 0) {
+        stdinFd = inPipe[0];
+        fcntl(inPipe[1], F_SETFL, O_NONBLOCK);
+    } else {
+        stdinFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+
+    CStringArray argv(spec.argv);
+    CStringArray envp(spec.env);
+    char **childEnv = spec.env.isEmpty() ? environ : envp.data();
+    QByteArray root = spec.chrootDir.toLocal8Bit();
+    QByteArray cwd = spec.workingDir.isEmpty() ? QByteArray("/") : spec.workingDir.toLocal8Bit();
+
+    pid_t pid = -1;
+    bool needFork = !spec.chrootDir.isEmpty();
+#ifndef HAVE_SPAWN_CHDIR
+    needFork = needFork || !spec.workingDir.isEmpty();
+#endif
+
+    if (!needFork) {
+        // SIGPIPE is ignored in this process (see main.cpp); children
+        // should get the default back
+        posix_spawnattr_t attr;
+        posix_spawnattr_init(&attr);
+        sigset_t defaults;
+        sigemptyset(&defaults);
+        sigaddset(&defaults, SIGPIPE);
+        posix_spawnattr_setsigdefault(&attr, &defaults);
+        // Its own process group, so the watchdog reaches grandchildren
+        posix_spawnattr_setpgroup(&attr, 0);
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETPGROUP);
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        if (stdinFd >= 0)
+            posix_spawn_file_actions_adddup2(&actions, stdinFd, STDIN_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, outPipe[1], STDOUT_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, errPipe[1], STDERR_FILENO);
+#ifdef HAVE_SPAWN_CHDIR
+        if (!spec.workingDir.isEmpty())
+            posix_spawn_file_actions_addchdir_np(&actions, cwd.constData());
+#endif
+        if (posix_spawnp(&pid, argv.data()[0], &actions, &attr, argv.data(), childEnv) != 0)
+            pid = -1;
+        posix_spawn_file_actions_destroy(&actions);
+        posix_spawnattr_destroy(&attr);
+    } else {
+        // Everything the child touches is prepared above so it only makes
+        // async-signal-safe calls until exec.
+        pid = fork();
+        if (pid == 0) {
+            signal(SIGPIPE, SIG_DFL);
+            setpgid(0, 0);
+            if (stdinFd >= 0)
+                dup2(stdinFd, STDIN_FILENO);
+            dup2(outPipe[1], STDOUT_FILENO);
+            dup2(errPipe[1], STDERR_FILENO);
+            if (!root.isEmpty() && chroot(root.constData()) != 0)
+                _exit(126);
+            if (chdir(cwd.constData()) != 0)
+                _exit(126);
+            execvpe(argv.data()[0], argv.data(), childEnv);
+            _exit(127);
+        }
+    }
+
+    if (stdinFd >= 0)
+        close(stdinFd);
+    close(outPipe[1]);
+    close(errPipe[1]);
+    if (pid < 0) {
+        close(outPipe[0]);
+        close(errPipe[0]);
+        if (inPipe[1] >= 0)
+            close(inPipe[1]);
+        return result;
+    }
+
+    // Escalates one level per call once a limit is hit: SIGTERM to the
+    // group, SIGKILL after the grace period, then gives up on the pipes
+    // (something outside the group may still hold them open)
+    QElapsedTimer sinceOutput;
+    sinceOutput.start();
+    const bool watched = spec.timeoutMs > 0 || spec.stallMs > 0 || threadCancel;
+    int escalation = 0;
+    qint64 escalatedAt = 0;
+    auto watchdog = [&]() {
+        if (escalation == 0) {
+            QString reason;
+            if (isCanceled())
+                reason = "canceled";
+            else if (spec.timeoutMs > 0 && timer.elapsed() > spec.timeoutMs)
+                reason = QString("still running after %1 s").arg(spec.timeoutMs / 1000);
+            else if (spec.stallMs > 0 && sinceOutput.elapsed() > spec.stallMs)
+                reason = QString("no output for %1 s").arg(spec.stallMs / 1000);
+            if (reason.isEmpty())
+                return false;
+            result.canceled = reason == "canceled";
+            result.watchdog = reason;
+            result.processDump = processTree(pid);
+            kill(-pid, SIGTERM);
+        } else if (timer.elapsed() - escalatedAt < KillGraceMs) {
+            return false;
+        } else if (escalation == 1) {
+            kill(-pid, SIGKILL);
+        } else {
+            return true;
+        }
+        ++escalation;
+        escalatedAt = timer.elapsed();
+        return false;
+    };
+
+    LineSplitter outLines(onLine, false);
+    LineSplitter errLines(onLine, true);
+    pollfd fds[3] = {{outPipe[0], POLLIN, 0}, {errPipe[0], POLLIN, 0}, {inPipe[1], POLLOUT, 0}};
+    int written = 0;
+    int openFds = 2;
+    char buf[16384];
+    while (openFds > 0) {
+        if (watched && watchdog())
+            break;
+        if (poll(fds, 3, watched ? 250 : -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[2].fd >= 0 && (fds[2].revents & (POLLOUT | POLLERR | POLLHUP))) {
+            ssize_t n = write(fds[2].fd, spec.stdinData.constData() + written,
+                              spec.stdinData.size() - written);
+            if (n > 0)
+                written += static_cast<int>(n);
+            if ((n < 0 && errno != EAGAIN && errno != EINTR) || written >= spec.stdinData.size()) {
+                close(fds[2].fd);
+                fds[2].fd = -1;
+            }
+        }
+        for (int i = 0; i < 2; ++i) {
+            if (fds[i].fd < 0 || !(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+            ssize_t n = read(fds[i].fd, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                --openFds;
+                continue;
+            }
+            (i == 0 ? outLines : errLines).feed(buf, n);
+            sinceOutput.restart();
+            outputBytes += n;
+            result.tail.append(buf, static_cast<int>(n));
+            // Trim lazily so the tail costs O(1) amortised per byte
+            if (result.tail.size() > 2 * tailBytes)
+                result.tail.remove(0, result.tail.size() - tailBytes);
+        }
+    }
+    for (pollfd &p : fds)
+        if (p.fd >= 0)
+            close(p.fd);
+    outLines.flush();
+    errLines.flush();
+    if (result.tail.size() > tailBytes)
+        result.tail.remove(0, result.tail.size() - tailBytes);
+
+    // The pipes can close before the child exits
+    int status = 0;
+    rusage ru{};
+    for (;;) {
+        pid_t r = wait4(pid, &status, watched ? WNOHANG : 0, &ru);
+        if (r == pid || (r < 0 && errno != EINTR))
+            break;
+        if (r == 0) {
+            watchdog();
+            QThread::msleep(100);
+        }
+    }
+    if (WIFEXITED(status))
+        result.exitCode = WEXITSTATUS(status);
+    else if (WIFSIGNALED(status))
+        result.termSignal = WTERMSIG(status);
+    result.elapsedMs = timer.elapsed();
+    result.userSeconds = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6;
+    result.systemSeconds = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+    result.maxRssKiB = ru.ru_maxrss;
+    result.blocksIn = ru.ru_inblock;
+    result.blocksOut = ru.ru_oublock;
+    span.setBytes(outputBytes);
+    span.setExitCode(result.termSignal ? 128 + result.termSignal : result.exitCode);
+    return result;
+}
+
+// The short commands have nobody to log to; a stopped one is reported here
+static void reportWatchdog(const CommandResult &r, const QStringList &argv)
+{
+    if (r.watchdog.isEmpty() || r.canceled)
+        return;
+    qWarning().noquote() << "Watchdog:" << argv.join(' ') << r.watchdog;
+    for (const QString &line : r.processDump)
+        qWarning().noquote() << " " << line;
+}
+
+int CommandRunner::execute(const QStringList &argv)
+{
+    CommandRunner runner([](const QString &, bool) {});
+    ProcessSpec spec;
+    spec.argv = privileged(argv);
+    spec.timeoutMs = ShortCommandTimeoutMs;
+    CommandResult r = runner.run(spec);
+    reportWatchdog(r, argv);
+    return r.termSignal || !r.watchdog.isEmpty() ? -1 : r.exitCode;
+}
+
+QString CommandRunner::capture(const QStringList &argv, int *exitCode)
+{
+    QString out;
+    CommandRunner runner([&out](const QString &line, bool isStderr) {
+        if (!isStderr)
+            out += line + '\n';
+    });
+    ProcessSpec spec;
+    spec.argv = privileged(argv);
+    spec.timeoutMs = ShortCommandTimeoutMs;
+    CommandResult r = runner.run(spec);
+    reportWatchdog(r, argv);
+    if (exitCode)
+        *exitCode = r.termSignal || !r.watchdog.isEmpty() ? -1 : r.exitCode;
+    return out;
+}
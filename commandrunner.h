@@ -0,0 +1,105 @@
+#ifndef COMMANDRUNNER_H
+#define COMMANDRUNNER_H
+
+#include "canceltoken.h"
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <functional>
+
+struct CommandResult {
+    int exitCode = -1;
+    int termSignal = 0;      // non-zero when the child was killed by a signal
+    qint64 elapsedMs = 0;
+    double userSeconds = 0.0;
+    double systemSeconds = 0.0;
+    long maxRssKiB = 0;
+    long blocksIn = 0;       // ru_inblock, 512 byte units
+    long blocksOut = 0;      // ru_oublock, 512 byte units
+    QByteArray tail;         // last output of both streams, for error reports
+    bool canceled = false;   // stopped, or never started, because of a cancel
+    QString watchdog;        // why the watchdog stopped it; empty if it did not
+    QStringList processDump; // the child's process tree when it was stopped
+
+    bool ok() const { return termSignal == 0 && exitCode == 0 && watchdog.isEmpty(); }
+    QString usageSummary() const;
+};
+
+// What to start: an argv vector, never a shell string, plus the optional
+// in-process setup the child needs before exec.
+struct ProcessSpec {
+    QStringList argv;
+    QString chrootDir;     // enter this root before exec (requires root)
+    QString workingDir;    // relative to chrootDir when both are set
+    QStringList env;       // "KEY=value"; empty inherits our environment
+    QByteArray stdinData;  // fed to the child's stdin, which is /dev/null otherwise
+    int timeoutMs = 0;     // budget for the whole run; 0 for none
+    int stallMs = 0;       // longest silence on stdout/stderr; 0 for none
+
+    // Secrets passed through stdin must not end up in the log
+    QString displayString() const;
+};
+
+// Runs a child process and hands its stdout/stderr to the caller one line
+// at a time as they arrive, instead of buffering everything until exit.
+// Memory stays bounded: lines are never accumulated, only a tail of the
+// most recent output is kept for error messages. Exit status and resource
+// usage come straight from wait4().
+//
+// Children are started with posix_spawn and no shell. Entering a chroot
+// needs a fork so the child can call chroot() itself before exec. When we
+// are not root, privileged() prefixes argv with sudo; as root (the normal
+// case, see main.cpp) nothing is added.
+//
+// Each child leads its own process group. A watchdog stops the group when
+// the spec's time budget runs out, when the child has been silent for
+// longer than its stall limit, or when the thread's CancelScope is
+// canceled: it records the process tree from /proc (states and wait
+// channels show what is stuck), sends SIGTERM, and SIGKILL after
+// KillGraceMs.
+class CommandRunner {
+public:
+    using LineFn = std::function<void(const QString &line, bool isStderr)>;
+
+    static const int KillGraceMs = 10000;
+    // Budget of execute() and capture(), which have no spec to carry one
+    static const int ShortCommandTimeoutMs = 15 * 60 * 1000;
+
+    // While one exists, every command started on this thread, including
+    // those of execute() and capture(), is stopped when token is canceled
+    // and a canceled token keeps new ones from starting
+    class CancelScope {
+    public:
+        explicit CancelScope(const CancelToken &token);
+        ~CancelScope();
+        CancelScope(const CancelScope &) = delete;
+        CancelScope &operator=(const CancelScope &) = delete;
+
+    private:
+        CancelToken token;
+        const CancelToken *previous;
+    };
+    static bool isCanceled();
+    // Sleeps, returning false early if this thread's scope gets canceled
+    static bool sleepUnlessCanceled(int ms);
+    // "pid state name [wchan] cmdline" for pid and its descendants
+    static QStringList processTree(qint64 pid);
+
+    explicit CommandRunner(const LineFn &onLine, int tailBytes = 16 * 1024);
+
+    CommandResult run(const ProcessSpec &spec);
+    CommandResult run(const QStringList &argv);
+
+    static QStringList privileged(const QStringList &argv);
+    static QStringList chrootEnvironment();
+
+    // Convenience wrappers for short commands whose output is not logged
+    static int execute(const QStringList &argv);
+    static QString capture(const QStringList &argv, int *exitCode = nullptr);
+
+private:
+    LineFn onLine;
+    int tailBytes;
+};
+
+#endif // COMMANDRUNNER_H
@@ -0,0 +1,264 @@
+#include "configeditor.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+ConfigEditor::ConfigEditor(const QString &r) : root(r) {}
+
+QString ConfigEditor::hostPath(const QString &path) const
+{
+    // cleanPath on the inside path first so ".." cannot climb out of root
+    return QDir::cleanPath(root + QDir::cleanPath("/" + path));
+}
+
+bool ConfigEditor::fail(const QString &message)
+{
+    error = message;
+    return false;
+}
+
+bool ConfigEditor::exists(const QString &path) const
+{
+    return QFileInfo::exists(hostPath(path));
+}
+
+bool ConfigEditor::readLines(const QString &path, QStringList *lines, bool mustExist) const
+{
+    lines->clear();
+    QFile f(hostPath(path));
+    if (!f.exists())
+        return !mustExist;
+    if (!f.open(QIODevice::ReadOnly))
+        return false;
+    *lines = QString::fromUtf8(f.readAll()).split('\n');
+    // A trailing newline is not an extra empty line
+    if (!lines->isEmpty() && lines->last().isEmpty())
+        lines->removeLast();
+    return true;
+}
+
+bool ConfigEditor::writeFile(const QString &path, const QByteArray &content)
+{
+    QString target = hostPath(path);
+    // QSaveFile resolves symlinks, and an absolute link inside the target
+    // would point back into the host system
+    if (QFileInfo(target).isSymLink())
+        return fail(path + " is a symlink, refusing to write through it");
+    QDir().mkpath(QFileInfo(target).absolutePath());
+
+    QSaveFile f(target);
+    if (!f.open(QIODevice::WriteOnly))
+        return fail(QString("Cannot write %1: %2").arg(path, f.errorString()));
+    if (f.write(content) != content.size() || !f.commit())
+        return fail(QString("Cannot write %1: %2").arg(path, f.errorString()));
+
+    QFile check(target);
+    if (!check.open(QIODevice::ReadOnly) || check.readAll() != content)
+        return fail(path + " does not contain what was written");
+    return true;
+}
+
+bool ConfigEditor::commit(const QString &path, const QStringList &lines)
+{
+    QByteArray content = lines.join('\n').toUtf8();
+    if (!lines.isEmpty())
+        content += '\n';
+    return writeFile(path, content);
+}
+
+bool ConfigEditor::contains(const QString &path, const QRegularExpression &re) const
+{
+    QStringList lines;
+    if (!readLines(path, &lines, true))
+        return false;
+    for (const QString &line : std::as_const(lines))
+        if (re.match(line).hasMatch())
+            return true;
+    return false;
+}
+
+int ConfigEditor::replaceInLines(const QString &path, const QRegularExpression &re,
+                                 const QString &replacement, bool mustMatch)
+{
+    QStringList lines;
+    if (!readLines(path, &lines, true)) {
+        fail("Cannot read " + path);
+        return -1;
+    }
+    int changed = 0;
+    for (QString &line : lines) {
+        QString edited = line;
+        edited.replace(re, replacement);
+        if (edited != line) {
+            line = edited;
+            ++changed;
+        }
+    }
+    if (changed == 0) {
+        if (mustMatch) {
+            fail(QString("%1: nothing matches %2").arg(path, re.pattern()));
+            return -1;
+        }
+        return 0;
+    }
+    return commit(path, lines) ? changed : -1;
+}
+
+int ConfigEditor::removeLines(const QString &path, const QRegularExpression &re)
+{
+    QStringList lines;
+    if (!readLines(path, &lines, true)) {
+        fail("Cannot read " + path);
+        return -1;
+    }
+    int before = lines.size();
+    lines.erase(std::remove_if(lines.begin(), lines.end(),
+                               [&re](const QString &l) { return re.match(l).hasMatch(); }),
+                lines.end());
+    int removed = before - lines.size();
+    if (removed == 0)
+        return 0;
+    return commit(path, lines) ? removed : -1;
+}
+
+bool ConfigEditor::appendLine(const QString &path, const QString &line)
+{
+    QStringList lines;
+    if (!readLines(path, &lines, false))
+        return fail("Cannot read " + path);
+    if (lines.contains(line))
+        return true;
+    lines << line;
+    return commit(path, lines);
+}
+
+// Index range [begin, end) of a section's body; the whole file when section
+// is empty. Returns false when the section does not exist.
+static bool sectionRange(const QStringList &lines, const QString &section, int *begin, int *end)
+{
+    if (section.isEmpty()) {
+        *begin = 0;
+        *end = lines.size();
+        return true;
+    }
+    static const QRegularExpression header("^\\s*\\[([^\\]]*)\\]");
+    *begin = -1;
+    for (int i = 0; i < lines.size(); ++i) {
+        QRegularExpressionMatch m = header.match(lines.at(i));
+        if (!m.hasMatch())
+            continue;
+        if (*begin >= 0) {
+            *end = i;
+            return true;
+        }
+        if (m.captured(1).trimmed() == section)
+            *begin = i + 1;
+    }
+    *end = lines.size();
+    return *begin >= 0;
+}
+
+static QRegularExpression assignment(const QString &key)
+{
+    return QRegularExpression("^\\s*(#\\s*)?" + QRegularExpression::escape(key) + "\\s*=");
+}
+
+bool ConfigEditor::setValues(const QString &path, const QList<QPair<QString, QString>> &values,
+                             const QString &section)
+{
+    QStringList lines;
+    if (!readLines(path, &lines, false))
+        return fail("Cannot read " + path);
+
+    for (const auto &kv : values) {
+        int begin = 0, end = 0;
+        if (!sectionRange(lines, section, &begin, &end)) {
+            if (!lines.isEmpty() && !lines.last().isEmpty())
+                lines << QString();
+            lines << "[" + section + "]";
+            begin = end = lines.size();
+        }
+
+        // Prefer an active assignment, fall back to a commented out one
+        QRegularExpression re = assignment(kv.first);
+        int active = -1, commented = -1;
+        for (int i = begin; i < end; ++i) {
+            QRegularExpressionMatch m = re.match(lines.at(i));
+            if (!m.hasMatch())
+                continue;
+            if (m.captured(1).isEmpty())
+                active = i;
+            else if (commented < 0)
+                commented = i;
+        }
+        QString line = kv.first + "=" + kv.second;
+        int at = active >= 0 ? active : commented;
+        if (at >= 0) {
+            lines[at] = line;
+        } else {
+            // Keep the key ahead of blank lines that separate sections
+            int insertAt = end;
+            while (!section.isEmpty() && insertAt > begin && lines.at(insertAt - 1).trimmed().isEmpty())
+                --insertAt;
+            lines.insert(insertAt, line);
+        }
+    }
+
+    if (!commit(path, lines))
+        return false;
+    for (const auto &kv : values) {
+        if (value(path, kv.first, section) != kv.second)
+            return fail(QString("%1: %2 did not read back as %3").arg(path, kv.first, kv.second));
+    }
+    return true;
+}
+
+bool ConfigEditor::setValue(const QString &path, const QString &key, const QString &val,
+                            const QString &section)
+{
+    return setValues(path, {{key, val}}, section);
+}
+
+QString ConfigEditor::value(const QString &path, const QString &key, const QString &section) const
+{
+    QStringList lines;
+    int begin = 0, end = 0;
+    if (!readLines(path, &lines, true) || !sectionRange(lines, section, &begin, &end))
+        return QString();
+    QRegularExpression re = assignment(key);
+    QString result;
+    for (int i = begin; i < end; ++i) {
+        QRegularExpressionMatch m = re.match(lines.at(i));
+        if (m.hasMatch() && m.captured(1).isEmpty())
+            result = lines.at(i).mid(m.capturedEnd()).trimmed();
+    }
+    return result;
+}
+
+bool ConfigEditor::symlink(const QString &target, const QString &linkPath)
+{
+    if (!exists(target))
+        return fail(QString("Cannot link %1: %2 does not exist in the target").arg(linkPath, target));
+
+    QString link = hostPath(linkPath);
+    QByteArray dest = target.toLocal8Bit();
+    QByteArray tmp = (link + ".tmp" + QString::number(getpid())).toLocal8Bit();
+    ::unlink(tmp.constData());
+    if (::symlink(dest.constData(), tmp.constData()) != 0 ||
+        ::rename(tmp.constData(), link.toLocal8Bit().constData()) != 0) {
+        int err = errno;
+        ::unlink(tmp.constData());
+        return fail(QString("Cannot link %1: %2").arg(linkPath, QString::fromLocal8Bit(std::strerror(err))));
+    }
+
+    char buf[4096];
+    ssize_t n = ::readlink(link.toLocal8Bit().constData(), buf, sizeof(buf));
+    if (n < 0 || QByteArray(buf, static_cast<int>(n)) != dest)
+        return fail(linkPath + " does not point to " + target);
+    return true;
+}
@@ -0,0 +1,65 @@
+#ifndef CONFIGEDITOR_H
+#define CONFIGEDITOR_H
+
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+#include <QRegularExpression>
+#include <QString>
+#include <QStringList>
+
+// Edits configuration files of the target system in place, without starting
+// a chroot and sed/echo for every change. All paths are absolute paths as
+// seen from inside the target and are resolved below root.
+//
+// Every change is written to a temporary file in the same directory and
+// renamed over the original, so a crash never leaves a half-written file.
+// Existing permissions are kept (sudoers stays 0440). After the rename the
+// file is read back and checked against what was meant to be written and
+// against the edit's own postcondition; a failed check is reported through
+// errorString().
+class ConfigEditor {
+public:
+    explicit ConfigEditor(const QString &root);
+
+    QString errorString() const { return error; }
+    QString hostPath(const QString &path) const;
+
+    bool writeFile(const QString &path, const QByteArray &content);
+    bool exists(const QString &path) const;
+    bool contains(const QString &path, const QRegularExpression &re) const;
+
+    // Substitutes re with replacement (\1 back references allowed) on every
+    // line and returns the number of lines changed, or -1 on error. When
+    // mustMatch is set, finding nothing to change is an error.
+    int replaceInLines(const QString &path, const QRegularExpression &re,
+                       const QString &replacement, bool mustMatch = false);
+    int removeLines(const QString &path, const QRegularExpression &re);
+
+    // Appends line unless an identical line is already present.
+    bool appendLine(const QString &path, const QString &line);
+
+    // Sets key=value, replacing an existing (or commented out) assignment.
+    // With a section the file is treated as INI and the key is placed in
+    // [section], which is created if needed.
+    bool setValue(const QString &path, const QString &key, const QString &value,
+                  const QString &section = QString());
+    bool setValues(const QString &path, const QList<QPair<QString, QString>> &values,
+                   const QString &section = QString());
+    QString value(const QString &path, const QString &key,
+                  const QString &section = QString()) const;
+
+    // Atomically points linkPath at target (target is interpreted inside the
+    // root, like a symlink on the installed system would be).
+    bool symlink(const QString &target, const QString &linkPath);
+
+private:
+    bool readLines(const QString &path, QStringList *lines, bool mustExist) const;
+    bool commit(const QString &path, const QStringList &lines);
+    bool fail(const QString &message);
+
+    QString root;
+    QString error;
+};
+
+#endif // CONFIGEDITOR_H
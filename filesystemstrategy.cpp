@@ -0,0 +1,150 @@
+#include "filesystemstrategy.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QtGlobal>
+
+namespace {
+
+class Ext4Strategy : public FilesystemStrategy {
+public:
+    QString name() const override { return "ext4"; }
+
+    QStringList mkfsCommand(const QString &device, qint64 sizeBytes) const override {
+        const qint64 MiB = 1024 * 1024;
+        // Roughly 1/256 of the filesystem, clamped to what mke2fs accepts for
+        // a 4k block size. Tiny partitions such as /boot get the minimum.
+        qint64 journalMiB = qBound<qint64>(16, sizeBytes / 256 / MiB, 1024);
+        QStringList opts{"lazy_itable_init=1", "lazy_journal_init=1", "nodiscard"};
+        return {"mkfs.ext4", "-F", "-q",
+                "-E", opts.join(','),
+                "-J", QString("size=%1").arg(journalMiB),
+                device};
+    }
+
+    QString mountOptions() const override { return "rw,relatime"; }
+    // relatime still writes an access time once a day per file read
+    QString fstabOptions(bool flash) const override { return flash ? "rw,noatime" : mountOptions(); }
+    QString installRemountData() const override { return "commit=60,nobarrier"; }
+    QString productionRemountData() const override { return "commit=5,barrier"; }
+    QStringList packages() const override { return {"e2fsprogs"}; }
+};
+
+// zstd level 1 compresses the rootfs to roughly half its size on typical
+// package payloads while staying faster than a SATA disk can write.
+class BtrfsStrategy : public FilesystemStrategy {
+public:
+    QString name() const override { return "btrfs"; }
+
+    QStringList mkfsCommand(const QString &device, qint64) const override {
+        return {"mkfs.btrfs", "-f", "-q", "--nodiscard", device};
+    }
+
+    QString mountOptions() const override { return "rw,noatime,compress=zstd:1,space_cache=v2"; }
+    QString fstabOptions(bool flash) const override {
+        return flash ? mountOptions() + ",ssd,discard=async" : mountOptions();
+    }
+    int fsckPass() const override { return 0; }
+    QString installRemountData() const override { return "commit=120,nobarrier"; }
+    QString productionRemountData() const override { return "commit=30,barrier"; }
+    // In a subvolume of its own, so snapshots of / leave it out; mkswapfile
+    // also marks it NOCOW, which swap on btrfs requires
+    QString swapfilePath() const override { return "/swap/swapfile"; }
+    QList<QStringList> swapfileCommands(qint64 mib, bool directoryExists) const override {
+        QList<QStringList> commands;
+        if (!directoryExists)
+            commands << QStringList{"btrfs", "subvolume", "create", "/swap"};
+        commands << QStringList{"btrfs", "filesystem", "mkswapfile", "--size", QString("%1m").arg(mib),
+                                swapfilePath()};
+        return commands;
+    }
+    QStringList packages() const override { return {"btrfs-progs"}; }
+    QStringList initcpioModules() const override { return {"btrfs"}; }
+    // fsck.btrfs is a no-op, the hook only costs boot time
+    QStringList initcpioHooksToDrop() const override { return {"fsck"}; }
+};
+
+class F2fsStrategy : public FilesystemStrategy {
+public:
+    QString name() const override { return "f2fs"; }
+
+    QStringList mkfsCommand(const QString &device, qint64) const override {
+        return {"mkfs.f2fs", "-f", "-q", "-t", "0",
+                "-O", "extra_attr,inode_checksum,sb_checksum,compression", device};
+    }
+
+    // f2fs only compresses files flagged for it; compress_extension=* flags
+    // every new file, the way compress= does for all of btrfs
+    QString mountOptions() const override {
+        return "rw,noatime,lazytime,compress_algorithm=zstd,compress_chksum,compress_extension=*,atgc,gc_merge";
+    }
+    // Written out rather than fallocated, so every block is in place
+    // before swapon pins the file. A compressed file cannot be swap, and
+    // the flag can only be cleared while the file is still empty.
+    QList<QStringList> swapfileCommands(qint64 mib, bool) const override {
+        return {{"touch", swapfilePath()},
+                {"chattr", "-c", swapfilePath()},
+                {"dd", "if=/dev/zero", "of=" + swapfilePath(), "bs=1M", QString("count=%1").arg(mib), "conv=notrunc",
+                 "status=none"},
+                {"chmod", "600", swapfilePath()},
+                {"mkswap", swapfilePath()}};
+    }
+    QStringList packages() const override { return {"f2fs-tools"}; }
+    QStringList initcpioModules() const override { return {"f2fs"}; }
+};
+
+class XfsStrategy : public FilesystemStrategy {
+public:
+    QString name() const override { return "xfs"; }
+
+    QStringList mkfsCommand(const QString &device, qint64) const override {
+        return {"mkfs.xfs", "-f", "-q", "-K", device};
+    }
+
+    QString mountOptions() const override { return "rw,noatime,inode64,logbufs=8"; }
+    int fsckPass() const override { return 0; }
+    QStringList packages() const override { return {"xfsprogs"}; }
+    QStringList initcpioHooksToDrop() const override { return {"fsck"}; }
+};
+
+} // namespace
+
+// ext4 and xfs allocate real blocks for fallocate, which swap accepts
+QList<QStringList> FilesystemStrategy::swapfileCommands(qint64 mib, bool) const
+{
+    return {{"fallocate", "-l", QString("%1MiB").arg(mib), swapfilePath()},
+            {"chmod", "600", swapfilePath()},
+            {"mkswap", swapfilePath()}};
+}
+
+std::unique_ptr<FilesystemStrategy> FilesystemStrategy::create(const QString &name)
+{
+    if (name == "btrfs")
+        return std::make_unique<BtrfsStrategy>();
+    if (name == "f2fs")
+        return std::make_unique<F2fsStrategy>();
+    if (name == "xfs")
+        return std::make_unique<XfsStrategy>();
+    if (name == "ext4")
+        return std::make_unique<Ext4Strategy>();
+    return nullptr;
+}
+
+QStringList FilesystemStrategy::available()
+{
+    return {"ext4", "btrfs", "f2fs", "xfs"};
+}
+
+qint64 FilesystemStrategy::bytesWritten(const QString &device)
+{
+    QString name = QFileInfo(QFileInfo(device).canonicalFilePath()).fileName();
+    if (name.isEmpty())
+        name = QFileInfo(device).fileName();
+    QFile f("/sys/class/block/" + name + "/stat");
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text))
+        return -1;
+    // Field 7 is sectors written, always in 512 byte units
+    QList<QByteArray> fields = f.readAll().simplified().split(' ');
+    if (fields.size() < 7)
+        return -1;
+    return fields.at(6).toLongLong() * 512;
+}
@@ -0,0 +1,50 @@
+#ifndef FILESYSTEMSTRATEGY_H
+#define FILESYSTEMSTRATEGY_H
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <memory>
+
+// Everything the installer needs to know about one root filesystem type:
+// how to create it, how to mount it during and after the install, what the
+// installed system needs to keep using it, and how much it has written.
+class FilesystemStrategy {
+public:
+    virtual ~FilesystemStrategy() = default;
+
+    virtual QString name() const = 0;
+    virtual QStringList mkfsCommand(const QString &device, qint64 sizeBytes) const = 0;
+
+    // Options for the initial mount and for the installed system's fstab
+    virtual QString mountOptions() const = 0;
+    virtual int fsckPass() const { return 1; }
+    // fstab options for the installed system. Discard is left to the
+    // periodic fstrim timer unless the filesystem handles it asynchronously.
+    virtual QString fstabOptions(bool /*flash*/) const { return mountOptions(); }
+
+    // Remount data applied while files are extracted and packages installed,
+    // and the data that undoes it. Empty when the filesystem has nothing
+    // worth tuning at remount time.
+    virtual QString installRemountData() const { return QString(); }
+    virtual QString productionRemountData() const { return QString(); }
+
+    // Where the installed system's swap file goes, and the commands run in
+    // the target that allocate every block of it (swapon refuses files with
+    // holes) and format it. directoryExists: the file's directory is there
+    // already, from an earlier attempt.
+    virtual QString swapfilePath() const { return "/swapfile"; }
+    virtual QList<QStringList> swapfileCommands(qint64 mib, bool directoryExists) const;
+
+    virtual QStringList packages() const = 0;
+    virtual QStringList initcpioModules() const { return QStringList(); }
+    virtual QStringList initcpioHooksToDrop() const { return QStringList(); }
+
+    static std::unique_ptr<FilesystemStrategy> create(const QString &name);
+    static QStringList available();
+
+    // Bytes written to a block device since boot, from /sys/class/block/*/stat
+    static qint64 bytesWritten(const QString &device);
+};
+
+#endif // FILESYSTEMSTRATEGY_H
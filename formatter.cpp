@@ -0,0 +1,165 @@
+#include "formatter.h"
+#include "commandrunner.h"
+#include "filesystemstrategy.h"
+#include "tracer.h"
+#include <QElapsedTimer>
+#include <QProcess>
+#include <memory>
+#include <vector>
+
+Formatter::Formatter(const LogFn &l) : log(l) {}
+
+// mkfs time grows with the device on rotational disks (xfs and ext4 still
+// write their metadata groups across the whole range): five minutes plus
+// one per 50 GiB, so an 18 TB HDD gets about six hours
+int Formatter::timeBudgetMs(qint64 sizeBytes)
+{
+    qint64 minutes = 5 + sizeBytes / (50LL << 30);
+    return static_cast<int>(qMin<qint64>(minutes, 24 * 60) * 60 * 1000);
+}
+
+// Issue a discard for the whole range of a device when it is flash backed.
+// Rotational disks and devices without discard support are left alone.
+bool Formatter::discard(const QString &device)
+{
+    BlockDeviceInfo info = BlockDeviceInfo::probe(device);
+    if (!info.isFlash() || !info.supportsDiscard())
+        return false;
+
+    QElapsedTimer timer;
+    timer.start();
+    TraceSpan span("format", "discard " + device);
+    span.setBytes(blockDeviceSize(device));
+    if (CommandRunner::execute({"blkdiscard", "-f", device}) != 0) {
+        log("Discard of " + device + " failed, continuing without it");
+        return false;
+    }
+    log(QString("Discarded %1 (%2) in %3 s")
+            .arg(device, info.nvme ? "NVMe" : "SSD")
+            .arg(timer.elapsed() / 1000.0, 0, 'f', 1));
+    return true;
+}
+
+QStringList Formatter::mkfsCommand(const FormatJob &job, qint64 sizeBytes)
+{
+    if (job.fsType == "vfat")
+        return {"mkfs.fat", "-F32", job.device};
+
+    std::unique_ptr<FilesystemStrategy> fs = FilesystemStrategy::create(job.fsType);
+    if (!fs)
+        return {};
+    return fs->mkfsCommand(job.device, sizeBytes);
+}
+
+QList<FormatResult> Formatter::formatAll(const QList<FormatJob> &jobs, bool discardFirst)
+{
+    if (discardFirst) {
+        // Nothing is discarded for a job that cannot be formatted
+        for (const FormatJob &job : jobs)
+            if (!mkfsCommand(job, 0).isEmpty())
+                discard(job.device);
+    }
+
+    struct Running {
+        FormatJob job;
+        std::unique_ptr<QProcess> proc;
+        QElapsedTimer timer;
+        qint64 traceStartUs = 0;
+        int budgetMs = 0;
+        qint64 stoppedAtMs = -1;  // when the watchdog sent SIGTERM
+        QString stopReason;
+        FormatResult result;
+        bool done = false;
+    };
+    std::vector<Running> running(jobs.size());
+
+    for (int i = 0; i < jobs.size(); ++i) {
+        Running &r = running[i];
+        r.job = jobs.at(i);
+        r.result.device = r.job.device;
+        r.proc.reset(new QProcess);
+        r.proc->setProcessChannelMode(QProcess::MergedChannels);
+        qint64 sizeBytes = blockDeviceSize(r.job.device);
+        r.budgetMs = timeBudgetMs(sizeBytes);
+        QStringList cmd = mkfsCommand(r.job, sizeBytes);
+        if (cmd.isEmpty()) {
+            r.done = true;
+            r.result.error = "unsupported filesystem " + r.job.fsType;
+            continue;
+        }
+        log("Formatting " + r.job.device + " as " + r.job.fsType + "...");
+        r.timer.start();
+        r.traceStartUs = Tracer::instance().nowUs();
+        QStringList argv = CommandRunner::privileged(cmd);
+        r.proc->start(argv.first(), argv.mid(1));
+        if (!r.proc->waitForStarted()) {
+            r.done = true;
+            r.result.error = "Could not start " + cmd.first();
+        }
+    }
+
+    // Poll all of them so each partition's time is taken when it finishes,
+    // not when a slower one in front of it in the list does.
+    int remaining = 0;
+    for (const Running &r : running)
+        if (!r.done)
+            ++remaining;
+    while (remaining > 0) {
+        for (Running &r : running) {
+            if (r.done)
+                continue;
+            if (!r.proc->waitForFinished(50)) {
+                // Over budget or canceled: SIGTERM, then SIGKILL after the
+                // same grace the CommandRunner watchdog gives
+                qint64 elapsed = r.timer.elapsed();
+                if (r.stoppedAtMs < 0 && (CommandRunner::isCanceled() || elapsed > r.budgetMs)) {
+                    r.stopReason = CommandRunner::isCanceled()
+                                       ? QString("canceled")
+                                       : QString("still running after %1 s").arg(r.budgetMs / 1000);
+                    log(QString("Watchdog stopped mkfs on %1: %2").arg(r.job.device, r.stopReason));
+                    for (const QString &line : CommandRunner::processTree(r.proc->processId()))
+                        log("  " + line);
+                    r.proc->terminate();
+                    r.stoppedAtMs = elapsed;
+                } else if (r.stoppedAtMs >= 0 && elapsed - r.stoppedAtMs > CommandRunner::KillGraceMs) {
+                    r.proc->kill();
+                }
+                continue;
+            }
+            r.done = true;
+            --remaining;
+            r.result.elapsedMs = r.timer.elapsed();
+            r.result.ok = r.stopReason.isEmpty() && r.proc->exitStatus() == QProcess::NormalExit
+                          && r.proc->exitCode() == 0;
+            if (!r.stopReason.isEmpty())
+                r.result.error = "mkfs " + r.stopReason;
+            else if (!r.result.ok)
+                r.result.error = QString::fromLocal8Bit(r.proc->readAll()).trimmed();
+
+            // The jobs overlap, so they are recorded here rather than with
+            // nested spans
+            TraceEvent event;
+            event.category = "format";
+            event.name = "mkfs " + r.job.device;
+            event.detail = r.job.fsType;
+            event.startUs = r.traceStartUs;
+            event.durationUs = r.result.elapsedMs * 1000;
+            event.tid = Tracer::currentThreadId();
+            event.exitCode = r.proc->exitCode();
+            event.hasExitCode = true;
+            Tracer::instance().record(event);
+        }
+    }
+
+    QList<FormatResult> results;
+    for (const Running &r : running) {
+        if (r.result.ok)
+            log(QString("Formatted %1 (%2) in %3 s")
+                    .arg(r.job.device, r.job.fsType)
+                    .arg(r.result.elapsedMs / 1000.0, 0, 'f', 1));
+        else
+            log("Formatting " + r.job.device + " failed: " + r.result.error);
+        results << r.result;
+    }
+    return results;
+}
@@ -0,0 +1,45 @@
+#ifndef FORMATTER_H
+#define FORMATTER_H
+
+#include "blockdevice.h"
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <functional>
+
+struct FormatJob {
+    QString device;  // partition node, e.g. /dev/sda2
+    QString fsType;  // "vfat" or a FilesystemStrategy name
+};
+
+struct FormatResult {
+    QString device;
+    bool ok = false;
+    qint64 elapsedMs = 0;
+    QString error;
+};
+
+// Formats independent partitions at the same time. On flash media the range
+// is discarded once up front so mkfs itself never has to; the mkfs options
+// themselves come from the FilesystemStrategy for each type. Each mkfs gets
+// a time budget scaled to the device and is stopped when it runs over or
+// the thread's CommandRunner::CancelScope is canceled.
+class Formatter {
+public:
+    using LogFn = std::function<void(const QString &)>;
+
+    explicit Formatter(const LogFn &log);
+
+    bool discard(const QString &device);
+    QList<FormatResult> formatAll(const QList<FormatJob> &jobs, bool discardFirst = true);
+
+    // Empty for a filesystem type without a strategy
+    static QStringList mkfsCommand(const FormatJob &job, qint64 sizeBytes);
+    // How long mkfs may take on a device of that size before it is stopped
+    static int timeBudgetMs(qint64 sizeBytes);
+
+private:
+    LogFn log;
+};
+
+#endif // FORMATTER_H
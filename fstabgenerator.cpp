@@ -0,0 +1,233 @@
+#include "fstabgenerator.h"
+#include "blockdevice.h"
+#include "filesystemstrategy.h"
+#include "mountmanager.h"
+#include <QFile>
+#include <QStringList>
+#include <QtEndian>
+#include <algorithm>
+
+static QByteArray readAt(QFile &f, qint64 offset, int len)
+{
+    if (!f.seek(offset))
+        return QByteArray();
+    QByteArray data = f.read(len);
+    return data.size() == len ? data : QByteArray();
+}
+
+static quint32 le32(const QByteArray &b, int offset)
+{
+    return qFromLittleEndian<quint32>(reinterpret_cast<const uchar *>(b.constData() + offset));
+}
+
+static quint16 le16(const QByteArray &b, int offset)
+{
+    return qFromLittleEndian<quint16>(reinterpret_cast<const uchar *>(b.constData() + offset));
+}
+
+static QString formatUuid(const QByteArray &raw)
+{
+    QString hex = QString::fromLatin1(raw.toHex());
+    return QString("%1-%2-%3-%4-%5")
+        .arg(hex.mid(0, 8), hex.mid(8, 4), hex.mid(12, 4), hex.mid(16, 4), hex.mid(20, 12));
+}
+
+// Offsets are from the kernel's on-disk structures: ext4_super_block,
+// f2fs_super_block, btrfs_super_block, xfs_sb, the FAT boot sector and
+// swap_header (4 KiB pages).
+bool SuperblockInfo::probe(const QString &device, SuperblockInfo *out)
+{
+    QFile f(device);
+    if (!f.open(QIODevice::ReadOnly))
+        return false;
+
+    QByteArray page = readAt(f, 0, 4096);
+    if (page.isEmpty())
+        return false;
+
+    QByteArray swapMagic = page.mid(4086, 10);
+    if (swapMagic == "SWAPSPACE2") {
+        out->fsType = "swap";
+        out->uuid = formatUuid(page.mid(1036, 16));
+        return true;
+    }
+
+    // ext2/3/4 and f2fs both keep their superblock at 1 KiB
+    if (le16(page, 1024 + 0x38) == 0xEF53) {
+        quint32 compat = le32(page, 1024 + 0x5C);
+        quint32 incompat = le32(page, 1024 + 0x60);
+        // extents, 64bit or flex_bg make it ext4; a journal alone ext3
+        if (incompat & (0x40 | 0x80 | 0x200))
+            out->fsType = "ext4";
+        else
+            out->fsType = (compat & 0x4) ? "ext3" : "ext2";
+        out->uuid = formatUuid(page.mid(1024 + 0x68, 16));
+        return true;
+    }
+    if (le32(page, 1024) == 0xF2F52010) {
+        out->fsType = "f2fs";
+        out->uuid = formatUuid(page.mid(1024 + 0x6C, 16));
+        return true;
+    }
+    if (page.startsWith("XFSB")) {
+        out->fsType = "xfs";
+        out->uuid = formatUuid(page.mid(32, 16));
+        return true;
+    }
+
+    QByteArray btrfs = readAt(f, 0x10000, 0x48);
+    if (!btrfs.isEmpty() && btrfs.mid(0x40, 8) == "_BHRfS_M") {
+        out->fsType = "btrfs";
+        out->uuid = formatUuid(btrfs.mid(0x20, 16));
+        return true;
+    }
+
+    if (quint8(page.at(510)) == 0x55 && quint8(page.at(511)) == 0xAA) {
+        // FAT32 keeps the volume serial further in than FAT12/16
+        int serialOffset = -1;
+        if (page.mid(0x52, 5) == "FAT32")
+            serialOffset = 0x43;
+        else if (page.mid(0x36, 3) == "FAT")
+            serialOffset = 0x27;
+        if (serialOffset > 0) {
+            quint32 serial = le32(page, serialOffset);
+            out->fsType = "vfat";
+            out->uuid = QString("%1-%2")
+                            .arg(serial >> 16, 4, 16, QChar('0'))
+                            .arg(serial & 0xFFFF, 4, 16, QChar('0'))
+                            .toUpper();
+            return true;
+        }
+    }
+    return false;
+}
+
+FstabGenerator::FstabGenerator(const QString &r) : root(r) {}
+
+QString FstabGenerator::optionsFor(const QString &fsType, bool flash)
+{
+    if (fsType == "swap")
+        return "defaults";
+    // Only root may read the ESP; errors leave it read-only rather than
+    // failing the boot
+    if (fsType == "vfat")
+        return "rw,noatime,fmask=0077,dmask=0077,codepage=437,iocharset=ascii,"
+               "shortname=mixed,utf8,errors=remount-ro";
+    std::unique_ptr<FilesystemStrategy> fs = FilesystemStrategy::create(fsType);
+    return fs ? fs->fstabOptions(flash) : QString("rw,relatime");
+}
+
+int FstabGenerator::passFor(const QString &fsType, const QString &mountPoint)
+{
+    if (fsType == "swap")
+        return 0;
+    std::unique_ptr<FilesystemStrategy> fs = FilesystemStrategy::create(fsType);
+    int pass = fs ? fs->fsckPass() : 1;
+    if (pass == 0)
+        return 0;
+    return mountPoint == "/" ? 1 : 2;
+}
+
+bool FstabGenerator::addDevice(const QString &device, const QString &mountPoint)
+{
+    SuperblockInfo sb;
+    if (!SuperblockInfo::probe(device, &sb)) {
+        error = "No known filesystem on " + device;
+        return false;
+    }
+
+    FstabEntry e;
+    e.device = device;
+    e.uuid = sb.uuid;
+    e.fsType = sb.fsType;
+    e.mountPoint = sb.fsType == "swap" ? QString("none") : mountPoint;
+    e.options = optionsFor(sb.fsType, BlockDeviceInfo::probe(device).isFlash());
+    e.pass = passFor(sb.fsType, e.mountPoint);
+
+    for (FstabEntry &existing : list) {
+        if (existing.mountPoint == e.mountPoint && e.mountPoint != "none") {
+            existing = e;
+            return true;
+        }
+    }
+    list << e;
+    return true;
+}
+
+void FstabGenerator::addSwapFile(const QString &path)
+{
+    if (std::any_of(list.cbegin(), list.cend(), [&path](const FstabEntry &e) { return e.device == path; }))
+        return;
+    FstabEntry e;
+    e.device = path;
+    e.mountPoint = "none";
+    e.fsType = "swap";
+    e.options = optionsFor("swap", false);
+    list << e;
+}
+
+bool FstabGenerator::addMountedFilesystems()
+{
+    QStringList disks;
+    for (const MountEntry &m : MountManager::mountsFor(root)) {
+        if (!m.source.startsWith("/dev/") || m.source.startsWith("/dev/loop"))
+            continue;
+        QString inside = m.mountPoint.mid(root.size());
+        if (inside.isEmpty())
+            inside = "/";
+        if (!addDevice(m.source, inside))
+            return false;
+        disks << BlockDeviceInfo::probe(m.source).name;
+    }
+    if (std::none_of(list.cbegin(), list.cend(),
+                     [](const FstabEntry &e) { return e.mountPoint == "/"; })) {
+        error = "Nothing is mounted at " + root;
+        return false;
+    }
+
+    // Swap partitions on the target disk and swap files inside the target
+    QFile swaps("/proc/swaps");
+    if (swaps.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        const QStringList lines = QString::fromLocal8Bit(swaps.readAll()).split('\n', Qt::SkipEmptyParts);
+        for (const QString &line : lines.mid(1)) {
+            QString path = line.section(' ', 0, 0, QString::SectionSkipEmpty);
+            if (path.startsWith(root + '/')) {
+                addSwapFile(path.mid(root.size()));
+            } else if (path.startsWith("/dev/") && disks.contains(BlockDeviceInfo::probe(path).name)) {
+                addDevice(path, "none");
+            }
+        }
+    }
+    return true;
+}
+
+QList<FstabEntry> FstabGenerator::entries() const
+{
+    QList<FstabEntry> sorted = list;
+    // Root first, then by mount point so parents precede children, swap last
+    std::sort(sorted.begin(), sorted.end(), [](const FstabEntry &a, const FstabEntry &b) {
+        bool aSwap = a.mountPoint == "none", bSwap = b.mountPoint == "none";
+        if (aSwap != bSwap)
+            return bSwap;
+        if (aSwap)
+            return a.device < b.device;
+        return a.mountPoint < b.mountPoint;
+    });
+    return sorted;
+}
+
+QByteArray FstabGenerator::render() const
+{
+    QStringList out{"# /etc/fstab: static file system information.",
+                    "#",
+                    "# <file system>\t<dir>\t<type>\t<options>\t<dump>\t<pass>"};
+    for (const FstabEntry &e : entries()) {
+        out << QString() << "# " + e.device;
+        out << QString("%1\t%2\t%3\t%4\t%5 %6")
+                   .arg(e.uuid.isEmpty() ? e.device : "UUID=" + e.uuid, e.mountPoint, e.fsType, e.options)
+                   .arg(e.dump)
+                   .arg(e.pass);
+    }
+    out << QString();
+    return out.join('\n').toUtf8();
+}
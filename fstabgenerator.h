@@ -0,0 +1,57 @@
+#ifndef FSTABGENERATOR_H
+#define FSTABGENERATOR_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+// What the on-disk superblock says about a device or image file.
+struct SuperblockInfo {
+    QString fsType;  // ext2/ext3/ext4, btrfs, xfs, f2fs, vfat or swap
+    QString uuid;    // as used after UUID= (vfat: the XXXX-XXXX serial)
+
+    // Reads the superblock directly; no blkid or udev involved, so regular
+    // image files work as well as block devices.
+    static bool probe(const QString &device, SuperblockInfo *out);
+};
+
+struct FstabEntry {
+    QString device;      // only used for the comment above the entry
+    QString uuid;
+    QString mountPoint;  // as seen by the installed system, or "none" for swap
+    QString fsType;
+    QString options;
+    int dump = 0;
+    int pass = 0;
+};
+
+// Builds /etc/fstab from what the installer mounted under the target root
+// instead of running genfstab. UUIDs and types come from the superblocks,
+// options from the FilesystemStrategy of each type. The output only depends
+// on the entries, so it is stable across runs.
+class FstabGenerator {
+public:
+    explicit FstabGenerator(const QString &root);
+
+    QString errorString() const { return error; }
+
+    // Every block device mounted at or below root, plus swap on the same
+    // devices. Returns false when the root itself cannot be identified.
+    bool addMountedFilesystems();
+    bool addDevice(const QString &device, const QString &mountPoint);
+    // A swap file at path as seen by the installed system, whether or not
+    // it is active
+    void addSwapFile(const QString &path);
+    QList<FstabEntry> entries() const;
+    QByteArray render() const;
+
+    static QString optionsFor(const QString &fsType, bool flash);
+    static int passFor(const QString &fsType, const QString &mountPoint);
+
+private:
+    QString root;
+    QString error;
+    QList<FstabEntry> list;
+};
+
+#endif // FSTABGENERATOR_H
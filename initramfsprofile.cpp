@@ -0,0 +1,53 @@
+#include "initramfsprofile.h"
+
+bool InitramfsProfile::named(const QString &name, InitramfsProfile *out)
+{
+    InitramfsProfile profile;
+    profile.name = name;
+    if (name == "fast") {
+        profile.systemdHooks = true;
+        profile.compression = "lz4";
+        profile.fallback = false;
+        profile.storageModules = true;
+    } else if (name != "compatible") {
+        return false;
+    }
+    *out = profile;
+    return true;
+}
+
+QStringList InitramfsProfile::available()
+{
+    return {"compatible", "fast"};
+}
+
+QStringList InitramfsProfile::systemdHookSet(const QStringList &drop) const
+{
+    // No kms: early graphics drivers are most of an image's size, and the
+    // display manager loads them soon enough. keyboard stays for the
+    // emergency shell.
+    QStringList hooks{"base", "systemd", "autodetect", "microcode", "modconf",
+                      "keyboard", "block", "filesystems", "fsck"};
+    for (const QString &hook : drop)
+        hooks.removeAll(hook);
+    return hooks;
+}
+
+QStringList InitramfsProfile::compressionOptions() const
+{
+    // zstd decompresses at much the same speed at every level, so the
+    // lowest one only makes the build faster; mkinitcpio adds lz4's -l
+    if (compression == "zstd")
+        return {"-1", "-T0"};
+    return {};
+}
+
+QString InitramfsProfile::describe() const
+{
+    QStringList parts{systemdHooks ? "systemd hooks" : "udev hooks",
+                      compression.isEmpty() ? "default compression" : compression,
+                      fallback ? "fallback" : "no fallback"};
+    if (storageModules)
+        parts << "storage modules";
+    return QString("%1 (%2)").arg(name, parts.join(", "));
+}
@@ -0,0 +1,32 @@
+#ifndef INITRAMFSPROFILE_H
+#define INITRAMFSPROFILE_H
+
+#include <QString>
+#include <QStringList>
+
+// How mkinitcpio builds the installed system's initramfs. "compatible" is
+// the live ISO's hook set without archiso, mkinitcpio's default compression
+// and a fallback image with every module. "fast" boots a systemd based
+// initramfs holding only the autodetected modules plus the driver of the
+// root disk's controller, compressed with lz4, which decompresses fastest,
+// and builds no fallback image.
+struct InitramfsProfile {
+    QString name = "compatible";
+    bool systemdHooks = false;    // systemd hook set instead of the ISO's udev one
+    QString compression;          // "zstd" or "lz4"; mkinitcpio's default when empty
+    bool fallback = true;         // also build the image with every module
+    bool storageModules = false;  // controller driver of the root disk in MODULES
+
+    static bool named(const QString &name, InitramfsProfile *out);
+    static QStringList available();
+    static QStringList compressions() { return {"zstd", "lz4"}; }
+
+    // HOOKS for the systemd set, less the hooks the filesystem does not need
+    QStringList systemdHookSet(const QStringList &drop) const;
+    // COMPRESSION_OPTIONS for the chosen compression
+    QStringList compressionOptions() const;
+    // e.g. "fast (systemd hooks, lz4, no fallback)"
+    QString describe() const;
+};
+
+#endif // INITRAMFSPROFILE_H
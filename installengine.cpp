@@ -0,0 +1,624 @@
+#include "installengine.h"
+#include "bootloaderstrategy.h"
+#include "commandrunner.h"
+#include "filesystemstrategy.h"
+#include "formatter.h"
+#include "memoryconfig.h"
+#include "mountmanager.h"
+#include "partitionhelpers.h"
+#include "perfbaseline.h"
+#include "sharedinstallsource.h"
+#include "systemworker.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+#include <QSet>
+#include <QVariant>
+#include <unistd.h>
+
+namespace {
+
+// The part of TOML an install config uses: [table] headers, bare keys,
+// basic and literal strings, booleans, integers, one-line arrays of
+// strings, and # comments. Keys come back as "table.key".
+class TomlReader {
+public:
+    bool parse(const QString &text, QMap<QString, QVariant> *values, QString *error) {
+        const QStringList lines = text.split('\n');
+        QString table;
+        for (int n = 0; n < lines.size(); ++n) {
+            line = lines.at(n);
+            pos = 0;
+            skipSpace();
+            if (atEnd() || peek() == '#')
+                continue;
+
+            if (peek() == '[') {
+                ++pos;
+                table = readKey();
+                skipSpace();
+                if (table.isEmpty() || atEnd() || peek() != ']')
+                    return fail(n, "malformed table header", error);
+                ++pos;
+            } else {
+                QString key = readKey();
+                skipSpace();
+                if (key.isEmpty() || atEnd() || peek() != '=')
+                    return fail(n, "expected key = value", error);
+                ++pos;
+                skipSpace();
+                QVariant value;
+                if (!readValue(&value))
+                    return fail(n, "unsupported or malformed value", error);
+                QString full = table.isEmpty() ? key : table + '.' + key;
+                if (values->contains(full))
+                    return fail(n, "duplicate key " + full, error);
+                values->insert(full, value);
+            }
+
+            skipSpace();
+            if (!atEnd() && peek() != '#')
+                return fail(n, "unexpected text after value", error);
+        }
+        return true;
+    }
+
+private:
+    bool atEnd() const { return pos >= line.size(); }
+    QChar peek() const { return line.at(pos); }
+    void skipSpace() {
+        while (!atEnd() && (peek() == ' ' || peek() == '\t' || peek() == '\r'))
+            ++pos;
+    }
+
+    QString readKey() {
+        int start = pos;
+        while (!atEnd() && (peek().isLetterOrNumber() || peek() == '_' || peek() == '-'))
+            ++pos;
+        return line.mid(start, pos - start);
+    }
+
+    bool readValue(QVariant *value) {
+        if (atEnd())
+            return false;
+        if (peek() == '[')
+            return readStringArray(value);
+        QChar quote = peek();
+        if (quote == '"' || quote == '\'') {
+            ++pos;
+            QString s;
+            while (!atEnd() && peek() != quote) {
+                QChar c = line.at(pos++);
+                // Literal strings ('...') have no escapes
+                if (c == '\\' && quote == '"') {
+                    if (atEnd())
+                        return false;
+                    QChar e = line.at(pos++);
+                    if (e == 'n') s += '\n';
+                    else if (e == 't') s += '\t';
+                    else if (e == '"' || e == '\\') s += e;
+                    else return false;
+                } else {
+                    s += c;
+                }
+            }
+            if (atEnd())
+                return false;
+            ++pos;
+            *value = s;
+            return true;
+        }
+        QString word = readKey();
+        if (word == "true" || word == "false") {
+            *value = word == "true";
+            return true;
+        }
+        bool ok = false;
+        qlonglong number = word.toLongLong(&ok);
+        if (ok)
+            *value = number;
+        return ok;
+    }
+
+    bool readStringArray(QVariant *value) {
+        ++pos;
+        QStringList items;
+        for (;;) {
+            skipSpace();
+            if (atEnd())
+                return false;
+            if (peek() == ']')
+                break;
+            QVariant item;
+            if (!readValue(&item) || item.userType() != QMetaType::QString)
+                return false;
+            items << item.toString();
+            skipSpace();
+            if (!atEnd() && peek() == ',')
+                ++pos;
+            else if (atEnd() || peek() != ']')
+                return false;
+        }
+        ++pos;
+        *value = items;
+        return true;
+    }
+
+    bool fail(int lineIndex, const QString &what, QString *error) {
+        *error = QString("line %1: %2").arg(lineIndex + 1).arg(what);
+        return false;
+    }
+
+    QString line;
+    int pos = 0;
+};
+
+} // namespace
+
+bool InstallConfig::load(const QString &path, QString *error)
+{
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        *error = path + ": " + f.errorString();
+        return false;
+    }
+    QMap<QString, QVariant> values;
+    TomlReader reader;
+    if (!reader.parse(QString::fromUtf8(f.readAll()), &values, error)) {
+        *error = path + ": " + *error;
+        return false;
+    }
+
+    // Set after the profile they adjust, whatever the order in the file
+    QMap<QString, QVariant> initramfsOverrides;
+
+    QMap<QString, QString *> strings{
+        {"disk.drive", &drive},
+        {"disk.partition", &partition},
+        {"disk.esp", &esp},
+        {"disk.filesystem", &rootFilesystem},
+        {"system.iso", &iso},
+        {"system.desktop", &desktop},
+        {"system.bootloader", &bootloader},
+        {"memory.mode", &memory},
+        {"performance.governor", &governor},
+        {"user.name", &username},
+        {"user.password", &password},
+        {"user.root_password", &rootPassword},
+        {"user.batch_file", &userBatchFile},
+    };
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it) {
+        const QString &key = it.key();
+        const QVariant &value = it.value();
+        bool isString = value.userType() == QMetaType::QString;
+        bool isBool = value.userType() == QMetaType::Bool;
+        if (strings.contains(key) && isString) {
+            *strings.value(key) = value.toString();
+        } else if (key == "disk.mode" && isString) {
+            QString m = value.toString();
+            if (m == "wipe")
+                mode = InstallerWorker::InstallMode::WipeDrive;
+            else if (m == "partition")
+                mode = InstallerWorker::InstallMode::UsePartition;
+            else if (m == "free-space")
+                mode = InstallerWorker::InstallMode::UseFreeSpace;
+            else {
+                *error = path + ": disk.mode must be \"wipe\", \"partition\" or \"free-space\"";
+                return false;
+            }
+        } else if (key == "disk.boot" && isString) {
+            QString b = value.toString();
+            if (b != "uefi" && b != "bios") {
+                *error = path + ": disk.boot must be \"uefi\" or \"bios\"";
+                return false;
+            }
+            efi = b == "uefi";
+        } else if (key == "disk.confirm_wipe" && isBool) {
+            confirmWipe = value.toBool();
+        } else if (key == "disk.drives" && value.userType() == QMetaType::QStringList) {
+            drives = value.toStringList();
+        } else if (key == "system.os_prober" && value.userType() == QMetaType::QStringList) {
+            osProberDevices = value.toStringList();
+        } else if (key == "initramfs.profile" && isString) {
+            if (!InitramfsProfile::named(value.toString(), &initramfs)) {
+                *error = path + ": initramfs.profile must be one of: " + InitramfsProfile::available().join(", ");
+                return false;
+            }
+        } else if (key == "initramfs.hooks" && isString) {
+            if (value.toString() != "udev" && value.toString() != "systemd") {
+                *error = path + ": initramfs.hooks must be \"udev\" or \"systemd\"";
+                return false;
+            }
+            initramfsOverrides.insert(key, value);
+        } else if (key == "initramfs.compression" && isString) {
+            if (value.toString() != "default" && !InitramfsProfile::compressions().contains(value.toString())) {
+                *error = path + ": initramfs.compression must be \"default\", \"zstd\" or \"lz4\"";
+                return false;
+            }
+            initramfsOverrides.insert(key, value);
+        } else if (key == "memory.swapfile_mib" && value.userType() == QMetaType::LongLong) {
+            swapfileMiB = value.toLongLong();
+        } else if (key == "initramfs.fallback" && isBool) {
+            initramfsOverrides.insert(key, value);
+        } else {
+            // Typos must not silently fall back to a default
+            *error = path + ": unknown key or wrong type: " + key;
+            return false;
+        }
+    }
+    if (drive.startsWith("/dev/"))
+        drive = drive.mid(5);
+    for (QString &d : drives)
+        if (d.startsWith("/dev/"))
+            d = d.mid(5);
+    for (QString &d : osProberDevices)
+        if (d.startsWith("/dev/"))
+            d = d.mid(5);
+    if (initramfsOverrides.contains("initramfs.hooks"))
+        initramfs.systemdHooks = initramfsOverrides.value("initramfs.hooks").toString() == "systemd";
+    if (initramfsOverrides.contains("initramfs.compression")) {
+        QString compression = initramfsOverrides.value("initramfs.compression").toString();
+        initramfs.compression = compression == "default" ? QString() : compression;
+    }
+    if (initramfsOverrides.contains("initramfs.fallback"))
+        initramfs.fallback = initramfsOverrides.value("initramfs.fallback").toBool();
+    return true;
+}
+
+QList<InstallConfig> InstallConfig::targets() const
+{
+    if (drives.isEmpty())
+        return {*this};
+    QList<InstallConfig> list;
+    for (const QString &d : drives) {
+        InstallConfig target = *this;
+        target.drive = d;
+        target.drives.clear();
+        list << target;
+    }
+    return list;
+}
+
+QString InstallConfig::validate() const
+{
+    if (!drives.isEmpty()) {
+        if (!drive.isEmpty() || !partition.isEmpty() || !esp.isEmpty())
+            return "disk.drives cannot be combined with disk.drive, disk.partition or disk.esp";
+        if (mode == InstallerWorker::InstallMode::UsePartition)
+            return "disk.drives needs disk.mode \"wipe\" or \"free-space\"";
+        if (drives.size() != QSet<QString>(drives.begin(), drives.end()).size())
+            return "disk.drives lists a drive twice";
+        for (const InstallConfig &target : targets()) {
+            QString error = target.validate();
+            if (!error.isEmpty())
+                return QString("/dev/%1: %2").arg(target.drive, error);
+        }
+        return QString();
+    }
+    if (drive.isEmpty() && partition.isEmpty())
+        return "disk.drive is required";
+    if (mode == InstallerWorker::InstallMode::UsePartition && partition.isEmpty())
+        return "disk.partition is required when disk.mode is \"partition\"";
+    if (mode == InstallerWorker::InstallMode::WipeDrive && !confirmWipe)
+        return QString("disk.mode \"wipe\" erases /dev/%1; set disk.confirm_wipe = true").arg(drive);
+    if (mode == InstallerWorker::InstallMode::UseFreeSpace && efi && esp.isEmpty())
+        return "disk.esp is required for a UEFI install into free space";
+    if (!FilesystemStrategy::create(rootFilesystem))
+        return "unsupported disk.filesystem: " + rootFilesystem;
+    std::unique_ptr<BootloaderStrategy> boot = BootloaderStrategy::create(bootloader);
+    if (!boot)
+        return "system.bootloader must be one of: " + BootloaderStrategy::available().join(", ");
+    if (!efi && !boot->supportsBios())
+        return QString("system.bootloader \"%1\" needs disk.boot = \"uefi\"").arg(bootloader);
+    if (!MemoryConfig::modes().contains(memory))
+        return "memory.mode must be one of: " + MemoryConfig::modes().join(", ");
+    if (swapfileMiB < 0)
+        return "memory.swapfile_mib cannot be negative";
+    if (!PerfBaseline::governors().contains(governor))
+        return "performance.governor must be one of: " + PerfBaseline::governors().join(", ");
+    if (!osProberDevices.isEmpty() && bootloader != "grub")
+        return "system.os_prober only applies to system.bootloader \"grub\"";
+    if (username.isEmpty() || password.isEmpty() || rootPassword.isEmpty())
+        return "user.name, user.password and user.root_password are required";
+    return QString();
+}
+
+InstallEngine::InstallEngine(const InstallConfig &c, QObject *parent) : QObject(parent), config(c)
+{
+    if (config.iso.isEmpty())
+        config.iso = QDir::tempPath() + "/archlinux.iso";
+}
+
+void InstallEngine::setTarget(const QString &root, const std::shared_ptr<SharedInstallSource> &s)
+{
+    targetRoot = root;
+    source = s;
+}
+
+QString InstallEngine::exitCodeName(ExitCode code)
+{
+    switch (code) {
+    case Success: return "success";
+    case UsageError: return "usage";
+    case ConfigError: return "config";
+    case PreflightError: return "preflight";
+    case DiskError: return "disk";
+    case SystemError: return "system";
+    case Canceled: return "canceled";
+    case Warnings: return "warnings";
+    }
+    return "unknown";
+}
+
+InstallEngine::ExitCode InstallEngine::outcome(ExitCode code) const
+{
+    return code == Success && !warningList.isEmpty() ? Warnings : code;
+}
+
+InstallEngine::ExitCode InstallEngine::worse(ExitCode a, ExitCode b)
+{
+    auto rank = [](ExitCode c) { return c == Warnings ? 1 : c == Success ? 0 : 2 + int(c); };
+    return rank(a) >= rank(b) ? a : b;
+}
+
+// The workers go on after many errors (a failed config edit, a soft
+// command); each one is passed on so neither the wizard nor the headless
+// event stream loses it
+void InstallEngine::addWarning(const QString &message)
+{
+    warningList << message;
+    emit warning(message);
+}
+
+InstallEngine::ExitCode InstallEngine::run()
+{
+    for (Stage stage : {Stage::Preflight, Stage::Disk, Stage::System}) {
+        ExitCode code = runStage(stage);
+        if (code != Success)
+            return code;
+    }
+    return outcome(Success);
+}
+
+InstallEngine::ExitCode InstallEngine::resume()
+{
+    ExitCode code = runStage(Stage::Preflight);
+    if (code != Success)
+        return code;
+    bool mounted = false;
+    for (const MountEntry &e : MountManager::mountsFor(targetRoot))
+        mounted = mounted || e.mountPoint == targetRoot;
+    if (!mounted)
+        return fail(PreflightError, QString("Nothing mounted on %1 to resume; run the full install").arg(targetRoot));
+    return outcome(runStage(Stage::System));
+}
+
+InstallEngine::ExitCode InstallEngine::runStage(Stage stage)
+{
+    // The disk a partition lives on is needed by every stage
+    if (config.drive.isEmpty() && !config.partition.isEmpty())
+        config.drive = parentDrive(config.partition);
+    // Every command the stage starts on this thread watches the token
+    CommandRunner::CancelScope cancelScope(cancelToken);
+    if (cancelToken.isCanceled())
+        return finishCanceled();
+
+    ExitCode code = Success;
+    switch (stage) {
+    case Stage::Preflight:
+        emit stageChanged("preflight");
+        code = preflight();
+        break;
+    case Stage::Disk:
+        emit stageChanged("disk");
+        code = prepareDisk();
+        break;
+    case Stage::System:
+        emit stageChanged("system");
+        code = installSystem();
+        break;
+    }
+    if (code != Success && cancelToken.isCanceled())
+        return finishCanceled();
+    return code;
+}
+
+InstallEngine::ExitCode InstallEngine::fail(ExitCode code, const QString &message)
+{
+    // Whatever broke after a cancel broke because of it
+    if (cancelToken.isCanceled())
+        return Canceled;
+    error = message;
+    emit failed(code, message);
+    return code;
+}
+
+// The workers release their chroot mounts on the way out; the target's own
+// filesystems and swap are left, so nothing keeps the disk busy afterwards
+InstallEngine::ExitCode InstallEngine::finishCanceled()
+{
+    MountManager::unmountAll(targetRoot, QString(), [this](const QString &msg) { emit logMessage(msg); });
+    MountManager::swapOffDevice("/dev/" + config.drive, targetRoot,
+                                [this](const QString &msg) { emit logMessage(msg); });
+    error = "Installation canceled";
+    emit failed(Canceled, error);
+    return Canceled;
+}
+
+InstallEngine::ExitCode InstallEngine::checkTargetDisk()
+{
+    if (geteuid() != 0)
+        return fail(PreflightError, "The installer must run as root");
+    if (config.drive.isEmpty() || !QFileInfo::exists("/sys/block/" + config.drive))
+        return fail(PreflightError, "No such disk: " + config.drive);
+    // Never touch the disk the running system lives on
+    for (const MountEntry &e : MountManager::mountsFor(QString(), "/dev/" + config.drive))
+        if (e.mountPoint == "/")
+            return fail(PreflightError, QString("/dev/%1 holds the running system").arg(config.drive));
+    return Success;
+}
+
+InstallEngine::ExitCode InstallEngine::preflight()
+{
+    ExitCode code = checkTargetDisk();
+    if (code != Success)
+        return code;
+    if (config.mode == InstallerWorker::InstallMode::UsePartition && !QFileInfo::exists(config.partition))
+        return fail(PreflightError, "No such partition: " + config.partition);
+    if (!config.esp.isEmpty() && !QFileInfo::exists(config.esp))
+        return fail(PreflightError, "No such ESP: " + config.esp);
+    if (!QFileInfo::exists(config.iso))
+        return fail(PreflightError, "Arch Linux ISO not found at " + config.iso);
+    if (config.mode != InstallerWorker::InstallMode::UsePartition && locatePartedBinary().isEmpty())
+        return fail(PreflightError, "parted not found");
+    return Success;
+}
+
+InstallEngine::ExitCode InstallEngine::prepareDisk()
+{
+    // The wizard runs this stage without preflight
+    ExitCode code = checkTargetDisk();
+    if (code != Success)
+        return code;
+    auto log = [this](const QString &msg) { emit logMessage(msg); };
+    QString esp = config.esp;
+
+    switch (config.mode) {
+    case InstallerWorker::InstallMode::WipeDrive:
+        if (!config.efi) {
+            if (!runInstallerWorker(InstallerWorker::InstallMode::WipeDrive, QString()))
+                return DiskError;
+            break;
+        }
+        {
+            QString root = partitionPath(config.drive, 2);
+            esp = partitionPath(config.drive, 1);
+            // Left over from an earlier run; anything else mounted from the
+            // disk makes createEfiLayout refuse
+            MountManager::unmountAll(targetRoot, QString(), log);
+            if (!createEfiLayout(config.drive, log, &error))
+                return fail(DiskError, error);
+            if (!waitForPartition(esp) || !waitForPartition(root))
+                return fail(DiskError, "Partition device did not appear in time after partitioning.");
+            Formatter formatter(log);
+            if (!formatter.formatAll({{esp, "vfat"}}).first().ok)
+                return fail(DiskError, "Failed to format " + esp + " as FAT32.");
+            if (!runInstallerWorker(InstallerWorker::InstallMode::UsePartition, root))
+                return DiskError;
+        }
+        break;
+
+    case InstallerWorker::InstallMode::UsePartition: {
+        QString root = config.partition;
+        // GRUB on a BIOS machine needs a bios_grub partition on GPT disks
+        if (!config.efi && getPartitionTableType(config.drive) == "gpt"
+            && !hasBiosBootPartition(config.drive, QFileInfo(root).fileName())) {
+            log("GPT disk without a BIOS boot partition; splitting " + root);
+            root = replaceWithBiosBootAndRoot(config.drive, root, &error);
+            if (root.isEmpty())
+                return fail(DiskError, error);
+        }
+        if (config.efi && esp.isEmpty()) {
+            esp = carveEspFromPartition(config.drive, partitionNumber(root), log, &error);
+            if (esp.isEmpty())
+                return fail(DiskError, error);
+        }
+        if (!runInstallerWorker(InstallerWorker::InstallMode::UsePartition, root))
+            return DiskError;
+        break;
+    }
+
+    case InstallerWorker::InstallMode::UseFreeSpace:
+        if (getPartitionTableType(config.drive) == "dos" && mbrPrimaryPartitionLimitReached(config.drive))
+            return fail(DiskError, "MBR (msdos) disks allow only 4 primary partitions. "
+                                   "Cannot create a new partition.");
+        if (!runInstallerWorker(InstallerWorker::InstallMode::UseFreeSpace, QString()))
+            return DiskError;
+        break;
+    }
+
+    if (config.efi && !mountEsp(esp))
+        return fail(DiskError, QString("Could not mount %1 on %2/boot").arg(esp, targetRoot));
+    return Success;
+}
+
+bool InstallEngine::runInstallerWorker(InstallerWorker::InstallMode mode, const QString &partition)
+{
+    InstallerWorker worker;
+    worker.setDrive(config.drive);
+    worker.setMode(mode);
+    worker.setTargetPartition(partition);
+    worker.setRootFilesystem(config.rootFilesystem);
+    // A shared source mounts the ISO once; nothing to copy onto the target
+    worker.setIsoPath(source ? QString() : config.iso);
+    worker.setTargetRoot(targetRoot);
+
+    // The engine may live on another thread than the one running it (the
+    // wizard's jobs, the headless targets); the worker's signals must
+    // arrive before run() returns
+    bool complete = false;
+    QString workerError;
+    connect(&worker, &InstallerWorker::logMessage, this, &InstallEngine::logMessage,
+            Qt::DirectConnection);
+    connect(&worker, &InstallerWorker::errorOccurred, this,
+            [this, &workerError](const QString &msg) {
+                workerError = msg;
+                addWarning(msg);
+            },
+            Qt::DirectConnection);
+    connect(&worker, &InstallerWorker::installComplete, this, [&complete]() { complete = true; },
+            Qt::DirectConnection);
+    worker.run();
+
+    if (!complete)
+        fail(DiskError, workerError.isEmpty() ? QString("Disk preparation failed") : workerError);
+    return complete;
+}
+
+bool InstallEngine::mountEsp(const QString &esp)
+{
+    QDir().mkpath(targetRoot + "/boot");
+    return CommandRunner::execute({"mount", esp, targetRoot + "/boot"}) == 0;
+}
+
+InstallEngine::ExitCode InstallEngine::installSystem()
+{
+    if (config.username.isEmpty() || config.password.isEmpty() || config.rootPassword.isEmpty())
+        return fail(ConfigError, "User name, user password and root password are required");
+
+    SystemWorker worker;
+    worker.setParameters(config.drive, config.username, config.password, config.rootPassword,
+                         config.desktop, config.efi, config.rootFilesystem);
+    if (!config.userBatchFile.isEmpty())
+        worker.setUserBatchFile(config.userBatchFile);
+    worker.setBootloader(config.bootloader, config.osProberDevices);
+    worker.setInitramfsProfile(config.initramfs);
+    worker.setMemory(config.memory, config.swapfileMiB);
+    worker.setGovernor(config.governor);
+    worker.setTargetRoot(targetRoot);
+    if (source) {
+        worker.setSharedSource(source);
+        worker.setMetricsTarget(config.drive);
+    }
+
+    bool finished = false;
+    QString workerError;
+    connect(&worker, &SystemWorker::logMessage, this, &InstallEngine::logMessage,
+            Qt::DirectConnection);
+    connect(&worker, &SystemWorker::progressChanged, this, &InstallEngine::progressChanged,
+            Qt::DirectConnection);
+    connect(&worker, &SystemWorker::errorOccurred, this,
+            [this, &workerError](const QString &msg) {
+                workerError = msg;
+                addWarning(msg);
+            },
+            Qt::DirectConnection);
+    connect(&worker, &SystemWorker::finished, this, [&finished]() { finished = true; },
+            Qt::DirectConnection);
+    worker.run();
+
+    if (!finished)
+        return fail(SystemError, workerError.isEmpty() ? QString("System installation failed") : workerError);
+    return Success;
+}
@@ -0,0 +1,145 @@
+#ifndef INSTALLENGINE_H
+#define INSTALLENGINE_H
+
+#include "canceltoken.h"
+#include "initramfsprofile.h"
+#include "installerworker.h"
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <memory>
+
+class SharedInstallSource;
+
+// Everything one install needs. The wizard fills it from its pages; the
+// headless mode reads it from a TOML file (see load()), e.g.
+//
+//   [disk]
+//   drive = "sda"            # or drives = ["sdb", "sdc"] to image several
+//   mode = "wipe"            # wipe, partition or free-space
+//   boot = "uefi"            # uefi or bios
+//   filesystem = "btrfs"
+//   confirm_wipe = true
+//
+//   [system]
+//   desktop = "XFCE"
+//
+//   [user]
+//   name = "alice"
+//   password = "..."
+//   root_password = "..."
+struct InstallConfig {
+    QString drive;        // disk name, e.g. "sda"; derived from partition if empty
+    InstallerWorker::InstallMode mode = InstallerWorker::InstallMode::WipeDrive;
+    QString partition;    // root partition for mode "partition"
+    QString esp;          // existing ESP to use instead of making one
+    bool efi = false;
+    QString rootFilesystem = "ext4";
+    bool confirmWipe = false;
+    QStringList drives;   // several disks installed at once, instead of drive
+
+    QString iso;          // empty: the wizard's download location
+    QString desktop = "XFCE";
+    QString bootloader = "grub";  // see BootloaderStrategy
+    QStringList osProberDevices;  // disks GRUB lists other systems from
+    InitramfsProfile initramfs;
+    QString memory = "auto";      // see MemoryConfig
+    qint64 swapfileMiB = 0;       // 0: sized from the RAM
+    QString governor = "auto";    // see PerfBaseline
+
+    QString username;
+    QString password;
+    QString rootPassword;
+    QString userBatchFile;
+
+    // Reads a config file; on failure returns false with *error naming the
+    // line. Only the subset of TOML the keys above need is understood:
+    // [tables], strings, booleans, arrays of strings and comments.
+    bool load(const QString &path, QString *error);
+    // Consistency of the settings themselves, without looking at the system
+    QString validate() const;
+    // One config per disk in drives, or just this one
+    QList<InstallConfig> targets() const;
+};
+
+// Runs an install from an InstallConfig without any UI: checks the host,
+// lays out and formats the disk, then installs the system. The wizard runs
+// the same stages as jobs; the headless mode (main.cpp) runs all of them
+// and turns the result into the process exit code. Everything runs on the
+// calling thread and signals are emitted from it.
+class InstallEngine : public QObject {
+    Q_OBJECT
+
+public:
+    enum ExitCode {
+        Success = 0,
+        UsageError = 1,     // bad command line
+        ConfigError = 2,    // unreadable or inconsistent config
+        PreflightError = 3, // host not ready: not root, no drive, no ISO
+        DiskError = 4,      // partitioning, formatting or mounting failed
+        SystemError = 5,    // installing the system into the target failed
+        Canceled = 6,       // stopped on request; the target is unmounted
+        Warnings = 7,       // installed, but commands or config edits failed on the way
+    };
+    Q_ENUM(ExitCode)
+
+    enum class Stage { Preflight, Disk, System };
+
+    explicit InstallEngine(const InstallConfig &config, QObject *parent = nullptr);
+
+    // For one of several drives installed at once: its own mount root
+    // instead of /mnt, and the ISO mount and package cache shared with the
+    // other targets. Metrics are then written per drive.
+    void setTarget(const QString &root, const std::shared_ptr<SharedInstallSource> &source);
+    // Canceling stops the running command, lets the stage return and
+    // unmounts everything under the target root
+    void setCancelToken(const CancelToken &token) { cancelToken = token; }
+
+    // All stages in order, stopping at the first failure
+    ExitCode run();
+    // Preflight and the system stage again, on the disk a failed run left
+    // mounted; the install journal on it skips the steps that completed
+    ExitCode resume();
+    ExitCode runStage(Stage stage);
+
+    QString errorString() const { return error; }
+    // Errors the workers reported without stopping, in order
+    QStringList warnings() const { return warningList; }
+    // Warnings instead of Success when there were any
+    ExitCode outcome(ExitCode code) const;
+    // Worse of two results; Warnings is only better than Success
+    static ExitCode worse(ExitCode a, ExitCode b);
+    QString isoPath() const { return config.iso; }
+    static QString exitCodeName(ExitCode code);
+
+signals:
+    void stageChanged(const QString &stage);
+    void logMessage(const QString &message);
+    void warning(const QString &message);
+    void progressChanged(int permille, qint64 etaSeconds);
+    void failed(int exitCode, const QString &message);
+
+private:
+    ExitCode preflight();
+    // Root, an existing disk, and not the one the running system is on;
+    // part of preflight and checked again before the disk is touched
+    ExitCode checkTargetDisk();
+    ExitCode prepareDisk();
+    ExitCode installSystem();
+
+    bool runInstallerWorker(InstallerWorker::InstallMode mode, const QString &partition);
+    bool mountEsp(const QString &esp);
+    ExitCode fail(ExitCode code, const QString &message);
+    ExitCode finishCanceled();
+    void addWarning(const QString &message);
+
+    InstallConfig config;
+    QStringList warningList;
+    QString targetRoot = "/mnt";
+    std::shared_ptr<SharedInstallSource> source;
+    CancelToken cancelToken;
+    QString error;
+};
+
+#endif // INSTALLENGINE_H
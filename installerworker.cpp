@@ -1,34 +1,16 @@
 #include "installerworker.h"
-#include <QProcess>
-#include <QThread>
+#include "commandrunner.h"
+#include "filesystemstrategy.h"
+#include "formatter.h"
+#include "mountmanager.h"
+#include "partitionhelpers.h"
+#include "resizeplanner.h"
+#include "tracer.h"
+#include <QDir>
 #include <QFile>
-#include <QStandardPaths>
-#include <QFileInfo>
-
-static QString locatePartedBinary()
-{
-    QString p = QStandardPaths::findExecutable("parted");
-    if (!p.isEmpty())
-        return p;
-    const QStringList fallbacks{"/usr/sbin/parted", "/sbin/parted"};
-    for (const QString &path : fallbacks)
-        if (QFileInfo::exists(path))
-            return path;
-    return QString();
-}
-
-static bool waitForPartition(const QString &partPath, int timeoutSeconds = 10) {
-    QFileInfo fi(partPath);
-    int elapsed = 0;
-    while (!fi.exists() && elapsed < timeoutSeconds) {
-        QThread::sleep(1);
-        fi.refresh();
-        elapsed++;
-    }
-    return fi.exists();
-}
 
-InstallerWorker::InstallerWorker(QObject *parent) : QObject(parent) {}
+InstallerWorker::InstallerWorker(QObject *parent)
+    : QObject(parent), isoPath(QDir::tempPath() + "/archlinux.iso") {}
 
 void InstallerWorker::setDrive(const QString &drive) {
     selectedDrive = drive;
@@ -40,34 +22,50 @@ void InstallerWorker::setTargetPartition(const QString &part) {
     targetPartition = part;
 }
 
+void InstallerWorker::setRootFilesystem(const QString &fsName) {
+    rootFilesystem = fsName;
+}
+
+void InstallerWorker::setIsoPath(const QString &path) {
+    isoPath = path;
+}
+
+void InstallerWorker::setTargetRoot(const QString &root) {
+    targetRoot = root;
+}
+
 
 void InstallerWorker::run() {
-    QProcess process;
     QString suffix = (selectedDrive.startsWith("nvme") || selectedDrive.startsWith("mmc")) ? "p" : "";
     QString bootPart = QString("/dev/%1%2%3").arg(selectedDrive, suffix, "1");
     QString rootPart = QString("/dev/%1%2%3").arg(selectedDrive, suffix, "2");
 
     emit logMessage("🧙 Starting disk preparation in thread...");
 
-    // Unmount any existing mounts
-    emit logMessage("Unmounting existing /mnt...");
-    process.start("sudo", {"umount", "-l", "/mnt/*"});
-    process.waitForFinished();
-    process.start("sudo", {"umount", "-l", "/mnt"});
-    process.waitForFinished();
+    std::unique_ptr<FilesystemStrategy> fs = FilesystemStrategy::create(rootFilesystem);
+    if (!fs) {
+        emit errorOccurred("Unsupported root filesystem: " + rootFilesystem);
+        return;
+    }
 
+    // Only what is about to be overwritten: the partition being formatted,
+    // or the whole disk when it is wiped. Free space leaves the disk's
+    // other partitions, mounted or not, alone.
     QString queryTarget;
     if (mode == InstallMode::UsePartition)
         queryTarget = targetPartition;
-    else
+    else if (mode == InstallMode::WipeDrive)
         queryTarget = QString("/dev/%1").arg(selectedDrive);
 
-    process.start("/bin/bash", {"-c", QString("lsblk -nr -o MOUNTPOINT %1").arg(queryTarget)});
-    process.waitForFinished();
-    QStringList mps = QString(process.readAllStandardOutput()).split('\n', Qt::SkipEmptyParts);
-    for (const QString &mp : mps) {
-        process.start("sudo", {"umount", "-f", mp.trimmed()});
-        process.waitForFinished();
+    // Unmount anything left under the target root or on the target,
+    // including the ISO loop mount and swap from a previous run
+    TraceSpan step("step", "Unmount target");
+    emit logMessage(QString("Unmounting existing %1...").arg(targetRoot));
+    QString unmountError;
+    if (MountManager::unmountAll(targetRoot, queryTarget,
+                                 [this](const QString &msg) { emit logMessage(msg); }, &unmountError) < 0) {
+        emit errorOccurred(unmountError);
+        return;
     }
 
     QString partedBin;
@@ -78,50 +76,51 @@ void InstallerWorker::run() {
             emit errorOccurred("parted not found");
             return;
         }
+        Formatter formatter([this](const QString &msg) { emit logMessage(msg); });
+        // Whole-range discard before the new table is written; mkfs below
+        // then skips its own per-partition discard.
+        formatter.discard(QString("/dev/%1").arg(selectedDrive));
+
+        step.next("Partition");
         emit logMessage("Creating new partition table...");
         QStringList args{partedBin, QString("/dev/%1").arg(selectedDrive), "--script",
                          "mklabel", "msdos",
                          "mkpart", "primary", "ext4", "1MiB", "513MiB",
                          "set", "1", "boot", "on",
                          "mkpart", "primary", "ext4", "513MiB", "100%"};
-        if (QProcess::execute("sudo", args) != 0) {
+        if (CommandRunner::execute(args) != 0) {
             emit errorOccurred("Partition command failed");
             return;
         }
 
         emit logMessage("Refreshing partition table...");
-        QProcess::execute("sudo", {"partprobe", QString("/dev/%1").arg(selectedDrive)});
-        QProcess::execute("sudo", {"udevadm", "settle"});
+        CommandRunner::execute({"partprobe", QString("/dev/%1").arg(selectedDrive)});
+        CommandRunner::execute({"udevadm", "settle"});
 
         if (!waitForPartition(rootPart)) {
             emit errorOccurred("Partition device did not appear in time after partitioning. Cannot format.");
             return;
         }
 
-        emit logMessage("Formatting boot partition " + bootPart + " as ext4...");
-        if (QProcess::execute("sudo", {"mkfs.ext4", "-F", bootPart}) != 0) {
-            emit errorOccurred("Format failed.");
-            return;
-        }
-
-        if (!waitForPartition(rootPart)) {
+        if (!waitForPartition(bootPart)) {
             emit errorOccurred("Partition device did not appear in time after partitioning. Cannot format.");
             return;
         }
 
-        emit logMessage("Formatting partition " + rootPart + " as ext4...");
-        if (QProcess::execute("sudo", {"mkfs.ext4", "-F", rootPart}) != 0) {
-            emit errorOccurred("Format failed.");
-            return;
+        step.next("Format");
+        for (const FormatResult &r : formatter.formatAll({{bootPart, "ext4"}, {rootPart, fs->name()}}, false)) {
+            if (!r.ok) {
+                emit errorOccurred("Format failed.");
+                return;
+            }
         }
 
+        step.next("Mount");
         emit logMessage("Mounting partitions...");
-        process.start("sudo", {"mount", rootPart, "/mnt"});
-        process.waitForFinished();
-        process.start("sudo", {"mkdir", "-p", "/mnt/boot"});
-        process.waitForFinished();
-        process.start("sudo", {"mount", bootPart, "/mnt/boot"});
-        process.waitForFinished();
+        CommandRunner::execute({"mkdir", "-p", targetRoot});
+        CommandRunner::execute({"mount", "-o", fs->mountOptions(), rootPart, targetRoot});
+        CommandRunner::execute({"mkdir", "-p", targetRoot + "/boot"});
+        CommandRunner::execute({"mount", bootPart, targetRoot + "/boot"});
     } else if (mode == InstallMode::UsePartition) {
         rootPart = targetPartition;
 
@@ -130,14 +129,16 @@ void InstallerWorker::run() {
             return;
         }
 
-        emit logMessage("Formatting target partition " + rootPart + " as ext4...");
-        if (QProcess::execute("sudo", {"mkfs.ext4", "-F", rootPart}) != 0) {
+        step.next("Format");
+        Formatter formatter([this](const QString &msg) { emit logMessage(msg); });
+        if (!formatter.formatAll({{rootPart, fs->name()}}).first().ok) {
             emit errorOccurred("Format failed.");
             return;
         }
+        step.next("Mount");
         emit logMessage("Mounting partition...");
-        process.start("sudo", {"mount", rootPart, "/mnt"});
-        process.waitForFinished();
+        CommandRunner::execute({"mkdir", "-p", targetRoot});
+        CommandRunner::execute({"mount", "-o", fs->mountOptions(), rootPart, targetRoot});
     }  else if (mode == InstallMode::UseFreeSpace) {
             partedBin = locatePartedBinary();
             if (partedBin.isEmpty()) {
@@ -145,34 +146,30 @@ void InstallerWorker::run() {
                 return;
             }
             emit logMessage("Refreshing partition table...");
-            QProcess::execute("sudo", {"partprobe", QString("/dev/%1").arg(selectedDrive)});
-            QProcess::execute("sudo", {"udevadm", "settle"});
+            CommandRunner::execute({"partprobe", QString("/dev/%1").arg(selectedDrive)});
+            CommandRunner::execute({"udevadm", "settle"});
 
+            step.next("Partition");
             emit logMessage("Searching for free space...");
 
-            process.start("sudo", {partedBin, QString("/dev/%1").arg(selectedDrive), "-m", "unit", "MiB", "print", "free"});
-            process.waitForFinished();
-            QString out = process.readAllStandardOutput();
-            QStringList lines = out.split('\n', Qt::SkipEmptyParts);
-
+            // Only unallocated space is used here, so no existing data moves
+            ResizePlanner planner(selectedDrive);
+            if (!planner.load()) {
+                emit errorOccurred(planner.errorString());
+                return;
+            }
             double bestSize = 0.0; QString bestStart, bestEnd;
-            for (const QString &l : lines) {
-                if (!l.contains("free")) continue;
-                QStringList cols = l.split(':');
-                if (cols.size() >= 4) {
-                    QString sizeStr = cols.at(3);
-                    sizeStr.remove("MiB");
-                    double sz = sizeStr.toDouble();
-                    if (sz > bestSize) { bestSize = sz; bestStart = cols.at(1); bestEnd = cols.at(2); }
+            for (const DiskExtent &f : planner.freeRegions()) {
+                if (f.sizeMiB() > bestSize) {
+                    bestSize = f.sizeMiB();
+                    bestStart = QString::number(f.startMiB, 'f', 2);
+                    bestEnd = QString::number(f.endMiB, 'f', 2);
                 }
-            }emit logMessage(QString("Best free region: start=%1, end=%2, size=%3 MiB")
+            }
+            emit logMessage(QString("Best free region: start=%1, end=%2, size=%3 MiB")
                                 .arg(bestStart, bestEnd).arg(bestSize));
 
-            QProcess sizeProc;
-            sizeProc.start("lsblk", QStringList() << "-b" << "-dn" << "-o" << "SIZE" << QString("/dev/%1").arg(selectedDrive));
-            sizeProc.waitForFinished();
-            QString diskSizeStr = QString(sizeProc.readAllStandardOutput()).trimmed();
-            long long diskSizeMiB = diskSizeStr.toLongLong() / 1048576;
+            long long diskSizeMiB = blockDeviceSize(QString("/dev/%1").arg(selectedDrive)) / 1048576;
 
             QString startVal = bestStart;
             QString endVal = bestEnd;
@@ -196,22 +193,28 @@ void InstallerWorker::run() {
             QStringList args{partedBin, QString("/dev/%1").arg(selectedDrive), "--script",
                              "mkpart", "primary", startStr, endStr};
 
-            emit logMessage("About to run: sudo " + args.join(" "));
-
-            if (QProcess::execute("sudo", args) != 0) {
-
-                emit logMessage("Number two About to run: sudo " + args.join(" "));
+            // What execute() will run, sudo included only when we are not root
+            ProcessSpec spec;
+            spec.argv = CommandRunner::privileged(args);
+            emit logMessage("About to run: " + spec.displayString());
 
+            if (CommandRunner::execute(args) != 0) {
                 emit errorOccurred("Failed to create partition in free space");
                 return;
             }
             emit logMessage("Refreshing partition table...");
-            QProcess::execute("sudo", {"partprobe", QString("/dev/%1").arg(selectedDrive)});
-            QProcess::execute("sudo", {"udevadm", "settle"});
-
-            process.start("/bin/bash", {"-c", QString("lsblk -nr -o NAME,TYPE /dev/%1 | awk '$2==\"part\"{print $1}' | tail -n 1").arg(selectedDrive)});
-            process.waitForFinished();
-            rootPart = "/dev/" + QString(process.readAllStandardOutput()).trimmed();
+            CommandRunner::execute({"partprobe", QString("/dev/%1").arg(selectedDrive)});
+            CommandRunner::execute({"udevadm", "settle"});
+
+            // The newest partition is listed last
+            QString newest;
+            const QStringList rows = CommandRunner::capture({"lsblk", "-nr", "-o", "NAME,TYPE",
+                                                             QString("/dev/%1").arg(selectedDrive)})
+                                         .split('\n', Qt::SkipEmptyParts);
+            for (const QString &row : rows)
+                if (row.section(' ', 1, 1) == "part")
+                    newest = row.section(' ', 0, 0);
+            rootPart = "/dev/" + newest;
 
             // Wait for device to appear before formatting
             if (!waitForPartition(rootPart)) {
@@ -219,18 +222,21 @@ void InstallerWorker::run() {
                 return;
             }
 
-            emit logMessage("Formatting partition " + rootPart + " as ext4...");
-            if (QProcess::execute("sudo", {"mkfs.ext4", "-F", rootPart}) != 0) {
+            step.next("Format");
+            Formatter formatter([this](const QString &msg) { emit logMessage(msg); });
+            if (!formatter.formatAll({{rootPart, fs->name()}}).first().ok) {
                 emit errorOccurred("Format failed.");
                 return;
             }
+            step.next("Mount");
             emit logMessage("Mounting partition...");
-            process.start("sudo", {"mount", rootPart, "/mnt"});
-            process.waitForFinished();
+            CommandRunner::execute({"mkdir", "-p", targetRoot});
+            CommandRunner::execute({"mount", "-o", fs->mountOptions(), rootPart, targetRoot});
         }
 
-    process.start("/bin/bash", {"-c", "if [ -f /tmp/archlinux.iso ]; then sudo cp /tmp/archlinux.iso /mnt/archlinux.iso; fi"});
-    process.waitForFinished();
+    step.next("Copy ISO");
+    if (!isoPath.isEmpty() && QFile::exists(isoPath))
+        CommandRunner::execute({"cp", isoPath, targetRoot + "/archlinux.iso"});
 
     emit logMessage("✅ Drive is ready.");
     emit installComplete();
@@ -12,6 +12,12 @@ public:
     enum class InstallMode { WipeDrive, UsePartition, UseFreeSpace };
     void setMode(InstallMode mode);
     void setTargetPartition(const QString &partition);
+    void setRootFilesystem(const QString &fsName);
+    // ISO copied into the target; the wizard downloads to the temp dir.
+    // Empty when the system stage reads a shared ISO mount instead.
+    void setIsoPath(const QString &path);
+    // Mount root for the target, /mnt unless several drives install at once
+    void setTargetRoot(const QString &root);
 
 signals:
     void logMessage(const QString &message);
@@ -25,6 +31,9 @@ private:
     QString selectedDrive;
     InstallMode mode = InstallMode::WipeDrive;
     QString targetPartition; // used when mode == UsePartition
+    QString rootFilesystem = "ext4";
+    QString isoPath;
+    QString targetRoot = "/mnt";
 };
 
 #endif // INSTALLERWORKER_H
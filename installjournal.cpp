@@ -0,0 +1,122 @@
+#include "installjournal.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+InstallJournal::InstallJournal(const QString &r) : root(r) {}
+
+QByteArray InstallJournal::hashInputs(const QStringList &inputs)
+{
+    // Separated by NUL so {"ab", "c"} and {"a", "bc"} differ
+    return QCryptographicHash::hash(inputs.join(QChar(0)).toUtf8(), QCryptographicHash::Sha256).toHex();
+}
+
+bool InstallJournal::load()
+{
+    entries.clear();
+    position = 0;
+    intact = true;
+    running = false;
+    skipped = 0;
+
+    QFile f(hostPath());
+    if (!f.exists())
+        return true;
+    if (!f.open(QIODevice::ReadOnly)) {
+        error = QString("Cannot read %1: %2").arg(hostPath(), f.errorString());
+        return false;
+    }
+    QJsonObject doc = QJsonDocument::fromJson(f.readAll()).object();
+    if (doc.value("version").toInt() != 1) {
+        error = hostPath() + " is not an install journal this installer understands";
+        return false;
+    }
+    for (const QJsonValue &v : doc.value("steps").toArray()) {
+        QJsonObject o = v.toObject();
+        Entry e;
+        e.step = o.value("step").toString();
+        e.inputs = o.value("inputs").toString().toLatin1();
+        e.done = o.value("state").toString() == "done";
+        e.finishedAt = qint64(o.value("finishedAt").toDouble());
+        entries << e;
+    }
+    return true;
+}
+
+bool InstallJournal::isComplete(const QString &step, const QByteArray &inputsHash) const
+{
+    if (!intact || position >= entries.size())
+        return false;
+    const Entry &e = entries.at(position);
+    return e.done && e.step == step && e.inputs == inputsHash;
+}
+
+void InstallJournal::skip()
+{
+    ++position;
+    ++skipped;
+}
+
+bool InstallJournal::begin(const QString &step, const QByteArray &inputsHash)
+{
+    // A step begun before and never completed stays recorded as running
+    intact = false;
+    entries = entries.mid(0, position);
+    Entry e;
+    e.step = step;
+    e.inputs = inputsHash;
+    entries << e;
+    ++position;
+    running = true;
+    return save();
+}
+
+bool InstallJournal::complete()
+{
+    if (!running)
+        return true;
+    running = false;
+    entries.last().done = true;
+    entries.last().finishedAt = QDateTime::currentSecsSinceEpoch();
+    return save();
+}
+
+bool InstallJournal::remove()
+{
+    entries.clear();
+    running = false;
+    if (QFile::exists(hostPath()) && !QFile::remove(hostPath())) {
+        error = "Cannot remove " + hostPath();
+        return false;
+    }
+    return true;
+}
+
+bool InstallJournal::save()
+{
+    QJsonArray steps;
+    for (const Entry &e : std::as_const(entries)) {
+        QJsonObject o{{"step", e.step},
+                      {"inputs", QString::fromLatin1(e.inputs)},
+                      {"state", e.done ? "done" : "running"}};
+        if (e.done)
+            o["finishedAt"] = e.finishedAt;
+        steps.append(o);
+    }
+    QJsonObject doc{{"version", 1}, {"steps", steps}};
+
+    QDir().mkpath(QFileInfo(hostPath()).absolutePath());
+    QSaveFile f(hostPath());
+    QByteArray data = QJsonDocument(doc).toJson();
+    if (!f.open(QIODevice::WriteOnly) || f.write(data) != data.size() || !f.commit()) {
+        error = QString("Cannot write %1: %2").arg(hostPath(), f.errorString());
+        return false;
+    }
+    return true;
+}
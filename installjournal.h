@@ -0,0 +1,69 @@
+#ifndef INSTALLJOURNAL_H
+#define INSTALLJOURNAL_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+// Which steps of the system install completed on a target, kept on the
+// target itself so a failed install can be rerun without repeating them.
+// Steps are recorded in the order they run with a hash of their inputs
+// (packages, boot mode, ...). On a rerun a step is skipped only when the
+// entry at its position completed with the same inputs and every journaled
+// step before it was skipped as well; from the first step that has to run
+// again, everything after it runs again too.
+//
+//   InstallJournal journal("/mnt");
+//   journal.load();
+//   if (journal.isComplete("Base packages", hash) && kernelInstalled()) {
+//       journal.skip();
+//   } else {
+//       journal.begin("Base packages", hash);
+//       ...
+//       journal.complete();
+//   }
+class InstallJournal {
+public:
+    explicit InstallJournal(const QString &root);
+
+    // Inside the target; removed once the install has completed
+    static QString journalPath() { return "/var/lib/archhelp/install-journal.json"; }
+    static QByteArray hashInputs(const QStringList &inputs);
+
+    QString errorString() const { return error; }
+    QString hostPath() const { return root + journalPath(); }
+
+    // A missing journal is an empty one; an unreadable one is discarded
+    bool load();
+    bool isComplete(const QString &step, const QByteArray &inputsHash) const;
+    void skip();
+    // Records step as running and forgets every entry from its position on.
+    // The step before it is only done if complete() was called for it.
+    bool begin(const QString &step, const QByteArray &inputsHash);
+    // Marks the step begun last as done; a no-op when none is running
+    bool complete();
+    bool remove();
+
+    int skippedSteps() const { return skipped; }
+
+private:
+    struct Entry {
+        QString step;
+        QByteArray inputs;
+        bool done = false;
+        qint64 finishedAt = 0;
+    };
+
+    bool save();
+
+    QString root;
+    QString error;
+    QList<Entry> entries;
+    int position = 0;       // entry the next step is compared with
+    bool intact = true;     // no step has run yet in this run
+    bool running = false;
+    int skipped = 0;
+};
+
+#endif // INSTALLJOURNAL_H
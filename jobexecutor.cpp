@@ -0,0 +1,168 @@
+#include "jobexecutor.h"
+#include "commandrunner.h"
+#include <QMetaObject>
+#include <QRunnable>
+#include <utility>
+
+void JobContext::log(const QString &message)
+{
+    emit executor->logMessage(message);
+}
+
+void JobContext::setProgress(int permille, const QString &text)
+{
+    // Looked up on the executor's thread; the name is only read there
+    JobExecutor *e = executor;
+    int id = jobId;
+    QMetaObject::invokeMethod(e, [e, id, permille, text]() {
+        for (const JobExecutor::Job &job : std::as_const(e->running))
+            if (job.id == id)
+                emit e->jobProgress(id, job.name, permille, text);
+    }, Qt::QueuedConnection);
+}
+
+void JobContext::fail(const QString &message)
+{
+    failed = true;
+    error = message;
+}
+
+namespace {
+
+class JobRunnable : public QRunnable {
+public:
+    explicit JobRunnable(const std::function<void()> &fn) : fn(fn) {}
+    void run() override { fn(); }
+
+private:
+    std::function<void()> fn;
+};
+
+} // namespace
+
+JobExecutor::JobExecutor(int maxThreads, QObject *parent) : QObject(parent)
+{
+    pool.setMaxThreadCount(maxThreads);
+    // mkfs, resize2fs and pacman run for minutes; keep the threads around
+    pool.setExpiryTimeout(-1);
+}
+
+JobExecutor::~JobExecutor()
+{
+    cancelAll();
+    pool.waitForDone();
+}
+
+int JobExecutor::submit(const QString &name, const QString &device, const WorkFn &work,
+                        const DoneFn &done)
+{
+    Job job;
+    job.id = nextId++;
+    job.name = name;
+    job.device = device;
+    job.work = work;
+    job.done = done;
+    queued << job;
+    dispatch();
+    return job.id;
+}
+
+void JobExecutor::cancel(int id)
+{
+    for (int i = 0; i < queued.size(); ++i) {
+        if (queued.at(i).id != id)
+            continue;
+        Job job = queued.takeAt(i);
+        JobResult result;
+        result.id = job.id;
+        result.name = job.name;
+        result.canceled = true;
+        if (job.done)
+            job.done(result);
+        emit jobFinished(result);
+        dispatch();
+        return;
+    }
+    for (const Job &job : std::as_const(running))
+        if (job.id == id)
+            job.token.cancel();
+}
+
+void JobExecutor::cancelAll()
+{
+    while (!queued.isEmpty())
+        cancel(queued.last().id);
+    for (const Job &job : std::as_const(running))
+        job.token.cancel();
+}
+
+void JobExecutor::waitForDone()
+{
+    pool.waitForDone();
+}
+
+void JobExecutor::dispatch()
+{
+    for (int i = 0; i < queued.size();) {
+        const Job &job = queued.at(i);
+        if (!job.device.isEmpty() && busyDevices.contains(job.device)) {
+            ++i;
+            continue;
+        }
+        start(queued.takeAt(i));
+    }
+    bool busy = isBusy();
+    if (busy != wasBusy) {
+        wasBusy = busy;
+        emit busyChanged(busy);
+    }
+}
+
+void JobExecutor::start(const Job &job)
+{
+    if (!job.device.isEmpty())
+        busyDevices.insert(job.device);
+    running << job;
+    emit jobStarted(job.id, job.name);
+
+    WorkFn work = job.work;
+    CancelToken token = job.token;
+    int id = job.id;
+    QString name = job.name;
+    auto *runnable = new JobRunnable([this, work, token, id, name]() {
+        JobContext context(this, id, token);
+        {
+            // Abort reaches every command the job starts, not only those
+            // of jobs that pass the token on themselves
+            CommandRunner::CancelScope scope(token);
+            work(context);
+        }
+        JobResult result;
+        result.id = id;
+        result.name = name;
+        result.canceled = token.isCanceled();
+        result.ok = !context.failed && !result.canceled;
+        result.error = context.error;
+        QMetaObject::invokeMethod(this, [this, result]() { finish(result); },
+                                  Qt::QueuedConnection);
+    });
+    pool.start(runnable);
+}
+
+void JobExecutor::finish(const JobResult &result)
+{
+    DoneFn done;
+    for (int i = 0; i < running.size(); ++i) {
+        if (running.at(i).id != result.id)
+            continue;
+        Job job = running.takeAt(i);
+        if (!job.device.isEmpty())
+            busyDevices.remove(job.device);
+        done = job.done;
+        break;
+    }
+    if (done)
+        done(result);
+    emit jobFinished(result);
+    dispatch();
+}
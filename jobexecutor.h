@@ -0,0 +1,106 @@
+#ifndef JOBEXECUTOR_H
+#define JOBEXECUTOR_H
+
+#include "canceltoken.h"
+#include <QList>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QThreadPool>
+#include <functional>
+
+class JobExecutor;
+
+// Handed to the job's work function on the pool thread. The work must not
+// touch widgets; anything the GUI needs goes back through the done
+// callback, which runs on the executor's thread.
+class JobContext {
+public:
+    int id() const { return jobId; }
+    bool isCanceled() const { return token.isCanceled(); }
+    CancelToken cancelToken() const { return token; }
+
+    void log(const QString &message);
+    void setProgress(int permille, const QString &text = QString());
+    // Marks the job failed; the work function should return afterwards
+    void fail(const QString &error);
+
+private:
+    friend class JobExecutor;
+    JobContext(JobExecutor *executor, int id, const CancelToken &token)
+        : executor(executor), jobId(id), token(token) {}
+
+    JobExecutor *executor;
+    int jobId;
+    CancelToken token;
+    QString error;
+    bool failed = false;
+};
+
+struct JobResult {
+    int id = 0;
+    QString name;
+    bool ok = false;
+    bool canceled = false;
+    QString error;
+};
+
+// Runs background work for the wizard on a bounded thread pool. Jobs that
+// name a device (the disk, e.g. "sda") run one at a time per device in the
+// order they were submitted, so a partition table refresh never reads a
+// disk that parted is still rewriting. Jobs without a device run as soon
+// as a thread is free. submit() and cancel() must be called from the
+// thread the executor lives in, which is also where done callbacks run.
+class JobExecutor : public QObject {
+    Q_OBJECT
+
+public:
+    using WorkFn = std::function<void(JobContext &)>;
+    using DoneFn = std::function<void(const JobResult &)>;
+
+    explicit JobExecutor(int maxThreads = 4, QObject *parent = nullptr);
+    ~JobExecutor() override;
+
+    int submit(const QString &name, const QString &device, const WorkFn &work,
+               const DoneFn &done = DoneFn());
+    // A queued job is dropped; a running one sees isCanceled()
+    void cancel(int id);
+    void cancelAll();
+    void waitForDone();
+
+    bool isBusy() const { return !running.isEmpty() || !queued.isEmpty(); }
+    bool isBusy(const QString &device) const { return busyDevices.contains(device); }
+
+signals:
+    void jobStarted(int id, const QString &name);
+    void jobProgress(int id, const QString &name, int permille, const QString &text);
+    void jobFinished(const JobResult &result);
+    void busyChanged(bool busy);
+    // Emitted from the pool thread
+    void logMessage(const QString &message);
+
+private:
+    friend class JobContext;
+
+    struct Job {
+        int id = 0;
+        QString name;
+        QString device;
+        WorkFn work;
+        DoneFn done;
+        CancelToken token;
+    };
+
+    void dispatch();
+    void start(const Job &job);
+    void finish(const JobResult &result);
+
+    QThreadPool pool;
+    QList<Job> queued;
+    QList<Job> running;
+    QSet<QString> busyDevices;
+    int nextId = 1;
+    bool wasBusy = false;
+};
+
+#endif // JOBEXECUTOR_H
@@ -0,0 +1,201 @@
+#include "keyringcache.h"
+#include "commandrunner.h"
+#include <QDir>
+#include <QDebug>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QTemporaryDir>
+#include <utility>
+
+namespace {
+
+const QString KeyringDir = "/etc/pacman.d/gnupg";
+
+// The same budget SystemWorker gives pacman-key
+const int TimeoutMs = 10 * 60 * 1000;
+const int StallMs = 3 * 60 * 1000;
+
+// Runs argv inside root the way SystemWorker::runChroot does, under the
+// watchdog and this thread's CancelScope. Returns the exit code, or -1 when
+// it was stopped; stdout goes to output when given.
+int runInRoot(const QString &root, const QStringList &argv, QString *output = nullptr)
+{
+    CommandRunner runner([output](const QString &line, bool isStderr) {
+        if (output && !isStderr)
+            *output += line + '\n';
+    });
+    ProcessSpec spec;
+    spec.argv = argv;
+    spec.chrootDir = root;
+    spec.env = CommandRunner::chrootEnvironment();
+    spec.timeoutMs = TimeoutMs;
+    spec.stallMs = StallMs;
+    CommandResult r = runner.run(spec);
+    if (!r.watchdog.isEmpty() && !r.canceled) {
+        qWarning().noquote() << "Watchdog:" << spec.displayString() << r.watchdog;
+        for (const QString &line : std::as_const(r.processDump))
+            qWarning().noquote() << " " << line;
+    }
+    return r.termSignal || !r.watchdog.isEmpty() ? -1 : r.exitCode;
+}
+
+QStringList gpg(const QStringList &args)
+{
+    return QStringList{"gpg", "--homedir", KeyringDir, "--batch", "--yes"} + args;
+}
+
+// An agent left running holds sockets in the keyring directory
+void stopAgent(const QString &root)
+{
+    runInRoot(root, {"gpgconf", "--homedir", KeyringDir, "--kill", "gpg-agent"});
+}
+
+bool isVersion(const QString &version)
+{
+    static const QRegularExpression valid("^[0-9A-Za-z._:+-]+$");
+    return valid.match(version).hasMatch();
+}
+
+} // namespace
+
+KeyringCache::KeyringCache(const QString &directory) : dir(directory) {}
+
+QString KeyringCache::defaultDirectory()
+{
+    return "/var/cache/archhelp/keyring";
+}
+
+QString KeyringCache::availableVersion(const QString &root)
+{
+    QString out;
+    int exitCode = runInRoot(root, {"pacman", "-Sp", "--print-format", "%v", "archlinux-keyring"}, &out);
+    QString version = out.trimmed().section('\n', -1);
+    return exitCode == 0 && isVersion(version) ? version : QString();
+}
+
+QString KeyringCache::installedVersion(const QString &root)
+{
+    // Local database entries are named <package>-<version>-<release>
+    const QString prefix = "archlinux-keyring-";
+    const QStringList entries = QDir(root + "/var/lib/pacman/local").entryList({prefix + "*"}, QDir::Dirs);
+    for (const QString &entry : entries) {
+        QString version = entry.mid(prefix.size());
+        // Keeps archlinux-keyring-foo from matching
+        if (!version.isEmpty() && version.at(0).isDigit() && isVersion(version))
+            return version;
+    }
+    return QString();
+}
+
+QString KeyringCache::pathFor(const QString &version) const
+{
+    return dir + "/" + version;
+}
+
+bool KeyringCache::contains(const QString &version) const
+{
+    return isVersion(version) && QFileInfo::exists(pathFor(version) + "/trustdb.gpg");
+}
+
+bool KeyringCache::restore(const QString &version, const QString &root, const LogFn &log)
+{
+    QString target = root + KeyringDir;
+    QDir(target).removeRecursively();
+    QDir().mkpath(QFileInfo(target).absolutePath());
+    if (CommandRunner::execute({"cp", "-a", pathFor(version), target}) != 0) {
+        log("Could not copy the cached keyring " + pathFor(version));
+        QDir(target).removeRecursively();
+        return false;
+    }
+    return true;
+}
+
+// The keyring trusts packagers through local signatures the master key made
+// on the Arch master keys. Deleting the copied master key voids those; a new
+// one is generated and signs the keys archlinux-trusted lists again.
+bool KeyringCache::renewMasterKey(const QString &root, const LogFn &log)
+{
+    QString keys;
+    if (runInRoot(root, gpg({"--with-colons", "--list-secret-keys"}), &keys) != 0) {
+        log("Could not list the keyring's master key");
+        return false;
+    }
+    // The fpr record after a sec record is the primary key's fingerprint
+    QStringList masterKeys;
+    bool primary = false;
+    for (const QString &line : keys.split('\n')) {
+        if (line.startsWith("sec:"))
+            primary = true;
+        else if (line.startsWith("fpr:") && primary)
+            masterKeys << line.section(':', 9, 9);
+        if (!line.startsWith("sec:"))
+            primary = false;
+    }
+    for (const QString &fpr : std::as_const(masterKeys)) {
+        if (runInRoot(root, gpg({"--delete-secret-and-public-key", fpr})) != 0) {
+            log("Could not remove the cached master key " + fpr);
+            return false;
+        }
+    }
+
+    // Without a secret key --init generates one and trusts it ultimately
+    if (runInRoot(root, {"pacman-key", "--init"}) != 0) {
+        log("Could not generate the keyring's master key");
+        return false;
+    }
+    QFile trusted(root + "/usr/share/pacman/keyrings/archlinux-trusted");
+    if (!trusted.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        log("Cannot read " + trusted.fileName());
+        return false;
+    }
+    // <fingerprint>:<ownertrust> per line
+    for (const QByteArray &raw : trusted.readAll().split('\n')) {
+        QString fpr = QString::fromLatin1(raw).section(':', 0, 0).trimmed();
+        if (fpr.isEmpty() || fpr.startsWith('#'))
+            continue;
+        if (runInRoot(root, {"pacman-key", "--lsign-key", fpr}) != 0) {
+            log("Could not sign " + fpr + " with the new master key");
+            return false;
+        }
+    }
+    bool ok = runInRoot(root, {"pacman-key", "--updatedb"}) == 0;
+    stopAgent(root);
+    if (!ok)
+        log("Could not update the keyring's trust database");
+    return ok;
+}
+
+bool KeyringCache::store(const QString &version, const QString &root, const LogFn &log)
+{
+    if (!isVersion(version))
+        return false;
+    if (contains(version))
+        return true;
+    stopAgent(root);
+
+    // Holds the copied master key's private half
+    if (!QDir().mkpath(dir)
+        || !QFile::setPermissions(dir, QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner)) {
+        log("Could not create the keyring cache " + dir);
+        return false;
+    }
+    // Copied aside first and renamed into place, so a concurrent restore
+    // never sees half a keyring
+    QTemporaryDir staging(dir + "/.store-XXXXXX");
+    QString copy = staging.path() + "/gnupg";
+    if (!staging.isValid() || CommandRunner::execute({"cp", "-a", root + KeyringDir, copy}) != 0) {
+        log("Could not copy the keyring into " + dir);
+        return false;
+    }
+    QDirIterator sockets(copy, {"S.*"}, QDir::System | QDir::Files);
+    while (sockets.hasNext())
+        QFile::remove(sockets.next());
+    if (!QDir().rename(copy, pathFor(version)) && !contains(version)) {
+        log("Could not store the keyring in " + pathFor(version));
+        return false;
+    }
+    log(QString("Keyring %1 cached in %2").arg(version, pathFor(version)));
+    return true;
+}
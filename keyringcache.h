@@ -0,0 +1,47 @@
+#ifndef KEYRINGCACHE_H
+#define KEYRINGCACHE_H
+
+#include <QString>
+#include <functional>
+
+// Initialized pacman keyrings kept on the host, one per version of the
+// archlinux-keyring package. Populating a fresh keyring imports and signs
+// every packager key, which is most of the keyring step; a target whose
+// sync database offers a version already cached gets a copy instead. The
+// copy carries the master key of the install it was taken from, so
+// renewMasterKey() replaces it with one generated on the target: targets
+// must not share a key that can certify packagers. The cache holds that
+// private key too and is readable by root only.
+//
+//   KeyringCache keyrings;
+//   QString version = KeyringCache::availableVersion("/mnt");
+//   if (keyrings.contains(version) && keyrings.restore(version, "/mnt", log))
+//       KeyringCache::renewMasterKey("/mnt", log);
+class KeyringCache {
+public:
+    using LogFn = std::function<void(const QString &)>;
+
+    explicit KeyringCache(const QString &directory = defaultDirectory());
+
+    // /var/cache/archhelp/keyring, next to the shared package cache
+    static QString defaultDirectory();
+    // Version of archlinux-keyring the target's sync database offers; the
+    // databases are unsigned, so this works before the keyring exists
+    static QString availableVersion(const QString &root);
+    static QString installedVersion(const QString &root);
+
+    bool contains(const QString &version) const;
+    // Replaces the target's /etc/pacman.d/gnupg with the cached copy
+    bool restore(const QString &version, const QString &root, const LogFn &log);
+    static bool renewMasterKey(const QString &root, const LogFn &log);
+    // Keeps the target's keyring for later installs; a version that is
+    // already cached, possibly by a target running alongside, is left alone
+    bool store(const QString &version, const QString &root, const LogFn &log);
+
+private:
+    QString pathFor(const QString &version) const;
+
+    QString dir;
+};
+
+#endif // KEYRINGCACHE_H
@@ -0,0 +1,153 @@
+#include "logmodel.h"
+#include <QDateTime>
+#include <QDir>
+#include <QEvent>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QPlainTextEdit>
+#include <QScrollBar>
+#include <QThread>
+
+LogModel::LogModel(int capacity, QObject *parent) : QObject(parent), ring(capacity)
+{
+    frameTimer.setSingleShot(true);
+    frameTimer.setInterval(1000 / FramesPerSecond);
+    connect(&frameTimer, &QTimer::timeout, this, &LogModel::flush);
+}
+
+LogModel::~LogModel()
+{
+    QMutexLocker lock(&mutex);
+    if (file.isOpen())
+        file.flush();
+}
+
+QString LogModel::defaultLogPath()
+{
+    return "/var/log/archhelp/install.log";
+}
+
+bool LogModel::setLogFile(const QString &path)
+{
+    QMutexLocker lock(&mutex);
+    if (file.isOpen())
+        file.close();
+    const QStringList candidates{path, QDir::temp().filePath("archhelp-install.log")};
+    for (const QString &candidate : candidates) {
+        QDir().mkpath(QFileInfo(candidate).absolutePath());
+        file.setFileName(candidate);
+        if (file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+            file.write(QString("--- %1 ---\n")
+                           .arg(QDateTime::currentDateTime().toString(Qt::ISODate))
+                           .toUtf8());
+            return true;
+        }
+    }
+    return false;
+}
+
+QString LogModel::logFilePath() const
+{
+    QMutexLocker lock(&mutex);
+    return file.isOpen() ? file.fileName() : QString();
+}
+
+void LogModel::attach(QPlainTextEdit *view)
+{
+    if (!view)
+        return;
+    // Lines beyond the ring are only in the file, so the view needs no more
+    view->setMaximumBlockCount(ring.capacity());
+    view->setUndoRedoEnabled(false);
+    view->installEventFilter(this);
+    views << View{view, -1};
+    if (view->isVisible())
+        catchUp(views.last());
+}
+
+QStringList LogModel::lines() const
+{
+    QMutexLocker lock(&mutex);
+    QStringList out;
+    out.reserve(ring.count());
+    for (qsizetype i = ring.firstIndex(); i <= ring.lastIndex(); ++i)
+        out << ring.at(i);
+    return out;
+}
+
+void LogModel::append(const QString &line)
+{
+    bool schedule;
+    {
+        QMutexLocker lock(&mutex);
+        ring.append(line);
+        // QFile buffers, so this is a memcpy for most lines; flush() pushes
+        // it out once per frame
+        if (file.isOpen())
+            file.write(line.toUtf8() + '\n');
+        schedule = !flushScheduled;
+        flushScheduled = true;
+    }
+    if (schedule)
+        scheduleFlush();
+}
+
+void LogModel::scheduleFlush()
+{
+    if (QThread::currentThread() == thread()) {
+        frameTimer.start();
+        return;
+    }
+    QMetaObject::invokeMethod(this, [this]() { frameTimer.start(); }, Qt::QueuedConnection);
+}
+
+void LogModel::flush()
+{
+    {
+        QMutexLocker lock(&mutex);
+        flushScheduled = false;
+        if (file.isOpen())
+            file.flush();
+    }
+    for (View &v : views)
+        if (v.widget && v.widget->isVisible())
+            catchUp(v);
+}
+
+// Appends what the view has not seen yet as one block of text. A view that
+// fell further behind than the ring reaches is rebuilt from the ring.
+void LogModel::catchUp(View &view)
+{
+    QStringList batch;
+    bool rebuild;
+    {
+        QMutexLocker lock(&mutex);
+        if (ring.isEmpty() || view.shown >= ring.lastIndex())
+            return;
+        rebuild = view.shown < ring.firstIndex() - 1 || view.shown < 0;
+        qsizetype from = rebuild ? ring.firstIndex() : view.shown + 1;
+        batch.reserve(ring.lastIndex() - from + 1);
+        for (qsizetype i = from; i <= ring.lastIndex(); ++i)
+            batch << ring.at(i);
+        view.shown = ring.lastIndex();
+    }
+    if (rebuild) {
+        view.widget->setPlainText(batch.join('\n'));
+        view.widget->verticalScrollBar()->setValue(view.widget->verticalScrollBar()->maximum());
+    } else {
+        view.widget->appendPlainText(batch.join('\n'));
+    }
+}
+
+bool LogModel::eventFilter(QObject *watched, QEvent *event)
+{
+    if (event->type() == QEvent::Show) {
+        for (View &v : views) {
+            if (v.widget == watched) {
+                catchUp(v);
+                break;
+            }
+        }
+    }
+    return QObject::eventFilter(watched, event);
+}
@@ -0,0 +1,70 @@
+#ifndef LOGMODEL_H
+#define LOGMODEL_H
+
+#include <QContiguousCache>
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+
+class QPlainTextEdit;
+
+// One log shared by every log view of the wizard. append() may be called
+// from any thread; lines are queued and handed to the views in one batch
+// per frame (at most FramesPerSecond times a second), so a burst of pacman
+// output costs one relayout instead of one per line per view. Hidden views
+// are skipped and catch up from the ring buffer when shown. The ring
+// bounds what the views hold; the complete log goes to a file.
+class LogModel : public QObject {
+    Q_OBJECT
+
+public:
+    static const int DefaultCapacity = 5000;
+    static const int FramesPerSecond = 30;
+
+    explicit LogModel(int capacity = DefaultCapacity, QObject *parent = nullptr);
+    ~LogModel() override;
+
+    static QString defaultLogPath();
+    // Appends to the file; falls back to the temp directory when path
+    // cannot be opened. Returns false if neither could be.
+    bool setLogFile(const QString &path = defaultLogPath());
+    QString logFilePath() const;
+
+    void attach(QPlainTextEdit *view);
+
+    // The newest lines, at most capacity of them
+    QStringList lines() const;
+
+public slots:
+    void append(const QString &line);
+    // Brings the file and the visible views up to date now
+    void flush();
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private:
+    struct View {
+        QPointer<QPlainTextEdit> widget;
+        qsizetype shown = -1; // ring index of the last line it has
+    };
+
+    void scheduleFlush();
+    void catchUp(View &view);
+
+    mutable QMutex mutex;
+    QContiguousCache<QString> ring;
+    bool flushScheduled = false;
+    QFile file;
+
+    // GUI thread only
+    QList<View> views;
+    QTimer frameTimer;
+};
+
+#endif // LOGMODEL_H
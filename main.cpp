@@ -1,12 +1,204 @@
 #include "Installwizard.h"
+#include "installengine.h"
+#include "metricsexporter.h"
+#include "sharedinstallsource.h"
+#include "tracer.h"
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QMessageBox>
 #include <QFileInfo>
 #include <QProcess>
+#include <QThread>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <memory>
 #include <unistd.h>
 #include <vector>
 
+// SIGINT/SIGTERM cancel a headless install: the running command is killed
+// and the target unmounted before the installer exits with Canceled
+static CancelToken headlessCancel;
+
+static void cancelHeadless(int) {
+    headlessCancel.cancel();
+}
+
+// One JSON object per line on stdout, for provisioning scripts
+static void printEvent(const QJsonObject &event) {
+    QByteArray line = QJsonDocument(event).toJson(QJsonDocument::Compact);
+    line += '\n';
+    fwrite(line.constData(), 1, line.size(), stdout);
+    fflush(stdout);
+}
+
+// Prints an engine's signals as events. target is the disk, so the events
+// of drives installed at the same time can be told apart.
+static void printEvents(InstallEngine &engine, const QString &target) {
+    QObject::connect(&engine, &InstallEngine::stageChanged, [target](const QString &stage) {
+        printEvent({{"event", "stage"}, {"target", target}, {"stage", stage}});
+    });
+    QObject::connect(&engine, &InstallEngine::logMessage, [target](const QString &message) {
+        printEvent({{"event", "log"}, {"target", target}, {"message", message}});
+    });
+    QObject::connect(&engine, &InstallEngine::warning, [target](const QString &message) {
+        printEvent({{"event", "warning"}, {"target", target}, {"message", message}});
+    });
+    QObject::connect(&engine, &InstallEngine::progressChanged, [target](int permille, qint64 eta) {
+        printEvent({{"event", "progress"}, {"target", target}, {"permille", permille}, {"eta_seconds", eta}});
+    });
+    QObject::connect(&engine, &InstallEngine::failed, [target](int code, const QString &message) {
+        printEvent({{"event", "error"},
+                    {"target", target},
+                    {"class", InstallEngine::exitCodeName(InstallEngine::ExitCode(code))},
+                    {"exit_code", code},
+                    {"message", message}});
+    });
+}
+
+// disk.drives: every drive is checked first, then the ISO is mounted once
+// for all of them and each drive is partitioned and installed on its own
+// thread under /run/archhelp/targets/<drive>. Package downloads go through
+// one shared cache. With resume the disks are left as a failed run left
+// them. The exit code is the worst of the drives'.
+static InstallEngine::ExitCode runTargets(const QList<InstallConfig> &targets, bool resume) {
+    std::vector<std::unique_ptr<InstallEngine>> engines;
+    for (const InstallConfig &target : targets) {
+        engines.push_back(std::make_unique<InstallEngine>(target));
+        engines.back()->setCancelToken(headlessCancel);
+        printEvents(*engines.back(), target.drive);
+        InstallEngine::ExitCode code = engines.back()->runStage(InstallEngine::Stage::Preflight);
+        if (code != InstallEngine::Success)
+            return code;
+    }
+
+    auto source = std::make_shared<SharedInstallSource>(engines.front()->isoPath());
+    QString error;
+    auto log = [](const QString &message) { printEvent({{"event", "log"}, {"message", message}}); };
+    if (!source->open(log, &error)) {
+        printEvent({{"event", "error"},
+                    {"class", InstallEngine::exitCodeName(InstallEngine::PreflightError)},
+                    {"exit_code", InstallEngine::PreflightError},
+                    {"message", error}});
+        return InstallEngine::PreflightError;
+    }
+
+    std::vector<InstallEngine::ExitCode> codes(engines.size(), InstallEngine::Success);
+    QList<QThread *> threads;
+    for (size_t i = 0; i < engines.size(); ++i) {
+        InstallEngine *engine = engines[i].get();
+        QString drive = targets.at(int(i)).drive;
+        engine->setTarget("/run/archhelp/targets/" + drive, source);
+        InstallEngine::ExitCode *code = &codes[i];
+        threads << QThread::create([engine, drive, code, resume]() {
+            QElapsedTimer timer;
+            timer.start();
+            if (resume) {
+                *code = engine->resume();
+            } else {
+                *code = engine->runStage(InstallEngine::Stage::Disk);
+                if (*code == InstallEngine::Success)
+                    *code = engine->outcome(engine->runStage(InstallEngine::Stage::System));
+            }
+            printEvent({{"event", "target"},
+                        {"target", drive},
+                        {"status", InstallEngine::exitCodeName(*code)},
+                        {"exit_code", *code},
+                        {"seconds", timer.elapsed() / 1000.0}});
+        });
+        threads.last()->start();
+    }
+    for (QThread *thread : std::as_const(threads)) {
+        thread->wait();
+        delete thread;
+    }
+    source->close();
+    InstallEngine::ExitCode worst = InstallEngine::Success;
+    for (InstallEngine::ExitCode code : codes)
+        worst = InstallEngine::worse(worst, code);
+    return worst;
+}
+
+// --headless --config <file>: runs the whole install from the config
+// without a display and exits with an InstallEngine::ExitCode
+static int runHeadless(QCoreApplication &app) {
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Unattended Arch Linux install");
+    parser.addHelpOption();
+    parser.addOption({"headless", "Install without a display."});
+    parser.addOption({"config", "Install configuration (TOML).", "file"});
+    parser.addOption({"resume", "Retry the system install on the disk a failed run left mounted."});
+    // Exits with 1 (UsageError) on unknown options
+    parser.process(app);
+
+    auto finish = [](InstallEngine::ExitCode code) {
+        printEvent({{"event", "result"},
+                    {"status", InstallEngine::exitCodeName(code)},
+                    {"exit_code", code}});
+        Tracer::instance().flush();
+        return int(code);
+    };
+    auto configError = [&finish](const QString &message) {
+        printEvent({{"event", "error"},
+                    {"class", InstallEngine::exitCodeName(InstallEngine::ConfigError)},
+                    {"exit_code", InstallEngine::ConfigError},
+                    {"message", message}});
+        return finish(InstallEngine::ConfigError);
+    };
+
+    if (!parser.isSet("config"))
+        return configError("--headless needs --config <file>");
+    InstallConfig config;
+    QString error;
+    if (!config.load(parser.value("config"), &error))
+        return configError(error);
+    error = config.validate();
+    if (!error.isEmpty())
+        return configError(error);
+
+    signal(SIGINT, cancelHeadless);
+    signal(SIGTERM, cancelHeadless);
+
+    bool resume = parser.isSet("resume");
+    if (!config.drives.isEmpty())
+        return finish(runTargets(config.targets(), resume));
+    InstallEngine engine(config);
+    engine.setCancelToken(headlessCancel);
+    printEvents(engine, config.drive);
+    return finish(resume ? engine.resume() : engine.run());
+}
+
 int main(int argc, char *argv[]) {
+    bool headless = false;
+    for (int i = 1; i < argc; ++i)
+        headless = headless || strcmp(argv[i], "--headless") == 0;
+
+    // CommandRunner feeds child stdin through pipes; a child exiting early
+    // must surface as EPIPE rather than killing the installer
+    signal(SIGPIPE, SIG_IGN);
+
+    // ARCHHELP_TRACE=<file> records a timeline of the install for
+    // chrome://tracing or Perfetto
+    QString tracePath = qEnvironmentVariable("ARCHHELP_TRACE");
+    if (!tracePath.isEmpty())
+        Tracer::instance().enable(tracePath);
+    // ARCHHELP_METRICS_DIR=<dir> writes archhelp.prom/archhelp.json there
+    // after each install, e.g. node_exporter's textfile collector directory
+    QString metricsDir = qEnvironmentVariable("ARCHHELP_METRICS_DIR");
+    if (!metricsDir.isEmpty())
+        MetricsExporter::instance().enable(metricsDir);
+
+    // No pkexec relaunch here: there is no display for the password
+    // prompt, and the engine's preflight reports a missing root instead
+    if (headless) {
+        QCoreApplication app(argc, argv);
+        return runHeadless(app);
+    }
+
     QApplication a(argc, argv);
 
     // Ensure the installer has the necessary privileges to run
@@ -26,6 +218,11 @@ int main(int argc, char *argv[]) {
         QByteArray qpa = qgetenv("QT_QPA_PLATFORMTHEME");
         if (!qpa.isEmpty())
             argBytes << QByteArray("QT_QPA_PLATFORMTHEME=") + qpa;
+        for (const char *name : {"ARCHHELP_TRACE", "ARCHHELP_METRICS_DIR"}) {
+            QByteArray value = qgetenv(name);
+            if (!value.isEmpty())
+                argBytes << QByteArray(name) + '=' + value;
+        }
         argBytes << path.toLocal8Bit();
 
         std::vector<char*> execArgs;
@@ -50,5 +247,8 @@ int main(int argc, char *argv[]) {
 
     Installwizard wizard;
     wizard.show();
-    return a.exec();
+    int rc = a.exec();
+    // Also covers installs that failed or were abandoned half way
+    Tracer::instance().flush();
+    return rc;
 }
@@ -0,0 +1,92 @@
+#include "memoryconfig.h"
+#include <QFile>
+#include <QRegularExpression>
+
+namespace {
+
+const qint64 MiB = 1024 * 1024;
+const qint64 GiB = 1024 * MiB;
+
+} // namespace
+
+MemoryConfig::MemoryConfig(const QString &mode, qint64 ramBytes, qint64 swapfileMiB) : ram(ramBytes)
+{
+    const bool small = ram > 0 && ram < 8 * GiB;
+    useZram = mode == "zram" || mode == "both" || mode == "auto";
+    const bool swapfile = mode == "swapfile" || mode == "both" || (mode == "auto" && small);
+    lines << QString("RAM: %1 MiB, mode %2").arg(ram / MiB).arg(mode);
+
+    if (useZram)
+        lines << "zram: min(ram, 8 GiB) of zstd compressed swap at priority 100 (RAM is faster than any disk; "
+                 "zstd compresses pages about 3:1)";
+    if (swapfile) {
+        // As large as RAM up to 8 GiB; more only prolongs thrashing
+        swapMiB = swapfileMiB > 0 ? swapfileMiB : qBound<qint64>(1024, ram / MiB, 8192);
+        lines << QString("swap file: %1 MiB at the default, lower priority (%2)")
+                     .arg(swapMiB)
+                     .arg(swapfileMiB > 0 ? QString("size from the config")
+                                          : useZram ? QString("catches what zram cannot hold")
+                                                    : QString("only swap of the system"));
+    }
+    if (!useZram && !swapfile)
+        lines << "swap: none";
+
+    if (useZram) {
+        // The values the kernel's zram documentation and the Arch wiki give
+        set("vm.swappiness", "180", "swapping to zram is cheaper than dropping file pages that must be reread");
+        set("vm.watermark_boost_factor", "0", "no extra reclaim bursts after fragmentation events");
+        set("vm.watermark_scale_factor", "125", "reclaim starts earlier, before allocations stall");
+        set("vm.page-cluster", "0", "zram has no seek to amortize; swap in single pages");
+    } else if (swapfile) {
+        set("vm.swappiness", "30", "swap to disk only once the page cache has been trimmed");
+    }
+    if (small && (useZram || swapfile))
+        set("vm.vfs_cache_pressure", "50", "keep directory and inode caches; rebuilding them costs disk reads");
+}
+
+QStringList MemoryConfig::modes()
+{
+    return {"auto", "zram", "swapfile", "both", "none"};
+}
+
+qint64 MemoryConfig::totalRam()
+{
+    QFile f("/proc/meminfo");
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text))
+        return 0;
+    static const QRegularExpression memTotal("^MemTotal:\\s+(\\d+) kB", QRegularExpression::MultilineOption);
+    QRegularExpressionMatch m = memTotal.match(QString::fromLatin1(f.readAll()));
+    return m.hasMatch() ? m.captured(1).toLongLong() * 1024 : 0;
+}
+
+void MemoryConfig::set(const QString &key, const QString &value, const QString &reason)
+{
+    sysctls.append({key, value});
+    lines << QString("%1 = %2 (%3)").arg(key, value, reason);
+}
+
+QByteArray MemoryConfig::zramGeneratorConfig() const
+{
+    // Evaluated by zram-generator at boot, on the machine's own RAM
+    return "[zram0]\n"
+           "zram-size = min(ram, 8192)\n"
+           "compression-algorithm = zstd\n"
+           "swap-priority = 100\n"
+           "fs-type = swap\n";
+}
+
+QByteArray MemoryConfig::sysctlConfig() const
+{
+    if (sysctls.isEmpty())
+        return QByteArray();
+    QStringList out{"# Written by the installer; the reasons are in /var/log/archhelp/memory.txt"};
+    for (const auto &kv : sysctls)
+        out << kv.first + " = " + kv.second;
+    out << QString();
+    return out.join('\n').toUtf8();
+}
+
+QStringList MemoryConfig::report() const
+{
+    return lines;
+}
@@ -0,0 +1,50 @@
+#ifndef MEMORYCONFIG_H
+#define MEMORYCONFIG_H
+
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+
+// Swap and VM settings of the installed system, sized from its RAM. zram
+// is a compressed swap device in RAM, set up at boot by zram-generator;
+// with zstd it holds about three pages in the space of one, so a 4 GiB
+// machine behaves like one with several more. A swap file on the root
+// filesystem catches what zram cannot hold. The sysctls follow from which
+// of the two there is.
+//
+// Modes: "auto" (zram, plus a swap file below 8 GiB of RAM), "zram",
+// "swapfile", "both" and "none".
+class MemoryConfig {
+public:
+    // swapfileMiB overrides the size derived from ramBytes; 0 derives it
+    MemoryConfig(const QString &mode, qint64 ramBytes, qint64 swapfileMiB = 0);
+
+    static QStringList modes();
+    // MemTotal of the running system, which is the machine being installed
+    // unless several drives are imaged at once
+    static qint64 totalRam();
+
+    bool zram() const { return useZram; }
+    qint64 swapfileMiB() const { return swapMiB; }
+
+    static QString zramGeneratorPath() { return "/etc/systemd/zram-generator.conf"; }
+    static QString sysctlPath() { return "/etc/sysctl.d/99-archhelp-memory.conf"; }
+    QByteArray zramGeneratorConfig() const;
+    // Empty when the kernel defaults stay
+    QByteArray sysctlConfig() const;
+    // One line per decision with its reason
+    QStringList report() const;
+
+private:
+    void set(const QString &key, const QString &value, const QString &reason);
+
+    qint64 ram = 0;
+    bool useZram = false;
+    qint64 swapMiB = 0;
+    QList<QPair<QString, QString>> sysctls;
+    QStringList lines;
+};
+
+#endif // MEMORYCONFIG_H
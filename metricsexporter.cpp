@@ -0,0 +1,282 @@
+#include "metricsexporter.h"
+#include <QDateTime>
+#include <QDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStringList>
+#include <map>
+#include <memory>
+
+MetricsExporter &MetricsExporter::instance()
+{
+    static MetricsExporter exporter;
+    return exporter;
+}
+
+MetricsExporter &MetricsExporter::instance(const QString &target)
+{
+    if (target.isEmpty())
+        return instance();
+    static QMutex registryMutex;
+    static std::map<QString, std::unique_ptr<MetricsExporter>> targets;
+    QMutexLocker lock(&registryMutex);
+    std::unique_ptr<MetricsExporter> &exporter = targets[target];
+    if (!exporter) {
+        exporter.reset(new MetricsExporter);
+        exporter->target = target;
+        exporter->info["target"] = target;
+    }
+    return *exporter;
+}
+
+void MetricsExporter::enable(const QString &dir)
+{
+    QMutexLocker lock(&mutex);
+    directory = dir;
+}
+
+bool MetricsExporter::isEnabled() const
+{
+    if (!target.isEmpty())
+        return instance().isEnabled();
+    QMutexLocker lock(&mutex);
+    return !directory.isEmpty();
+}
+
+void MetricsExporter::setInfo(const QString &key, const QString &value)
+{
+    QMutexLocker lock(&mutex);
+    info[key] = value;
+}
+
+void MetricsExporter::setPhaseDuration(const QString &phase, double seconds)
+{
+    QMutexLocker lock(&mutex);
+    for (auto &p : phases) {
+        if (p.first == phase) {
+            p.second = seconds;
+            return;
+        }
+    }
+    phases << qMakePair(phase, seconds);
+}
+
+void MetricsExporter::addDownloadBytes(const QString &source, qint64 bytes)
+{
+    if (bytes <= 0)
+        return;
+    QMutexLocker lock(&mutex);
+    downloadBytes[source] += bytes;
+}
+
+void MetricsExporter::countCache(const QString &name, bool hit, int count)
+{
+    if (count <= 0)
+        return;
+    QMutexLocker lock(&mutex);
+    QPair<int, int> &c = cache[name];
+    (hit ? c.first : c.second) += count;
+}
+
+void MetricsExporter::setExtraction(qint64 bytes, double seconds)
+{
+    QMutexLocker lock(&mutex);
+    extractBytes = bytes;
+    extractSeconds = seconds;
+}
+
+void MetricsExporter::setInitramfs(const QMap<QString, qint64> &imageBytes, double buildSeconds)
+{
+    QMutexLocker lock(&mutex);
+    initramfsBytes = imageBytes;
+    initramfsSeconds = buildSeconds;
+}
+
+void MetricsExporter::setPackageCount(const QString &phase, int count)
+{
+    QMutexLocker lock(&mutex);
+    packages[phase] = count;
+}
+
+void MetricsExporter::addRetry(const QString &operation)
+{
+    QMutexLocker lock(&mutex);
+    ++retries[operation];
+}
+
+void MetricsExporter::setOutcome(bool ok, const QString &phase)
+{
+    QMutexLocker lock(&mutex);
+    finished = true;
+    success = ok;
+    failedPhase = ok ? QString() : phase;
+    finishedAt = QDateTime::currentSecsSinceEpoch();
+}
+
+static QString labelValue(QString v)
+{
+    return v.replace('\\', "\\\\").replace('"', "\\\"").replace('\n', "\\n");
+}
+
+static void family(QStringList &out, const QString &name, const QString &type, const QString &help)
+{
+    out << QString("# HELP %1 %2").arg(name, help) << QString("# TYPE %1 %2").arg(name, type);
+}
+
+QByteArray MetricsExporter::prometheusText() const
+{
+    QMutexLocker lock(&mutex);
+    QStringList out;
+
+    // Every sample of a per-drive instance carries its target label, or the
+    // files of several drives would repeat the same series and the textfile
+    // collector would reject them
+    auto sample = [this, &out](const QString &name, const QString &labels, const QString &value) {
+        QStringList all;
+        if (!target.isEmpty())
+            all << QString("target=\"%1\"").arg(labelValue(target));
+        if (!labels.isEmpty())
+            all << labels;
+        out << (all.isEmpty() ? name : QString("%1{%2}").arg(name, all.join(','))) + ' ' + value;
+    };
+    auto label = [](const QString &key, const QString &value) {
+        return QString("%1=\"%2\"").arg(key, labelValue(value));
+    };
+
+    QStringList infoLabels;
+    for (auto it = info.constBegin(); it != info.constEnd(); ++it)
+        infoLabels << label(it.key(), it.value());
+    if (!failedPhase.isEmpty())
+        infoLabels << label("failed_phase", failedPhase);
+    family(out, "archhelp_install_info", "gauge", "Parameters of the last install.");
+    // info already holds the target, see instance(target)
+    out << QString("archhelp_install_info{%1} 1").arg(infoLabels.join(','));
+
+    family(out, "archhelp_install_success", "gauge", "1 if the last install completed, 0 if it failed.");
+    sample("archhelp_install_success", QString(), QString::number(finished && success ? 1 : 0));
+    family(out, "archhelp_install_finished_timestamp_seconds", "gauge", "When the last install ended.");
+    sample("archhelp_install_finished_timestamp_seconds", QString(), QString::number(finishedAt));
+
+    family(out, "archhelp_phase_duration_seconds", "gauge", "Wall time of each install phase.");
+    for (const auto &p : phases)
+        sample("archhelp_phase_duration_seconds", label("phase", p.first), QString::number(p.second, 'f', 3));
+
+    family(out, "archhelp_download_bytes_total", "counter", "Bytes downloaded per source host.");
+    for (auto it = downloadBytes.constBegin(); it != downloadBytes.constEnd(); ++it)
+        sample("archhelp_download_bytes_total", label("source", it.key()), QString::number(it.value()));
+
+    family(out, "archhelp_cache_requests_total", "counter", "Cache lookups by cache and result.");
+    for (auto it = cache.constBegin(); it != cache.constEnd(); ++it) {
+        sample("archhelp_cache_requests_total", label("cache", it.key()) + ",result=\"hit\"",
+               QString::number(it.value().first));
+        sample("archhelp_cache_requests_total", label("cache", it.key()) + ",result=\"miss\"",
+               QString::number(it.value().second));
+    }
+
+    family(out, "archhelp_extract_bytes", "gauge", "Size of the extracted root filesystem image.");
+    sample("archhelp_extract_bytes", QString(), QString::number(extractBytes));
+    family(out, "archhelp_extract_bytes_per_second", "gauge", "Root filesystem extraction throughput.");
+    sample("archhelp_extract_bytes_per_second", QString(),
+           QString::number(extractSeconds > 0 ? extractBytes / extractSeconds : 0.0, 'f', 0));
+
+    family(out, "archhelp_initramfs_bytes", "gauge", "Size of each initramfs or kernel image built.");
+    for (auto it = initramfsBytes.constBegin(); it != initramfsBytes.constEnd(); ++it)
+        sample("archhelp_initramfs_bytes", label("image", it.key()), QString::number(it.value()));
+    family(out, "archhelp_initramfs_build_seconds", "gauge", "Wall time of the mkinitcpio run.");
+    sample("archhelp_initramfs_build_seconds", QString(), QString::number(initramfsSeconds, 'f', 3));
+
+    family(out, "archhelp_packages_installed", "gauge", "Packages installed or upgraded per phase.");
+    for (auto it = packages.constBegin(); it != packages.constEnd(); ++it)
+        sample("archhelp_packages_installed", label("phase", it.key()), QString::number(it.value()));
+
+    family(out, "archhelp_retries_total", "counter", "Retried operations.");
+    for (auto it = retries.constBegin(); it != retries.constEnd(); ++it)
+        sample("archhelp_retries_total", label("operation", it.key()), QString::number(it.value()));
+
+    out << QString();
+    return out.join('\n').toUtf8();
+}
+
+QByteArray MetricsExporter::json() const
+{
+    QMutexLocker lock(&mutex);
+    QJsonObject root;
+    QJsonObject infoObj;
+    for (auto it = info.constBegin(); it != info.constEnd(); ++it)
+        infoObj[it.key()] = it.value();
+    root["info"] = infoObj;
+    root["success"] = finished && success;
+    if (!failedPhase.isEmpty())
+        root["failedPhase"] = failedPhase;
+    root["finishedAt"] = finishedAt;
+
+    QJsonArray phaseArr;
+    for (const auto &p : phases)
+        phaseArr.append(QJsonObject{{"phase", p.first}, {"seconds", p.second}});
+    root["phases"] = phaseArr;
+
+    QJsonObject dl;
+    for (auto it = downloadBytes.constBegin(); it != downloadBytes.constEnd(); ++it)
+        dl[it.key()] = it.value();
+    root["downloadBytes"] = dl;
+
+    QJsonObject cacheObj;
+    for (auto it = cache.constBegin(); it != cache.constEnd(); ++it) {
+        int total = it.value().first + it.value().second;
+        cacheObj[it.key()] = QJsonObject{{"hits", it.value().first},
+                                         {"misses", it.value().second},
+                                         {"hitRate", total ? double(it.value().first) / total : 0.0}};
+    }
+    root["cache"] = cacheObj;
+
+    root["extract"] = QJsonObject{{"bytes", extractBytes},
+                                  {"seconds", extractSeconds},
+                                  {"bytesPerSecond", extractSeconds > 0 ? extractBytes / extractSeconds : 0.0}};
+
+    QJsonObject images;
+    for (auto it = initramfsBytes.constBegin(); it != initramfsBytes.constEnd(); ++it)
+        images[it.key()] = it.value();
+    root["initramfs"] = QJsonObject{{"images", images}, {"buildSeconds", initramfsSeconds}};
+
+    QJsonObject pkg;
+    for (auto it = packages.constBegin(); it != packages.constEnd(); ++it)
+        pkg[it.key()] = it.value();
+    root["packages"] = pkg;
+
+    QJsonObject retryObj;
+    for (auto it = retries.constBegin(); it != retries.constEnd(); ++it)
+        retryObj[it.key()] = it.value();
+    root["retries"] = retryObj;
+
+    return QJsonDocument(root).toJson();
+}
+
+bool MetricsExporter::write() const
+{
+    QString dir;
+    if (!target.isEmpty()) {
+        QMutexLocker lock(&instance().mutex);
+        dir = instance().directory;
+    } else {
+        QMutexLocker lock(&mutex);
+        dir = directory;
+    }
+    if (dir.isEmpty())
+        return true;
+    QDir().mkpath(dir);
+
+    // QSaveFile writes a temporary name and renames it into place, so the
+    // collector never reads a partial file
+    QString base = dir + (target.isEmpty() ? QString("/archhelp") : "/archhelp-" + target);
+    const QPair<QString, QByteArray> files[] = {{base + ".prom", prometheusText()},
+                                                {base + ".json", json()}};
+    bool ok = true;
+    for (const auto &f : files) {
+        QSaveFile out(f.first);
+        ok = out.open(QIODevice::WriteOnly) && out.write(f.second) == f.second.size() && out.commit() && ok;
+    }
+    return ok;
+}
@@ -0,0 +1,66 @@
+#ifndef METRICSEXPORTER_H
+#define METRICSEXPORTER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QPair>
+#include <QString>
+
+// Per-install numbers for monitoring a fleet of installs. Enabled with
+// ARCHHELP_METRICS_DIR=<dir> (see main.cpp); write() then drops
+// archhelp.prom for node_exporter's textfile collector and archhelp.json
+// with the same data into that directory. Both are replaced atomically, as
+// the collector requires. Recording is a no-op while disabled.
+//
+// Installs to several drives at once each record into their own instance,
+// instance("sdb") and so on, written as archhelp-sdb.prom/.json with a
+// target label on every sample; they share the directory of the default
+// instance.
+class MetricsExporter {
+public:
+    static MetricsExporter &instance();
+    static MetricsExporter &instance(const QString &target);
+
+    void enable(const QString &directory);
+    bool isEnabled() const;
+
+    void setInfo(const QString &key, const QString &value);
+    void setPhaseDuration(const QString &phase, double seconds);
+    void addDownloadBytes(const QString &source, qint64 bytes);
+    void countCache(const QString &cache, bool hit, int count = 1);
+    void setExtraction(qint64 bytes, double seconds);
+    // Size of each image mkinitcpio wrote and how long it took
+    void setInitramfs(const QMap<QString, qint64> &imageBytes, double buildSeconds);
+    void setPackageCount(const QString &phase, int packages);
+    void addRetry(const QString &operation);
+    void setOutcome(bool success, const QString &failedPhase = QString());
+
+    QByteArray prometheusText() const;
+    QByteArray json() const;
+    bool write() const;
+
+private:
+    MetricsExporter() = default;
+
+    mutable QMutex mutex;
+    QString directory;
+    QString target;
+    QMap<QString, QString> info;
+    QList<QPair<QString, double>> phases;  // in the order they ran
+    QMap<QString, qint64> downloadBytes;
+    QMap<QString, QPair<int, int>> cache;  // hits, misses
+    qint64 extractBytes = 0;
+    double extractSeconds = 0.0;
+    QMap<QString, qint64> initramfsBytes;
+    double initramfsSeconds = 0.0;
+    QMap<QString, int> packages;
+    QMap<QString, int> retries;
+    bool finished = false;
+    bool success = false;
+    QString failedPhase;
+    qint64 finishedAt = 0;
+};
+
+#endif // METRICSEXPORTER_H
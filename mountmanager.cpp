@@ -0,0 +1,349 @@
+#include "mountmanager.h"
+#include "blockdevice.h"
+#include "filesystemstrategy.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QThread>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mount.h>
+#include <sys/swap.h>
+#include <thread>
+#include <unistd.h>
+
+// mountinfo escapes space, tab, newline and backslash as \ooo octal
+static QString unescapeMountField(const QString &field)
+{
+    QString out;
+    out.reserve(field.size());
+    for (int i = 0; i < field.size(); ++i) {
+        if (field.at(i) == '\\' && i + 3 < field.size()) {
+            bool ok = false;
+            int code = field.mid(i + 1, 3).toInt(&ok, 8);
+            if (ok) {
+                out += QChar(code);
+                i += 3;
+                continue;
+            }
+        }
+        out += field.at(i);
+    }
+    return out;
+}
+
+static QString canonicalDevice(const QString &path)
+{
+    QString c = QFileInfo(path).canonicalFilePath();
+    return c.isEmpty() ? path : c;
+}
+
+static bool isWholeDisk(const QString &device)
+{
+    return !device.isEmpty()
+           && QFileInfo::exists("/sys/block/" + QFileInfo(canonicalDevice(device)).fileName());
+}
+
+QList<MountEntry> MountManager::readMountTable()
+{
+    QList<MountEntry> entries;
+    QFile f("/proc/self/mountinfo");
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text))
+        return entries;
+
+    const QList<QByteArray> lines = f.readAll().split('\n');
+    for (const QByteArray &raw : lines) {
+        QStringList cols = QString::fromLocal8Bit(raw).split(' ', Qt::SkipEmptyParts);
+        int sep = cols.indexOf("-");
+        if (cols.size() < 7 || sep < 6 || sep + 2 >= cols.size())
+            continue;
+        MountEntry e;
+        e.id = cols.at(0).toInt();
+        e.parentId = cols.at(1).toInt();
+        e.mountPoint = unescapeMountField(cols.at(4));
+        e.options = cols.at(5);
+        e.fsType = cols.at(sep + 1);
+        e.source = unescapeMountField(cols.at(sep + 2));
+        entries << e;
+    }
+    return entries;
+}
+
+bool MountManager::isUnder(const QString &path, const QString &prefix)
+{
+    if (prefix.isEmpty())
+        return false;
+    if (prefix == "/")
+        return true;
+    return path == prefix || path.startsWith(prefix + '/');
+}
+
+QString MountManager::loopBackingFile(const QString &source)
+{
+    if (!source.startsWith("/dev/loop"))
+        return QString();
+    QFile f("/sys/block/" + QFileInfo(source).fileName() + "/loop/backing_file");
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text))
+        return QString();
+    return QString::fromLocal8Bit(f.readAll()).trimmed();
+}
+
+// True when source is the device itself or, for a whole disk, one of its
+// partitions.
+bool MountManager::sourceOnDevice(const QString &source, const QString &device)
+{
+    if (device.isEmpty() || !source.startsWith("/dev/"))
+        return false;
+    QString src = canonicalDevice(source);
+    QString dev = canonicalDevice(device);
+    if (src == dev)
+        return true;
+    BlockDeviceInfo srcInfo = BlockDeviceInfo::probe(src);
+    return srcInfo.valid && srcInfo.name == QFileInfo(dev).fileName();
+}
+
+QList<MountEntry> MountManager::mountsFor(const QString &prefix, const QString &device)
+{
+    QList<MountEntry> matches;
+    for (const MountEntry &e : readMountTable()) {
+        QString backing = loopBackingFile(e.source);
+        if (isUnder(e.mountPoint, prefix) || sourceOnDevice(e.source, device) ||
+            (!backing.isEmpty() && isUnder(backing, prefix)))
+            matches << e;
+    }
+
+    // Deepest first; among equal depths the most recent mount sits on top
+    std::sort(matches.begin(), matches.end(), [](const MountEntry &a, const MountEntry &b) {
+        int da = a.mountPoint.count('/');
+        int db = b.mountPoint.count('/');
+        if (da != db)
+            return da > db;
+        return a.id > b.id;
+    });
+    return matches;
+}
+
+int MountManager::swapOffDevice(const QString &device, const QString &prefix, const LogFn &log)
+{
+    QFile f("/proc/swaps");
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text))
+        return 0;
+
+    int count = 0;
+    const QStringList lines = QString::fromLocal8Bit(f.readAll()).split('\n', Qt::SkipEmptyParts);
+    for (const QString &line : lines.mid(1)) { // skip header
+        QString path = unescapeMountField(line.section(' ', 0, 0, QString::SectionSkipEmpty));
+        if (!sourceOnDevice(path, device) && !isUnder(path, prefix))
+            continue;
+        if (::swapoff(path.toLocal8Bit().constData()) == 0) {
+            log("Disabled swap on " + path);
+            ++count;
+        } else {
+            log(QString("swapoff %1 failed: %2").arg(path, QString::fromLocal8Bit(std::strerror(errno))));
+        }
+    }
+    return count;
+}
+
+QList<MountEntry> MountManager::mountsOutside(const QString &prefix, const QString &device)
+{
+    QList<MountEntry> matches;
+    for (const MountEntry &e : readMountTable())
+        if (sourceOnDevice(e.source, device) && !isUnder(e.mountPoint, prefix))
+            matches << e;
+    return matches;
+}
+
+int MountManager::unmountAll(const QString &prefix, const QString &device, const LogFn &log,
+                             QString *error)
+{
+    // Partitions of a whole disk mounted elsewhere belong to the host
+    // (/home, /boot/efi, ...) and are never detached behind its back
+    if (isWholeDisk(device)) {
+        QStringList busy;
+        for (const MountEntry &e : mountsOutside(prefix, device))
+            busy << QString("%1 on %2").arg(e.source, e.mountPoint);
+        if (!busy.isEmpty()) {
+            QString message = QString("%1 is in use (%2); unmount it first").arg(device, busy.join(", "));
+            if (error)
+                *error = message;
+            log(message);
+            return -1;
+        }
+    }
+    swapOffDevice(device, prefix, log);
+
+    int count = 0;
+    for (const MountEntry &e : mountsFor(prefix, device)) {
+        // Never lazily detach the running system's root
+        if (e.mountPoint == "/")
+            continue;
+        QByteArray target = e.mountPoint.toLocal8Bit();
+        if (::umount2(target.constData(), 0) != 0 &&
+            ::umount2(target.constData(), MNT_DETACH) != 0) {
+            // Already gone because a parent was lazily detached
+            if (errno != EINVAL && errno != ENOENT)
+                log(QString("Failed to unmount %1: %2")
+                        .arg(e.mountPoint, QString::fromLocal8Bit(std::strerror(errno))));
+            continue;
+        }
+        log("Unmounted " + e.mountPoint);
+        ++count;
+    }
+    return count;
+}
+
+bool MountManager::remount(const QString &target, unsigned long flags, const QString &data,
+                           const LogFn &log)
+{
+    QByteArray t = target.toLocal8Bit();
+    QByteArray d = data.toLocal8Bit();
+    if (::mount(nullptr, t.constData(), nullptr, MS_REMOUNT | flags,
+                d.isEmpty() ? nullptr : d.constData()) != 0) {
+        log(QString("Remount of %1 (%2) failed: %3")
+                .arg(target, data, QString::fromLocal8Bit(std::strerror(errno))));
+        return false;
+    }
+    return true;
+}
+
+static qint64 dirtyKiB()
+{
+    QFile f("/proc/meminfo");
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text))
+        return -1;
+    qint64 total = 0;
+    for (const QByteArray &line : f.readAll().split('\n')) {
+        if (line.startsWith("Dirty:") || line.startsWith("Writeback:"))
+            total += line.simplified().split(' ').value(1).toLongLong();
+    }
+    return total;
+}
+
+// syncfs() gives no feedback, so run it on a helper thread and report the
+// kernel's dirty/writeback counters until it returns.
+bool MountManager::syncFilesystem(const QString &path, const LogFn &log)
+{
+    int fd = ::open(path.toLocal8Bit().constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        log("Cannot open " + path + " for syncing");
+        return false;
+    }
+
+    std::atomic<bool> done{false};
+    int rc = 0;
+    QElapsedTimer timer;
+    timer.start();
+    std::thread syncer([&]() {
+        rc = ::syncfs(fd);
+        done = true;
+    });
+    while (!done) {
+        QThread::msleep(500);
+        if (!done)
+            log(QString("Flushing %1: %2 MiB left to write").arg(path).arg(dirtyKiB() / 1024));
+    }
+    syncer.join();
+    ::close(fd);
+    log(QString("Flushed %1 in %2 s").arg(path).arg(timer.elapsed() / 1000.0, 0, 'f', 1));
+    return rc == 0;
+}
+
+InstallMountProfile::InstallMountProfile(const QString &r, const MountManager::LogFn &l)
+    : root(r), log(l)
+{
+    for (const MountEntry &e : MountManager::mountsFor(root)) {
+        std::unique_ptr<FilesystemStrategy> fs = FilesystemStrategy::create(e.fsType);
+        if (!fs || fs->installRemountData().isEmpty())
+            continue;
+        if (MountManager::remount(e.mountPoint, MS_NOATIME | MS_LAZYTIME,
+                                  fs->installRemountData(), log)) {
+            log(QString("Mounted %1 with install profile (noatime, %2)")
+                    .arg(e.mountPoint, fs->installRemountData()));
+            tuned << e;
+        }
+    }
+}
+
+InstallMountProfile::~InstallMountProfile()
+{
+    if (!finished)
+        finish();
+}
+
+bool InstallMountProfile::finish()
+{
+    finished = true;
+    if (tuned.isEmpty())
+        return true;
+
+    bool ok = MountManager::syncFilesystem(root, log);
+    for (const MountEntry &e : std::as_const(tuned)) {
+        if (e.mountPoint != root)
+            ok = MountManager::syncFilesystem(e.mountPoint, log) && ok;
+        std::unique_ptr<FilesystemStrategy> fs = FilesystemStrategy::create(e.fsType);
+        // Keep the atime policy the filesystem was originally mounted with
+        unsigned long atime = e.options.split(',').contains("noatime") ? MS_NOATIME : MS_RELATIME;
+        ok = MountManager::remount(e.mountPoint, atime, fs->productionRemountData(), log) && ok;
+    }
+    if (ok)
+        log("Restored production mount options");
+    return ok;
+}
+
+ChrootSession::ChrootSession(const QString &r, const MountManager::LogFn &l) : root(r), log(l)
+{
+    valid = mountOne("proc", "/proc", "proc", MS_NOSUID | MS_NOEXEC | MS_NODEV, QString()) &&
+            mountOne("sys", "/sys", "sysfs", MS_NOSUID | MS_NOEXEC | MS_NODEV | MS_RDONLY, QString()) &&
+            mountOne("udev", "/dev", "devtmpfs", MS_NOSUID, "mode=0755") &&
+            mountOne("devpts", "/dev/pts", "devpts", MS_NOSUID | MS_NOEXEC, "mode=0620,gid=5") &&
+            mountOne("shm", "/dev/shm", "tmpfs", MS_NOSUID | MS_NODEV, "mode=1777") &&
+            mountOne("/run", "/run", QString(), MS_BIND, QString()) &&
+            mountOne("tmp", "/tmp", "tmpfs", MS_STRICTATIME | MS_NODEV | MS_NOSUID, "mode=1777");
+    // grub-install and bootctl need the EFI variables on UEFI systems
+    if (valid && QFileInfo::exists("/sys/firmware/efi/efivars"))
+        mountOne("efivarfs", "/sys/firmware/efi/efivars", "efivarfs",
+                 MS_NOSUID | MS_NOEXEC | MS_NODEV, QString());
+    if (!valid)
+        release();
+}
+
+ChrootSession::~ChrootSession()
+{
+    release();
+}
+
+bool ChrootSession::mountOne(const QString &source, const QString &target, const QString &fsType,
+                             unsigned long flags, const QString &data)
+{
+    QString path = root + target;
+    QDir().mkpath(path);
+    QByteArray src = source.toLocal8Bit();
+    QByteArray dst = path.toLocal8Bit();
+    QByteArray type = fsType.toLocal8Bit();
+    QByteArray opts = data.toLocal8Bit();
+    if (::mount(src.constData(), dst.constData(), type.isEmpty() ? nullptr : type.constData(),
+                flags, opts.isEmpty() ? nullptr : opts.constData()) != 0) {
+        log(QString("Failed to mount %1 on %2: %3")
+                .arg(fsType.isEmpty() ? source : fsType, path,
+                     QString::fromLocal8Bit(std::strerror(errno))));
+        return false;
+    }
+    mounted.prepend(path);
+    return true;
+}
+
+void ChrootSession::release()
+{
+    for (const QString &path : std::as_const(mounted)) {
+        QByteArray target = path.toLocal8Bit();
+        if (::umount2(target.constData(), 0) != 0)
+            ::umount2(target.constData(), MNT_DETACH);
+    }
+    mounted.clear();
+}
@@ -0,0 +1,91 @@
+#ifndef MOUNTMANAGER_H
+#define MOUNTMANAGER_H
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <functional>
+
+// One line of /proc/self/mountinfo.
+struct MountEntry {
+    int id = 0;
+    int parentId = 0;
+    QString mountPoint;
+    QString fsType;
+    QString source;
+    QString options;
+};
+
+// Finds and tears down mounts with direct syscalls instead of umount/lsblk
+// subprocesses. A mount is considered to belong to the target when it lives
+// at or below the given prefix, when its source is the target device (or a
+// partition of it), or when it is a loop device whose backing file is.
+//
+// unmountAll() detaches what lives below prefix and what is mounted from
+// device. For a whole disk it first refuses, returning -1 with *error set,
+// when any of the disk's partitions is mounted outside prefix.
+class MountManager {
+public:
+    using LogFn = std::function<void(const QString &)>;
+
+    static QList<MountEntry> readMountTable();
+    static QList<MountEntry> mountsFor(const QString &prefix, const QString &device = QString());
+    // Mounts of device or its partitions that are not below prefix
+    static QList<MountEntry> mountsOutside(const QString &prefix, const QString &device);
+    static int unmountAll(const QString &prefix, const QString &device, const LogFn &log,
+                          QString *error = nullptr);
+    static int swapOffDevice(const QString &device, const QString &prefix, const LogFn &log);
+    static bool remount(const QString &target, unsigned long flags, const QString &data,
+                        const LogFn &log);
+    static bool syncFilesystem(const QString &path, const LogFn &log);
+
+private:
+    static bool isUnder(const QString &path, const QString &prefix);
+    static bool sourceOnDevice(const QString &source, const QString &device);
+    static QString loopBackingFile(const QString &source);
+};
+
+// Remounts the target's filesystems for write throughput (noatime, long
+// journal commit interval, no barriers, as chosen by each filesystem's
+// FilesystemStrategy) while files are extracted and packages installed.
+// finish() flushes everything with a single syncfs and restores the
+// production options. The destructor does the same if the install bails
+// out early, so a half-installed system is never left on barrier-less
+// mounts.
+class InstallMountProfile {
+public:
+    InstallMountProfile(const QString &root, const MountManager::LogFn &log);
+    ~InstallMountProfile();
+
+    bool finish();
+
+private:
+    QString root;
+    MountManager::LogFn log;
+    QList<MountEntry> tuned;
+    bool finished = false;
+};
+
+// The API filesystems a chroot needs (what arch-chroot would set up), mounted
+// with direct mount(2) calls so commands can be run inside the target with
+// a plain chroot() before exec. Everything is unmounted in reverse order by
+// release() or the destructor.
+class ChrootSession {
+public:
+    ChrootSession(const QString &root, const MountManager::LogFn &log);
+    ~ChrootSession();
+
+    bool isValid() const { return valid; }
+    void release();
+
+private:
+    bool mountOne(const QString &source, const QString &target, const QString &fsType,
+                  unsigned long flags, const QString &data);
+
+    QString root;
+    MountManager::LogFn log;
+    QStringList mounted;
+    bool valid = true;
+};
+
+#endif // MOUNTMANAGER_H
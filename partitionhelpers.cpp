@@ -0,0 +1,307 @@
+#include "partitionhelpers.h"
+#include "commandrunner.h"
+#include "formatter.h"
+#include "mountmanager.h"
+#include "resizeplanner.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QSet>
+#include <QStandardPaths>
+#include <QThread>
+#include <QtGlobal>
+#include <utility>
+
+QString locatePartedBinary()
+{
+    QString p = QStandardPaths::findExecutable("parted");
+    if (!p.isEmpty())
+        return p;
+    const QStringList fallbacks{"/usr/sbin/parted", "/sbin/parted"};
+    for (const QString &path : fallbacks)
+        if (QFileInfo::exists(path))
+            return path;
+    return QString();
+}
+
+QStringList availableDrives()
+{
+    // Use lsblk from PATH for better portability
+    QString output = CommandRunner::capture({"lsblk", "-o", "NAME,SIZE,TYPE", "-d", "-n"});
+
+    QStringList drives;
+    for (const QString &line : output.split('\n', Qt::SkipEmptyParts)) {
+        QStringList tokens = line.split(QRegularExpression("\\s+"), Qt::SkipEmptyParts);
+        // Only disks, and not loop devices
+        if (tokens.size() >= 3 && tokens[2] == "disk" && !tokens[0].startsWith("loop"))
+            drives << tokens[0];
+    }
+    return drives;
+}
+
+QString partitionPath(const QString &drive, int number)
+{
+    QString suffix = (drive.startsWith("nvme") || drive.startsWith("mmc")) ? "p" : "";
+    return QString("/dev/%1%2%3").arg(drive, suffix).arg(number);
+}
+
+QString parentDrive(const QString &partition)
+{
+    return CommandRunner::capture({"lsblk", "-nr", "-o", "PKNAME", partition}).trimmed();
+}
+
+int partitionNumber(const QString &partition)
+{
+    QFile f("/sys/class/block/" + QFileInfo(partition).fileName() + "/partition");
+    if (!f.open(QIODevice::ReadOnly))
+        return 0;
+    return f.readAll().trimmed().toInt();
+}
+
+QString getPartitionTableType(const QString &drive)
+{
+    QString device = QString("/dev/%1").arg(drive);
+    return CommandRunner::capture({"lsblk", "-no", "PTTYPE", device}).trimmed();
+}
+
+bool hasBiosBootPartition(const QString &drive, const QString &excludePart)
+{
+    QString device = QString("/dev/%1").arg(drive);
+    QString out = CommandRunner::capture({"lsblk", "-o", "NAME,PARTFLAGS,PARTTYPE", "-nr", device});
+    for (const QString &line : out.split('\n', Qt::SkipEmptyParts)) {
+        QStringList cols = line.split(QRegularExpression("\\s+"), Qt::SkipEmptyParts);
+        if (cols.size() < 3)
+            continue;
+        QString name = cols.at(0);
+        if (!excludePart.isEmpty() && name == excludePart)
+            continue;
+        QString flags = cols.at(1);
+        QString type = cols.at(2);
+        if (flags.contains("bios_grub") ||
+            type.contains("21686148-6449-6E6F-744E-656564454649", Qt::CaseInsensitive))
+            return true;
+    }
+    return false;
+}
+
+bool mbrPrimaryPartitionLimitReached(const QString &drive)
+{
+    QString device = QString("/dev/%1").arg(drive);
+    QString out = CommandRunner::capture({"lsblk", "-o", "TYPE", "-nr", device});
+    int count = 0;
+    for (const QString &line : out.split('\n', Qt::SkipEmptyParts)) {
+        if (line.trimmed() == "part")
+            count++;
+    }
+    return count >= 4;
+}
+
+bool waitForPartition(const QString &partPath, int timeoutSeconds)
+{
+    QFileInfo fi(partPath);
+    int elapsed = 0;
+    while (!fi.exists() && elapsed < timeoutSeconds) {
+        QThread::sleep(1);
+        fi.refresh();
+        elapsed++;
+    }
+    return fi.exists();
+}
+
+bool createEfiLayout(const QString &drive, const PartitionLogFn &log, QString *error)
+{
+    QString device = QString("/dev/%1").arg(drive);
+    if (MountManager::unmountAll(QString(), device, log, error) < 0)
+        return false;
+
+    QString partedBin = locatePartedBinary();
+    if (partedBin.isEmpty()) {
+        *error = "parted not found";
+        return false;
+    }
+
+    // Run all partition commands in a single parted invocation so the kernel
+    // sees the new table before we name and flag the ESP
+    QStringList args{partedBin, device,  "--script", "mklabel", "gpt",  "mkpart",
+                     "primary", "fat32", "1MiB",     "513MiB",  "name", "1",
+                     "ESP",     "set",   "1",        "esp",     "on",   "mkpart",
+                     "primary", "ext4",  "513MiB",   "100%"};
+    if (CommandRunner::execute(args) != 0) {
+        *error = "Failed to run parted.";
+        return false;
+    }
+
+    CommandRunner::execute({"partprobe", device});
+    CommandRunner::execute({"udevadm", "settle"});
+    return true;
+}
+
+QString carveEspFromPartition(const QString &drive, int partNum, const PartitionLogFn &log,
+                              QString *error)
+{
+    // The partition that is shrunk must not be mounted; the drive's other
+    // partitions are left as they are
+    MountManager::unmountAll(QString(), partitionPath(drive, partNum), log);
+
+    // Prefer carving the ESP out of unallocated space; only shrink the end
+    // of the filesystem when there is none, and never relocate its start.
+    ResizePlanner planner(drive);
+    if (!planner.load()) {
+        *error = planner.errorString();
+        return QString();
+    }
+
+    const long long espMiB = 512;
+    QList<ResizePlanner::Plan> plans = planner.plansFor(partNum, espMiB);
+    if (plans.isEmpty()) {
+        *error = "No free space and partition cannot be shrunk to make room for EFI.";
+        return QString();
+    }
+    for (const ResizePlanner::Plan &p : std::as_const(plans))
+        log("Candidate: " + p.description);
+
+    const ResizePlanner::Plan plan = plans.first();
+    if (!planner.apply(plan, log)) {
+        *error = planner.errorString();
+        return QString();
+    }
+
+    // Locate the partition that now starts where the ESP was carved out
+    int espNum = 0;
+    for (const DiskExtent &e : planner.extents()) {
+        if (!e.isFree && qAbs(e.startMiB - plan.carveStartMiB) < 1.0) {
+            espNum = e.number;
+            break;
+        }
+    }
+    if (espNum == 0) {
+        *error = "Could not locate new EFI partition.";
+        return QString();
+    }
+
+    QString device = QString("/dev/%1").arg(drive);
+    QString partedBin = locatePartedBinary();
+    QString espPath = partitionPath(drive, espNum);
+    waitForPartition(espPath);
+    Formatter formatter(log);
+    if (!formatter.formatAll({{espPath, "vfat"}}).first().ok) {
+        *error = "Failed to format " + espPath + " as FAT32.";
+        return QString();
+    }
+
+    CommandRunner::execute({partedBin, device, "--script", "name",
+                            QString::number(espNum), "ESP"});
+    CommandRunner::execute({partedBin, device, "--script", "set",
+                            QString::number(espNum), "esp", "on"});
+    return espPath;
+}
+
+QString replaceWithBiosBootAndRoot(const QString &drive, const QString &partition, QString *error)
+{
+    // 2. Unmount partition (safe even if not mounted)
+    CommandRunner::execute({"umount", partition});
+
+    // 3. Get partition number and start/end positions
+    QStringList infoVals = CommandRunner::capture({"lsblk", "-nr", "-o", "NAME,PARTNUM,START,SIZE", partition})
+                               .split(QRegularExpression("\\s+"), Qt::SkipEmptyParts);
+    if (infoVals.size() < 4) {
+        *error = "Could not get partition info.";
+        return QString();
+    }
+    QString partNum = infoVals[1];
+    long long partStartSector = infoVals[2].toLongLong();
+    long long partSizeSector = infoVals[3].toLongLong();
+
+    // 4. Get sector size (needed for parted)
+    QFile sectorFile("/sys/block/" + drive + "/queue/hw_sector_size");
+    long long sectorSize = 512;
+    if (sectorFile.open(QIODevice::ReadOnly | QIODevice::Text))
+        sectorSize = sectorFile.readAll().trimmed().toLongLong();
+
+    // 5. Calculate start and end in MiB
+    double startMiB = (double)partStartSector * sectorSize / 1048576.0;
+    double endMiB   = startMiB + ((double)partSizeSector * sectorSize / 1048576.0);
+
+    QString partedBin = locatePartedBinary();
+
+    // Capture partition list before modifications
+    QStringList beforeList = CommandRunner::capture({"lsblk", "-nr", "-o", "NAME", QString("/dev/%1").arg(drive)})
+                                 .split('\n', Qt::SkipEmptyParts);
+    // Convert list of partition names into a set for fast lookup
+    QSet<QString> beforeParts(beforeList.cbegin(), beforeList.cend());
+
+    // 6. Delete old partition
+    CommandRunner::execute({partedBin, QString("/dev/%1").arg(drive), "--script", "rm", partNum});
+    CommandRunner::execute({"partprobe", QString("/dev/%1").arg(drive)});
+    CommandRunner::execute({"udevadm", "settle"});
+
+    // 7. Create bios_grub (1MiB) and root (rest)
+    QString biosGrubStart = QString::number(startMiB, 'f', 2) + "MiB";
+    QString biosGrubEnd   = QString::number(startMiB + 1.0, 'f', 2) + "MiB";
+    QString rootStart     = biosGrubEnd;
+    QString rootEnd       = QString::number(endMiB, 'f', 2) + "MiB";
+
+    CommandRunner::execute({partedBin, QString("/dev/%1").arg(drive), "--script",
+                            "mkpart", "primary", biosGrubStart, biosGrubEnd});
+    CommandRunner::execute({partedBin, QString("/dev/%1").arg(drive), "--script",
+                            "mkpart", "primary", "ext4", rootStart, rootEnd});
+
+    CommandRunner::execute({"partprobe", QString("/dev/%1").arg(drive)});
+    CommandRunner::execute({"udevadm", "settle"});
+
+    // 8. Determine new partitions and set bios_grub flag
+    QStringList lines = CommandRunner::capture({"lsblk", "-bnr", "-o", "NAME,SIZE,PARTNUM", QString("/dev/%1").arg(drive)})
+                            .split('\n', Qt::SkipEmptyParts);
+
+    QString biosPartNum;
+    QString newRootPart;
+    for (const QString &l : lines) {
+        QStringList cols = l.split(QRegularExpression("\\s+"), Qt::SkipEmptyParts);
+        if (cols.size() < 3)
+            continue;
+        QString name = cols.at(0);
+        if (beforeParts.contains(name))
+            continue; // existing partition
+
+        QString sizeStr = cols.at(1);
+        bool ok = false;
+        double szMiB = sizeStr.toDouble(&ok) / 1048576.0; // bytes -> MiB
+        if (ok && qAbs(szMiB - 1.0) < 0.1)
+            biosPartNum = cols.at(2);
+        else
+            newRootPart = "/dev/" + name;
+    }
+
+    if (!biosPartNum.isEmpty())
+        CommandRunner::execute({partedBin, QString("/dev/%1").arg(drive), "--script",
+                                "set", biosPartNum, "bios_grub", "on"});
+
+    if (newRootPart.isEmpty())
+        *error = "Could not locate new root partition.";
+    return newRootPart;
+}
+
+bool formatRootPartitionWithCheck(const QString &rootPart, const QString &device,
+                                  const PartitionLogFn &log, QString *error)
+{
+    // Refresh kernel's partition table
+    CommandRunner::execute({"partprobe", device});
+    CommandRunner::execute({"udevadm", "settle"});
+    QThread::sleep(1);
+
+    // Wait for root partition to appear
+    if (!waitForPartition(rootPart)) {
+        *error = "Newly created partition did not appear in time!";
+        return false;
+    }
+
+    // Format ext4; a freshly made filesystem needs no fsck afterwards
+    Formatter formatter(log);
+    if (!formatter.formatAll({{rootPart, "ext4"}}).first().ok) {
+        *error = "Failed to format partition as ext4.";
+        return false;
+    }
+
+    log("Root partition formatted successfully.");
+    return true;
+}
@@ -0,0 +1,44 @@
+#ifndef PARTITIONHELPERS_H
+#define PARTITIONHELPERS_H
+
+#include <QString>
+#include <QStringList>
+#include <functional>
+
+// Disk layout helpers shared by the wizard and the headless engine. None of
+// them touch widgets or ask questions, so they run on any thread; failures
+// come back through the return value and *error.
+
+using PartitionLogFn = std::function<void(const QString &)>;
+
+QString locatePartedBinary();
+// Whole disks, without loop devices, e.g. {"sda", "nvme0n1"}
+QStringList availableDrives();
+// Node of partition number on drive, e.g. ("nvme0n1", 2) -> /dev/nvme0n1p2
+QString partitionPath(const QString &drive, int number);
+// Disk a partition lives on, e.g. /dev/sda3 -> "sda"
+QString parentDrive(const QString &partition);
+// 0 when partition is not a partition
+int partitionNumber(const QString &partition);
+
+QString getPartitionTableType(const QString &drive);
+bool hasBiosBootPartition(const QString &drive, const QString &excludePart = QString());
+bool mbrPrimaryPartitionLimitReached(const QString &drive);
+bool waitForPartition(const QString &partPath, int timeoutSeconds = 10);
+
+// Wipes drive and writes a GPT with a 512MiB ESP (partition 1) and a root
+// partition over the rest (partition 2).
+bool createEfiLayout(const QString &drive, const PartitionLogFn &log, QString *error);
+// Makes room for a 512MiB ESP next to partition partNum, from free space
+// if there is any and otherwise by shrinking the end of the partition, then
+// formats and flags it. Returns the ESP's node, empty on failure.
+QString carveEspFromPartition(const QString &drive, int partNum, const PartitionLogFn &log,
+                              QString *error);
+// Replaces a GPT partition with a 1MiB bios_grub partition plus a root
+// partition covering the rest of its range. Returns the new root partition,
+// or an empty string with *error set.
+QString replaceWithBiosBootAndRoot(const QString &drive, const QString &partition, QString *error);
+bool formatRootPartitionWithCheck(const QString &rootPart, const QString &device,
+                                  const PartitionLogFn &log, QString *error);
+
+#endif // PARTITIONHELPERS_H
@@ -0,0 +1,143 @@
+#include "perfbaseline.h"
+#include <QDir>
+#include <QFile>
+#include <QRegularExpression>
+#include <QThread>
+
+namespace {
+
+const QString CpuFreq = "/sys/devices/system/cpu/cpu0/cpufreq/";
+
+QString readText(const QString &path)
+{
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text))
+        return QString();
+    return QString::fromLatin1(f.readAll()).trimmed();
+}
+
+bool onBattery()
+{
+    const QDir supplies("/sys/class/power_supply");
+    for (const QString &supply : supplies.entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+        if (readText(supplies.filePath(supply + "/type")) == "Battery")
+            return true;
+    return false;
+}
+
+// A tmpfiles.d line writing value to the same file of every CPU
+QString writeEveryCpu(const QString &file, const QString &value)
+{
+    return QString("w /sys/devices/system/cpu/cpu*/cpufreq/%1 - - - - %2\n").arg(file, value);
+}
+
+} // namespace
+
+PerfBaseline::PerfBaseline(const QString &governor)
+{
+    const QString cpuinfo = readText("/proc/cpuinfo");
+    static const QRegularExpression vendorId("^vendor_id\\s*:\\s*(\\S+)", QRegularExpression::MultilineOption);
+    static const QRegularExpression modelName("^model name\\s*:\\s*(.+)$", QRegularExpression::MultilineOption);
+    const QString id = vendorId.match(cpuinfo).captured(1);
+    if (id == "GenuineIntel")
+        cpuVendor = "intel";
+    else if (id == "AuthenticAMD")
+        cpuVendor = "amd";
+    model = modelName.match(cpuinfo).captured(1).trimmed();
+    cpuCount = qMax(1, QThread::idealThreadCount());
+    cpufreqDriver = readText(CpuFreq + "scaling_driver");
+    availableGovernors = readText(CpuFreq + "scaling_available_governors").split(' ', Qt::SkipEmptyParts);
+    epp = QFile::exists(CpuFreq + "energy_performance_preference");
+    battery = onBattery();
+
+    decide("cpu", cpuVendor,
+           QString("%1, %2 logical CPUs, cpufreq driver %3")
+               .arg(model.isEmpty() ? id : model)
+               .arg(cpuCount)
+               .arg(cpufreqDriver.isEmpty() ? QString("none") : cpufreqDriver));
+
+    if (microcodePackage().isEmpty())
+        decide("microcode", "none", "no microcode package for this vendor");
+    else
+        decide("microcode", microcodePackage(), "loaded by the initramfs microcode hook before the kernel "
+                                                "starts, with every bootloader");
+
+    decide("makepkg MAKEFLAGS", "-j$(nproc)",
+           QString("builds on all %1 CPUs here; nproc follows the machine the disk boots in").arg(cpuCount));
+    decide("makepkg compression", "zstd -T0", "multithreaded zstd packs faster than xz and unpacks "
+                                              "several times faster; makepkg's default is single-threaded");
+    decide("pacman ParallelDownloads", QString::number(parallelDownloads()),
+           "overlaps the latency of each package; more connections gain little and mirrors throttle them");
+
+    decideGovernor(governor);
+}
+
+void PerfBaseline::decideGovernor(const QString &governor)
+{
+    if (cpufreqDriver.isEmpty()) {
+        decide("governor", "none", "no cpufreq driver (a virtual machine?); the clock is not ours to set");
+        return;
+    }
+    if (governor != "auto") {
+        if (!availableGovernors.contains(governor)) {
+            decide("governor", "kernel default", QString("%1 offers %2, not %3")
+                                                      .arg(cpufreqDriver, availableGovernors.join(", "), governor));
+            return;
+        }
+        tmpfiles = writeEveryCpu("scaling_governor", governor);
+        decide("governor", governor, "from the config, set at every boot");
+        return;
+    }
+    if (battery) {
+        extraPackages << "power-profiles-daemon";
+        units << "power-profiles-daemon.service";
+        decide("governor", "power-profiles-daemon",
+               "a laptop; the desktop switches between power-saver, balanced and performance");
+    } else if (epp) {
+        tmpfiles = writeEveryCpu("energy_performance_preference", "balance_performance");
+        decide("governor", "powersave, EPP balance_performance",
+               cpufreqDriver + " picks the frequency itself; on mains power the hint leans it toward speed");
+    } else if (availableGovernors.contains("schedutil")) {
+        tmpfiles = writeEveryCpu("scaling_governor", "schedutil");
+        decide("governor", "schedutil", "follows the scheduler's load tracking instead of sampling it");
+    } else {
+        decide("governor", "kernel default", cpufreqDriver + " has no schedutil");
+    }
+}
+
+QStringList PerfBaseline::governors()
+{
+    return {"auto", "performance", "schedutil", "ondemand", "powersave"};
+}
+
+void PerfBaseline::decide(const QString &setting, const QString &value, const QString &reason)
+{
+    lines << QString("%1: %2 (%3)").arg(setting, value, reason);
+}
+
+QString PerfBaseline::microcodePackage() const
+{
+    if (cpuVendor == "intel")
+        return "intel-ucode";
+    if (cpuVendor == "amd")
+        return "amd-ucode";
+    return QString();
+}
+
+QByteArray PerfBaseline::makepkgConfig() const
+{
+    // Sourced by makepkg after makepkg.conf, so pacman upgrades leave it be
+    return "# Written by the installer; the reasons are in /var/log/archhelp/performance.txt\n"
+           "MAKEFLAGS=\"-j$(nproc)\"\n"
+           "PKGEXT='.pkg.tar.zst'\n"
+           "COMPRESSZST=(zstd -c -T0 -)\n"
+           "COMPRESSXZ=(xz -c -z -T0 -)\n";
+}
+
+QByteArray PerfBaseline::tmpfilesConfig() const
+{
+    if (tmpfiles.isEmpty())
+        return QByteArray();
+    return ("# Written by the installer; the reasons are in /var/log/archhelp/performance.txt\n" + tmpfiles)
+        .toUtf8();
+}
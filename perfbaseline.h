@@ -0,0 +1,56 @@
+#ifndef PERFBASELINE_H
+#define PERFBASELINE_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+
+// Baseline of the installed system for its CPU, decided from /proc/cpuinfo
+// and cpufreq in sysfs: the vendor's microcode, makepkg building on every
+// core and compressing packages with multithreaded zstd, pacman downloading
+// in parallel, and how the CPU clock is governed. Like MemoryConfig it looks
+// at the machine running the installer; what depends on the core count is
+// written so it follows the machine the disk ends up in.
+//
+// Governors: "auto" (power-profiles-daemon on laptops, otherwise what suits
+// the cpufreq driver), or a cpufreq governor fixed at every boot.
+class PerfBaseline {
+public:
+    explicit PerfBaseline(const QString &governor = "auto");
+
+    static QStringList governors();
+    static QString makepkgPath() { return "/etc/makepkg.conf.d/archhelp.conf"; }
+    static QString tmpfilesPath() { return "/etc/tmpfiles.d/archhelp-cpu.conf"; }
+
+    // "intel", "amd", or "unknown"
+    QString vendor() const { return cpuVendor; }
+    int cores() const { return cpuCount; }
+    // Empty for vendors without a microcode package
+    QString microcodePackage() const;
+    int parallelDownloads() const { return 5; }
+    QByteArray makepkgConfig() const;
+    // Empty when the kernel's choice of governor stays
+    QByteArray tmpfilesConfig() const;
+    QStringList packages() const { return extraPackages; }
+    QStringList unitsToEnable() const { return units; }
+    // One line per decision with its reason
+    QStringList report() const { return lines; }
+
+private:
+    void decide(const QString &setting, const QString &value, const QString &reason);
+    void decideGovernor(const QString &governor);
+
+    QString cpuVendor = "unknown";
+    QString model;
+    int cpuCount = 1;
+    QString cpufreqDriver;
+    QStringList availableGovernors;
+    bool epp = false;
+    bool battery = false;
+    QString tmpfiles;
+    QStringList extraPackages;
+    QStringList units;
+    QStringList lines;
+};
+
+#endif // PERFBASELINE_H
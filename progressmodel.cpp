@@ -0,0 +1,210 @@
+#include "progressmodel.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QtGlobal>
+
+// Weight of the newest run in the moving averages
+static const double HistoryWeight = 0.5;
+
+ProgressModel::ProgressModel(const QList<QPair<QString, double>> &phases, const QString &path)
+    : historyPath(path)
+{
+    for (const auto &p : phases) {
+        names << p.first;
+        defaults << p.second;
+        actualSeconds << -1.0;
+        predictedSeconds << p.second;
+        units << 0.0;
+    }
+}
+
+QString ProgressModel::defaultHistoryPath()
+{
+    // Runs as root; keep it with the other state of the live system
+    return "/var/lib/archhelp/phase-history.json";
+}
+
+bool ProgressModel::loadHistory()
+{
+    QFile f(historyPath);
+    if (!f.open(QIODevice::ReadOnly))
+        return false;
+    QJsonObject root = QJsonDocument::fromJson(f.readAll()).object();
+    for (auto it = root.constBegin(); it != root.constEnd(); ++it) {
+        QJsonObject o = it.value().toObject();
+        PhaseStats s;
+        s.seconds = o.value("seconds").toDouble();
+        s.unitsPerSecond = o.value("unitsPerSecond").toDouble();
+        s.runs = o.value("runs").toInt();
+        history.insert(it.key(), s);
+    }
+    for (int i = 0; i < names.size(); ++i)
+        predictedSeconds[i] = estimate(i);
+    return true;
+}
+
+bool ProgressModel::saveHistory() const
+{
+    QJsonObject root;
+    for (auto it = history.constBegin(); it != history.constEnd(); ++it) {
+        root.insert(it.key(), QJsonObject{{"seconds", it.value().seconds},
+                                          {"unitsPerSecond", it.value().unitsPerSecond},
+                                          {"runs", it.value().runs}});
+    }
+    QDir().mkpath(QFileInfo(historyPath).absolutePath());
+    QSaveFile f(historyPath);
+    if (!f.open(QIODevice::WriteOnly))
+        return false;
+    f.write(QJsonDocument(root).toJson());
+    return f.commit();
+}
+
+double ProgressModel::phaseSeconds(const QString &phase) const
+{
+    int idx = names.indexOf(phase);
+    return idx >= 0 ? actualSeconds.at(idx) : -1.0;
+}
+
+double ProgressModel::phaseUnits(const QString &phase) const
+{
+    int idx = names.indexOf(phase);
+    return idx >= 0 ? units.at(idx) : 0.0;
+}
+
+double ProgressModel::estimate(int phase) const
+{
+    auto it = history.constFind(names.at(phase));
+    if (it == history.constEnd() || it->runs == 0)
+        return defaults.at(phase);
+    if (units.at(phase) > 0 && it->unitsPerSecond > 0)
+        return units.at(phase) / it->unitsPerSecond;
+    return it->seconds;
+}
+
+void ProgressModel::closeCurrent()
+{
+    if (current < 0)
+        return;
+    actualSeconds[current] = phaseTimer.elapsed() / 1000.0;
+    if (units.at(current) > 0)
+        unitsDone = units.at(current);
+    current = -1;
+}
+
+void ProgressModel::begin(const QString &phase, double totalUnits)
+{
+    closeCurrent();
+    int idx = names.indexOf(phase);
+    if (idx < 0)
+        return;
+    current = idx;
+    unitsDone = 0.0;
+    units[idx] = totalUnits;
+    predictedSeconds[idx] = estimate(idx);
+    phaseTimer.start();
+}
+
+void ProgressModel::setTotalUnits(double totalUnits)
+{
+    if (current < 0 || units.at(current) == totalUnits)
+        return;
+    units[current] = totalUnits;
+    predictedSeconds[current] = estimate(current);
+}
+
+void ProgressModel::advance(double done)
+{
+    unitsDone = done;
+}
+
+void ProgressModel::finish()
+{
+    closeCurrent();
+    for (int i = 0; i < names.size(); ++i) {
+        if (actualSeconds.at(i) < 0)
+            continue;
+        PhaseStats &s = history[names.at(i)];
+        double rate = units.at(i) > 0 && actualSeconds.at(i) > 0 ? units.at(i) / actualSeconds.at(i) : 0.0;
+        if (s.runs == 0) {
+            s.seconds = actualSeconds.at(i);
+            s.unitsPerSecond = rate;
+        } else {
+            s.seconds += HistoryWeight * (actualSeconds.at(i) - s.seconds);
+            if (rate > 0)
+                s.unitsPerSecond = s.unitsPerSecond > 0
+                                       ? s.unitsPerSecond + HistoryWeight * (rate - s.unitsPerSecond)
+                                       : rate;
+        }
+        ++s.runs;
+    }
+}
+
+// How far the running phase is, from its units when it reports them and
+// from elapsed time against the prediction otherwise. Time based progress
+// stops short of the end so an overrunning phase does not sit at 100%.
+double ProgressModel::phaseFraction() const
+{
+    if (current < 0)
+        return 0.0;
+    if (units.at(current) > 0)
+        return qBound(0.0, unitsDone / units.at(current), 1.0);
+    double predicted = predictedSeconds.at(current) * correction();
+    if (predicted <= 0)
+        return 0.0;
+    return qMin(0.95, phaseTimer.elapsed() / 1000.0 / predicted);
+}
+
+// Actual over predicted time of the phases finished so far in this run
+double ProgressModel::correction() const
+{
+    double actual = 0.0, predicted = 0.0;
+    for (int i = 0; i < names.size(); ++i) {
+        if (actualSeconds.at(i) < 0)
+            continue;
+        actual += actualSeconds.at(i);
+        predicted += predictedSeconds.at(i);
+    }
+    if (predicted < 1.0)
+        return 1.0;
+    return qBound(0.5, actual / predicted, 2.0);
+}
+
+double ProgressModel::fraction() const
+{
+    double total = 0.0, done = 0.0;
+    for (int i = 0; i < names.size(); ++i) {
+        double weight = predictedSeconds.at(i);
+        total += weight;
+        if (actualSeconds.at(i) >= 0)
+            done += weight;
+        else if (i == current)
+            done += weight * phaseFraction();
+    }
+    return total > 0 ? done / total : 0.0;
+}
+
+qint64 ProgressModel::etaSeconds() const
+{
+    double factor = correction();
+    double remaining = 0.0;
+    for (int i = 0; i < names.size(); ++i) {
+        if (actualSeconds.at(i) >= 0)
+            continue;
+        if (i != current) {
+            remaining += predictedSeconds.at(i) * factor;
+            continue;
+        }
+        double elapsed = phaseTimer.elapsed() / 1000.0;
+        double f = phaseFraction();
+        // Extrapolate from this phase's own pace once it has some
+        if (units.at(i) > 0 && f > 0.05)
+            remaining += elapsed * (1.0 - f) / f;
+        else
+            remaining += qMax(0.0, predictedSeconds.at(i) * factor - elapsed);
+    }
+    return static_cast<qint64>(remaining + 0.5);
+}
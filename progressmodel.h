@@ -0,0 +1,72 @@
+#ifndef PROGRESSMODEL_H
+#define PROGRESSMODEL_H
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QMap>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+
+// Turns a fixed list of install phases into one overall fraction and an
+// ETA. Each phase is weighted by how long it took on previous runs on this
+// host (an exponential moving average kept in a small JSON file). Phases
+// that report work units (bytes extracted, packages installed) are also
+// scaled by the throughput seen last time, so a bigger package set gets a
+// proportionally bigger share. Within a run, the ratio of actual to
+// predicted time of finished phases corrects the estimate for the rest.
+class ProgressModel {
+public:
+    struct PhaseStats {
+        double seconds = 0.0;        // EMA of the phase's duration
+        double unitsPerSecond = 0.0; // EMA of throughput, 0 when unknown
+        int runs = 0;
+    };
+
+    // defaultSeconds gives a rough first guess for hosts with no history
+    ProgressModel(const QList<QPair<QString, double>> &phases,
+                  const QString &historyPath = defaultHistoryPath());
+
+    static QString defaultHistoryPath();
+
+    bool loadHistory();
+    bool saveHistory() const;
+
+    void begin(const QString &phase, double totalUnits = 0.0);
+    void setTotalUnits(double totalUnits);
+    void advance(double unitsDone);
+    // Records the finished run's timings into the history
+    void finish();
+
+    double fraction() const;
+    qint64 etaSeconds() const;
+    QString currentPhase() const { return current >= 0 ? names.at(current) : QString(); }
+    double totalUnits() const { return current >= 0 ? units.at(current) : 0.0; }
+
+    // This run's results, for reporting: seconds is -1 for phases that
+    // have not finished
+    QStringList phases() const { return names; }
+    double phaseSeconds(const QString &phase) const;
+    double phaseUnits(const QString &phase) const;
+
+private:
+    double estimate(int phase) const;
+    double phaseFraction() const;
+    double correction() const;
+    void closeCurrent();
+
+    QString historyPath;
+    QStringList names;
+    QList<double> defaults;
+    QMap<QString, PhaseStats> history;
+
+    // This run
+    QList<double> actualSeconds;    // -1 until the phase has finished
+    QList<double> predictedSeconds; // prediction at the time the phase began
+    QList<double> units;
+    int current = -1;
+    double unitsDone = 0.0;
+    QElapsedTimer phaseTimer;
+};
+
+#endif // PROGRESSMODEL_H
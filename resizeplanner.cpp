@@ -0,0 +1,311 @@
+#include "resizeplanner.h"
+#include "commandrunner.h"
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+static QString locatePartedBinary()
+{
+    QString p = QStandardPaths::findExecutable("parted");
+    if (!p.isEmpty())
+        return p;
+    const QStringList fallbacks{"/usr/sbin/parted", "/sbin/parted"};
+    for (const QString &path : fallbacks)
+        if (QFileInfo::exists(path))
+            return path;
+    return QString();
+}
+
+static const int Minute = 60 * 1000;
+
+// e2fsck and resize2fs walk the whole filesystem and can stay quiet for a
+// long time on a large disk; parted only rewrites the partition table.
+static const int FilesystemTimeoutMs = 8 * 60 * Minute;
+static const int FilesystemStallMs = 60 * Minute;
+static const int PartedTimeoutMs = 10 * Minute;
+static const int PartedStallMs = 5 * Minute;
+
+// Runs argv under the watchdog and this thread's CancelScope, logging its
+// output line by line. Returns the exit code, or -1 when it was stopped or
+// could not start.
+static int runLogged(const QStringList &argv, int timeoutMs, int stallMs, const ResizePlanner::LogFn &log)
+{
+    CommandRunner runner([&log](const QString &line, bool) {
+        // resize2fs -p ends each pass with a 40 column bar of 'X' characters
+        QString text = line.trimmed();
+        while (text.endsWith('X') && text.contains("XXXX"))
+            text.chop(1);
+        text = text.trimmed();
+        if (!text.isEmpty())
+            log(text);
+    });
+    ProcessSpec spec;
+    spec.argv = CommandRunner::privileged(argv);
+    spec.timeoutMs = timeoutMs;
+    spec.stallMs = stallMs;
+    CommandResult result = runner.run(spec);
+    if (!result.watchdog.isEmpty() && !result.canceled) {
+        log(QString("Watchdog stopped %1: %2").arg(spec.displayString(), result.watchdog));
+        for (const QString &line : std::as_const(result.processDump))
+            log("  " + line);
+    }
+    if (result.canceled || result.termSignal != 0 || !result.watchdog.isEmpty())
+        return -1;
+    return result.exitCode;
+}
+
+static int runFilesystemTool(const QStringList &argv, const ResizePlanner::LogFn &log)
+{
+    return runLogged(argv, FilesystemTimeoutMs, FilesystemStallMs, log);
+}
+
+static int runParted(const QStringList &argv, const ResizePlanner::LogFn &log)
+{
+    return runLogged(argv, PartedTimeoutMs, PartedStallMs, log);
+}
+
+ResizePlanner::ResizePlanner(const QString &drv) : drive(drv) {}
+
+QList<DiskExtent> ResizePlanner::parsePartedMachineOutput(const QString &output)
+{
+    QList<DiskExtent> result;
+    for (QString line : output.split('\n', Qt::SkipEmptyParts)) {
+        line = line.trimmed();
+        if (line.endsWith(';'))
+            line.chop(1);
+        QStringList cols = line.split(':');
+        if (cols.size() < 5)
+            continue;
+        bool numOk = false, startOk = false, endOk = false;
+        DiskExtent e;
+        e.number = cols.at(0).toInt(&numOk);
+        e.startMiB = QString(cols.at(1)).remove("MiB").toDouble(&startOk);
+        e.endMiB = QString(cols.at(2)).remove("MiB").toDouble(&endOk);
+        // The device header line has a path in its first column
+        if (!numOk || !startOk || !endOk)
+            continue;
+        e.isFree = cols.at(4) == "free";
+        if (!e.isFree)
+            e.fsType = cols.at(4);
+        result << e;
+    }
+    std::sort(result.begin(), result.end(),
+              [](const DiskExtent &a, const DiskExtent &b) { return a.startMiB < b.startMiB; });
+    return result;
+}
+
+QString ResizePlanner::strategyName(Strategy s)
+{
+    switch (s) {
+    case Strategy::UseTrailingFree: return "use trailing free space";
+    case Strategy::UseLeadingFree: return "use leading free space";
+    case Strategy::ShrinkEnd: return "shrink partition end";
+    case Strategy::MoveStart: return "move partition start";
+    }
+    return QString();
+}
+
+bool ResizePlanner::load()
+{
+    partedBin = locatePartedBinary();
+    if (partedBin.isEmpty()) {
+        error = "parted not found";
+        return false;
+    }
+    layout = parsePartedMachineOutput(CommandRunner::capture(
+        {partedBin, QString("/dev/%1").arg(drive), "-m", "unit", "MiB", "print", "free"}));
+    if (layout.isEmpty()) {
+        error = QString("Could not read partition layout of /dev/%1").arg(drive);
+        return false;
+    }
+    return true;
+}
+
+QList<DiskExtent> ResizePlanner::freeRegions(double minSizeMiB) const
+{
+    QList<DiskExtent> regions;
+    for (const DiskExtent &e : layout)
+        if (e.isFree && e.sizeMiB() >= minSizeMiB)
+            regions << e;
+    return regions;
+}
+
+const DiskExtent *ResizePlanner::partition(int partNum) const
+{
+    for (const DiskExtent &e : layout)
+        if (!e.isFree && e.number == partNum)
+            return &e;
+    return nullptr;
+}
+
+QString ResizePlanner::partitionPath(int partNum) const
+{
+    QString suffix = (drive.startsWith("nvme") || drive.startsWith("mmc")) ? "p" : "";
+    return QString("/dev/%1%2%3").arg(drive, suffix).arg(partNum);
+}
+
+// Bytes actually in use by an ext* filesystem according to its superblock;
+// other filesystems are treated as full since we cannot shrink them anyway.
+qint64 ResizePlanner::usedBytes(int partNum) const
+{
+    const DiskExtent *p = partition(partNum);
+    if (!p)
+        return 0;
+    qint64 whole = static_cast<qint64>(p->sizeMiB() * 1048576.0);
+    if (!p->fsType.startsWith("ext"))
+        return whole;
+
+    qint64 blockCount = 0, freeBlocks = 0, blockSize = 0;
+    for (const QString &line : CommandRunner::capture({"dumpe2fs", "-h", partitionPath(partNum)}).split('\n')) {
+        QString value = line.section(':', 1).trimmed();
+        if (line.startsWith("Block count:"))
+            blockCount = value.toLongLong();
+        else if (line.startsWith("Free blocks:"))
+            freeBlocks = value.toLongLong();
+        else if (line.startsWith("Block size:"))
+            blockSize = value.toLongLong();
+    }
+    if (blockCount <= 0 || blockSize <= 0)
+        return whole;
+    return (blockCount - freeBlocks) * blockSize;
+}
+
+QList<ResizePlanner::Plan> ResizePlanner::plansFor(int partNum, long long carveMiB) const
+{
+    QList<Plan> plans;
+    const DiskExtent *p = partition(partNum);
+    if (!p)
+        return plans;
+
+    long long partStart = static_cast<long long>(std::ceil(p->startMiB));
+    long long partEnd = static_cast<long long>(std::floor(p->endMiB));
+
+    // Unallocated space directly after or before the partition costs nothing
+    for (const DiskExtent &f : freeRegions(carveMiB)) {
+        long long fStart = static_cast<long long>(std::ceil(f.startMiB));
+        long long fEnd = static_cast<long long>(std::floor(f.endMiB));
+        if (fStart < 1)
+            fStart = 1; // keep the first MiB for the partition table
+        if (fEnd - fStart < carveMiB)
+            continue;
+        // parted reports the boundaries in fractions of a MiB
+        const bool after = qAbs(f.startMiB - p->endMiB) < 1.0;
+        const bool before = qAbs(f.endMiB - p->startMiB) < 1.0;
+        if (!after && !before)
+            continue;
+        Plan plan;
+        plan.partNum = partNum;
+        if (after) {
+            plan.strategy = Strategy::UseTrailingFree;
+            plan.carveStartMiB = fStart;
+        } else {
+            plan.strategy = Strategy::UseLeadingFree;
+            plan.carveStartMiB = fEnd - carveMiB;
+        }
+        plan.carveEndMiB = plan.carveStartMiB + carveMiB;
+        plan.description = QString("%1: new partition at %2-%3 MiB, no data moved")
+                               .arg(strategyName(plan.strategy))
+                               .arg(plan.carveStartMiB).arg(plan.carveEndMiB);
+        plans << plan;
+    }
+
+    if (p->fsType.startsWith("ext") && partEnd - partStart > carveMiB) {
+        qint64 used = usedBytes(partNum);
+        qint64 newSize = (partEnd - partStart - carveMiB) * 1048576LL;
+        if (used < newSize) {
+            // resize2fs only relocates blocks that live past the new end;
+            // assume used blocks are spread evenly over the filesystem.
+            double tailFraction = double(carveMiB) / double(partEnd - partStart);
+            Plan shrink;
+            shrink.strategy = Strategy::ShrinkEnd;
+            shrink.partNum = partNum;
+            shrink.newPartEndMiB = partEnd - carveMiB;
+            shrink.newPartSizeMiB = shrink.newPartEndMiB - partStart;
+            shrink.carveStartMiB = shrink.newPartEndMiB;
+            shrink.carveEndMiB = partEnd;
+            shrink.estimatedIoBytes = static_cast<qint64>(2.0 * used * tailFraction);
+            shrink.description = QString("%1: shrink to %2 MiB, ~%3 MiB relocated")
+                                     .arg(strategyName(shrink.strategy))
+                                     .arg(shrink.newPartSizeMiB)
+                                     .arg(shrink.estimatedIoBytes / 1048576);
+            plans << shrink;
+
+            // Relocating the start copies every used block
+            Plan move;
+            move.strategy = Strategy::MoveStart;
+            move.partNum = partNum;
+            move.carveStartMiB = partStart;
+            move.carveEndMiB = partStart + carveMiB;
+            move.newPartEndMiB = partEnd;
+            move.newPartSizeMiB = partEnd - move.carveEndMiB;
+            move.estimatedIoBytes = 2 * used;
+            move.description = QString("%1: ~%2 MiB copied")
+                                   .arg(strategyName(move.strategy))
+                                   .arg(move.estimatedIoBytes / 1048576);
+            plans << move;
+        }
+    }
+
+    std::stable_sort(plans.begin(), plans.end(), [](const Plan &a, const Plan &b) {
+        return a.estimatedIoBytes < b.estimatedIoBytes;
+    });
+    return plans;
+}
+
+bool ResizePlanner::bestPlan(int partNum, long long carveMiB, Plan *out) const
+{
+    QList<Plan> plans = plansFor(partNum, carveMiB);
+    if (plans.isEmpty())
+        return false;
+    *out = plans.first();
+    return true;
+}
+
+bool ResizePlanner::apply(const Plan &plan, const LogFn &log)
+{
+    QString device = QString("/dev/%1").arg(drive);
+    log("Resize plan: " + plan.description);
+
+    if (plan.strategy == Strategy::MoveStart) {
+        // parted can no longer move partitions and copying the filesystem
+        // takes hours on large disks, so never do it implicitly.
+        error = "Making room would require relocating the whole filesystem. "
+                "Free some space after the partition and try again.";
+        return false;
+    }
+
+    if (plan.strategy == Strategy::ShrinkEnd) {
+        QString partPath = partitionPath(plan.partNum);
+        log("Checking filesystem on " + partPath + "...");
+        if (runFilesystemTool({"e2fsck", "-f", "-p", partPath}, log) > 1) {
+            error = "Filesystem check failed before resize.";
+            return false;
+        }
+
+        log(QString("Shrinking filesystem on %1 to %2 MiB...").arg(partPath).arg(plan.newPartSizeMiB));
+        if (runFilesystemTool({"resize2fs", "-p", partPath, QString("%1M").arg(plan.newPartSizeMiB)}, log) != 0) {
+            error = "Failed to shrink filesystem.";
+            return false;
+        }
+
+        if (runParted({partedBin, device, "--script", "resizepart",
+                               QString::number(plan.partNum),
+                               QString("%1MiB").arg(plan.newPartEndMiB)}, log) != 0) {
+            error = "Failed to resize selected partition.";
+            return false;
+        }
+    }
+
+    if (runParted({partedBin, device, "--script", "mkpart", "primary",
+                           QString("%1MiB").arg(plan.carveStartMiB),
+                           QString("%1MiB").arg(plan.carveEndMiB)}, log) != 0) {
+        error = "Failed to create new partition.";
+        return false;
+    }
+
+    CommandRunner::execute({"partprobe", device});
+    CommandRunner::execute({"udevadm", "settle"});
+    return load();
+}
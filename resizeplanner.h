@@ -0,0 +1,67 @@
+#ifndef RESIZEPLANNER_H
+#define RESIZEPLANNER_H
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <functional>
+
+// Describes one row of `parted -m unit MiB print free`: either a real
+// partition or a region of unallocated space.
+struct DiskExtent {
+    int number = 0;
+    double startMiB = 0.0;
+    double endMiB = 0.0;
+    QString fsType;
+    bool isFree = false;
+
+    double sizeMiB() const { return endMiB - startMiB; }
+};
+
+// Works out how to make room for a new small partition (ESP or bios_grub)
+// next to an existing one while moving as little data as possible. Layouts
+// that only use unallocated space are preferred over shrinking the end of a
+// filesystem, which in turn is always preferred over relocating its start.
+class ResizePlanner {
+public:
+    using LogFn = std::function<void(const QString &)>;
+
+    enum class Strategy { UseTrailingFree, UseLeadingFree, ShrinkEnd, MoveStart };
+
+    struct Plan {
+        Strategy strategy = Strategy::UseTrailingFree;
+        int partNum = 0;
+        long long carveStartMiB = 0;  // where the new partition goes
+        long long carveEndMiB = 0;
+        long long newPartEndMiB = 0;  // ShrinkEnd/MoveStart: new extent of partNum
+        long long newPartSizeMiB = 0;
+        qint64 estimatedIoBytes = 0;  // bytes read+written to carry out the plan
+        QString description;
+    };
+
+    explicit ResizePlanner(const QString &drive);
+
+    bool load();
+    QString errorString() const { return error; }
+    QList<DiskExtent> extents() const { return layout; }
+    QList<DiskExtent> freeRegions(double minSizeMiB = 0.0) const;
+    const DiskExtent *partition(int partNum) const;
+
+    QList<Plan> plansFor(int partNum, long long carveMiB) const;
+    bool bestPlan(int partNum, long long carveMiB, Plan *out) const;
+    bool apply(const Plan &plan, const LogFn &log);
+
+    static QList<DiskExtent> parsePartedMachineOutput(const QString &output);
+    static QString strategyName(Strategy s);
+
+private:
+    QString drive;
+    QString partedBin;
+    QString error;
+    QList<DiskExtent> layout;
+
+    QString partitionPath(int partNum) const;
+    qint64 usedBytes(int partNum) const;
+};
+
+#endif // RESIZEPLANNER_H
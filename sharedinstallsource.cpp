@@ -0,0 +1,86 @@
+#include "sharedinstallsource.h"
+#include "commandrunner.h"
+#include "mountmanager.h"
+#include <QDir>
+#include <QFileInfo>
+#include <cerrno>
+#include <cstring>
+#include <sys/mount.h>
+
+SharedInstallSource::SharedInstallSource(const QString &isoPath, const QString &packageCache)
+    : iso(isoPath), cacheDir(packageCache), mountPoint("/run/archhelp/iso")
+{
+}
+
+SharedInstallSource::~SharedInstallSource()
+{
+    close();
+}
+
+QString SharedInstallSource::defaultPackageCache()
+{
+    return "/var/cache/archhelp/pkg";
+}
+
+bool SharedInstallSource::open(const LogFn &log, QString *error)
+{
+    if (opened)
+        return true;
+    if (!QFileInfo::exists(iso)) {
+        *error = "Arch Linux ISO not found at " + iso;
+        return false;
+    }
+    // Left behind by an installer that did not get to close()
+    MountManager::unmountAll(mountPoint, QString(), log);
+    QDir().mkpath(mountPoint);
+    if (CommandRunner::execute({"mount", "-o", "loop,ro", iso, mountPoint}) != 0) {
+        *error = "Could not mount " + iso;
+        return false;
+    }
+    if (!QFileInfo::exists(squashfsPath())) {
+        MountManager::unmountAll(mountPoint, QString(), log);
+        *error = iso + " has no root filesystem image";
+        return false;
+    }
+    if (!QDir().mkpath(cacheDir)) {
+        MountManager::unmountAll(mountPoint, QString(), log);
+        *error = "Could not create the package cache " + cacheDir;
+        return false;
+    }
+    log(QString("Shared ISO mounted on %1, packages cached in %2").arg(mountPoint, cacheDir));
+    opened = true;
+    return true;
+}
+
+void SharedInstallSource::close()
+{
+    if (!opened)
+        return;
+    MountManager::unmountAll(mountPoint, QString(), [](const QString &) {});
+    opened = false;
+}
+
+QString SharedInstallSource::squashfsPath() const
+{
+    return mountPoint + "/arch/x86_64/airootfs.sfs";
+}
+
+bool SharedInstallSource::attachPackageCache(const QString &root, const LogFn &log)
+{
+    QString target = root + "/var/cache/pacman/pkg";
+    QDir().mkpath(target);
+    QByteArray src = cacheDir.toLocal8Bit();
+    QByteArray dst = target.toLocal8Bit();
+    if (::mount(src.constData(), dst.constData(), nullptr, MS_BIND, nullptr) != 0) {
+        log(QString("Failed to bind %1 on %2: %3")
+                .arg(cacheDir, target, QString::fromLocal8Bit(std::strerror(errno))));
+        return false;
+    }
+    return true;
+}
+
+// Must happen before fstab is generated, or the bind mount gets an entry
+void SharedInstallSource::detachPackageCache(const QString &root, const LogFn &log)
+{
+    MountManager::unmountAll(root + "/var/cache/pacman/pkg", QString(), log);
+}
@@ -0,0 +1,50 @@
+#ifndef SHAREDINSTALLSOURCE_H
+#define SHAREDINSTALLSOURCE_H
+
+#include <QMutex>
+#include <QString>
+#include <functional>
+
+// What several drives installed at once have in common. The ISO is loop
+// mounted once, read-only, and every target extracts straight from its
+// squashfs instead of copying the ISO onto itself first. A package cache on
+// the host is bind-mounted into each target's /var/cache/pacman/pkg; targets
+// take downloadLock() around their download-only pacman runs, so the first
+// target to reach a step fetches its packages and the others find them in
+// place. open() and close() belong to whoever fans the install out; the
+// rest may be called from the targets' threads.
+class SharedInstallSource {
+public:
+    using LogFn = std::function<void(const QString &)>;
+
+    explicit SharedInstallSource(const QString &isoPath,
+                                 const QString &packageCache = defaultPackageCache());
+    ~SharedInstallSource();
+    SharedInstallSource(const SharedInstallSource &) = delete;
+    SharedInstallSource &operator=(const SharedInstallSource &) = delete;
+
+    // /var/cache/archhelp/pkg, kept between runs of the imaging station
+    static QString defaultPackageCache();
+
+    bool open(const LogFn &log, QString *error);
+    void close();
+    bool isOpen() const { return opened; }
+
+    QString isoPath() const { return iso; }
+    QString squashfsPath() const;
+    QString packageCache() const { return cacheDir; }
+
+    bool attachPackageCache(const QString &root, const LogFn &log);
+    void detachPackageCache(const QString &root, const LogFn &log);
+
+    QMutex &downloadLock() { return downloadMutex; }
+
+private:
+    QString iso;
+    QString cacheDir;
+    QString mountPoint;
+    bool opened = false;
+    QMutex downloadMutex;
+};
+
+#endif // SHAREDINSTALLSOURCE_H
@@ -0,0 +1,105 @@
+#include "storagetuning.h"
+#include "fstabgenerator.h"
+
+StorageTuning::StorageTuning(const QString &rootDevice, const QString &fs)
+    : info(BlockDeviceInfo::probe(rootDevice)), fsType(fs)
+{
+    if (!info.valid) {
+        decide("tuning", "none", "sysfs reports no queue for " + rootDevice + "; kernel defaults kept");
+        return;
+    }
+    decide("device", "/dev/" + info.name,
+           QString("%1, queue depth %2, discard granularity %3 bytes")
+               .arg(deviceClass(), info.queueDepth > 0 ? QString::number(info.queueDepth) : QString("n/a"))
+               .arg(info.discardGranularity));
+
+    if (info.nvme) {
+        scheduler = "none";
+        decide("scheduler", scheduler, "NVMe spreads requests over per-CPU hardware queues; "
+                                       "a scheduler only adds latency");
+    } else if (info.isFlash() && info.queueDepth >= 32) {
+        scheduler = "none";
+        decide("scheduler", scheduler, QString("the SSD reorders its %1 queued commands itself").arg(info.queueDepth));
+    } else if (info.isFlash()) {
+        scheduler = "mq-deadline";
+        decide("scheduler", scheduler, "SSD without a deep command queue; deadlines keep reads from "
+                                       "starving behind writes");
+    } else {
+        scheduler = "bfq";
+        decide("scheduler", scheduler, "seeks dominate a spinning disk; BFQ keeps the desktop responsive "
+                                       "under background I/O");
+    }
+
+    if (info.rotational) {
+        readAheadKiB = 4096;
+        decide("read-ahead", QString("%1 KiB").arg(readAheadKiB),
+               "large sequential reads make up for the seek in front of them");
+    } else {
+        decide("read-ahead", QString("kernel default (%1 KiB)").arg(info.readAheadKiB),
+               "random reads are cheap on flash; more read-ahead only fills the page cache");
+    }
+
+    const QString options = FstabGenerator::optionsFor(fsType, info.isFlash());
+    if (!info.isFlash()) {
+        decide("trim", "none", "spinning disks have no use for TRIM");
+    } else if (!info.supportsDiscard()) {
+        decide("trim", "none", "the device does not accept discard requests");
+    } else if (options.contains("discard")) {
+        decide("trim", "continuous", fsType + " discards freed extents asynchronously, in batches");
+    } else {
+        units << "fstrim.timer";
+        decide("trim", "fstrim.timer", "weekly batched trim; discarding on every delete stalls writes "
+                                       "on many SATA SSDs");
+    }
+
+    decide("mount options /", options,
+           options.contains("noatime") ? QString("reads do not turn into access time writes")
+                                       : QString("relatime writes an access time at most once a day"));
+    decide("commit interval", "filesystem default",
+           "a longer interval saves little on modern disks and loses more on power failure");
+}
+
+void StorageTuning::decide(const QString &setting, const QString &value, const QString &reason)
+{
+    list << StorageDecision{setting, value, reason};
+}
+
+QString StorageTuning::deviceClass() const
+{
+    if (!info.valid)
+        return "unknown";
+    if (info.nvme)
+        return "nvme";
+    return info.isFlash() ? "ssd" : "hdd";
+}
+
+QByteArray StorageTuning::udevRules() const
+{
+    if (!info.valid)
+        return QByteArray();
+    // For every disk of the same kind, as kernel names are not stable.
+    // Partitions have no queue attributes, so each match excludes them.
+    QString match;
+    if (info.nvme)
+        match = "KERNEL==\"nvme[0-9]*n[0-9]*\", ENV{DEVTYPE}==\"disk\"";
+    else if (info.isFlash())
+        match = "KERNEL==\"sd[a-z]*|mmcblk[0-9]*|vd[a-z]*\", ATTR{queue/rotational}==\"0\"";
+    else
+        match = "KERNEL==\"sd[a-z]*|vd[a-z]*\", ATTR{queue/rotational}==\"1\"";
+    QString rule = QString("ACTION==\"add|change\", %1, ATTR{queue/scheduler}=\"%2\"").arg(match, scheduler);
+    if (readAheadKiB > 0)
+        rule += QString(", ATTR{queue/read_ahead_kb}=\"%1\"").arg(readAheadKiB);
+    return QString("# Written by the installer for %1 disks like /dev/%2;\n"
+                   "# the reasons are in /var/log/archhelp/storage.txt\n"
+                   "%3\n")
+        .arg(deviceClass(), info.name, rule)
+        .toUtf8();
+}
+
+QString StorageTuning::report() const
+{
+    QStringList lines;
+    for (const StorageDecision &d : list)
+        lines << QString("%1: %2 (%3)").arg(d.setting, d.value, d.reason);
+    return lines.join('\n') + '\n';
+}
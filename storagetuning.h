@@ -0,0 +1,52 @@
+#ifndef STORAGETUNING_H
+#define STORAGETUNING_H
+
+#include "blockdevice.h"
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+// One choice made for the installed system's storage and why
+struct StorageDecision {
+    QString setting;
+    QString value;
+    QString reason;
+};
+
+// Tuning of the installed system for the disk its root filesystem is on,
+// decided from what sysfs reports about that disk: the I/O scheduler and
+// read-ahead (as a udev rule for disks of the same kind), how freed blocks
+// are trimmed, and the root's mount options. Every choice, including
+// leaving a default alone, is a decision with a reason for the report.
+//
+//   StorageTuning tuning("/dev/nvme0n1p2", "ext4");
+//   config.writeFile(StorageTuning::rulesPath(), tuning.udevRules());
+//   for (const QString &unit : tuning.unitsToEnable()) ...
+class StorageTuning {
+public:
+    StorageTuning(const QString &rootDevice, const QString &fsType);
+
+    static QString rulesPath() { return "/etc/udev/rules.d/60-archhelp-storage.rules"; }
+
+    const BlockDeviceInfo &device() const { return info; }
+    // "nvme", "ssd", "hdd", or "unknown" when sysfs had nothing to say
+    QString deviceClass() const;
+    QList<StorageDecision> decisions() const { return list; }
+    // Empty when the disk is unknown
+    QByteArray udevRules() const;
+    QStringList unitsToEnable() const { return units; }
+    QString report() const;
+
+private:
+    void decide(const QString &setting, const QString &value, const QString &reason);
+
+    BlockDeviceInfo info;
+    QString fsType;
+    QString scheduler;
+    int readAheadKiB = 0;
+    QStringList units;
+    QList<StorageDecision> list;
+};
+
+#endif // STORAGETUNING_H
@@ -1,9 +1,34 @@
 #include "systemworker.h"
-#include <QProcess>
+#include "accountmanager.h"
+#include "blockdevice.h"
+#include "bootloaderstrategy.h"
+#include "commandrunner.h"
+#include "configeditor.h"
+#include "filesystemstrategy.h"
+#include "fstabgenerator.h"
+#include "installjournal.h"
+#include "keyringcache.h"
+#include "memoryconfig.h"
+#include "metricsexporter.h"
+#include "mountmanager.h"
+#include "perfbaseline.h"
+#include "progressmodel.h"
+#include "sharedinstallsource.h"
+#include "storagetuning.h"
+#include "tracer.h"
 #include <QFile>
+#include <QFileInfo>
 #include <QDir>
+#include <QDirIterator>
 #include <QMap>
+#include <QMutexLocker>
+#include <QRegularExpression>
+#include <QScopeGuard>
+#include <QStorageInfo>
+#include <QUrl>
 #include <QStringList>
+#include <functional>
+#include <memory>
 
 SystemWorker::SystemWorker(QObject *parent) : QObject(parent) {}
 
@@ -12,39 +37,410 @@ void SystemWorker::setParameters(const QString &drv,
                                  const QString &pass,
                                  const QString &rootPass,
                                  const QString &de,
-                                 bool efi) {
+                                 bool efi,
+                                 const QString &rootFs) {
     drive = drv;
     username = user;
     password = pass;
     rootPassword = rootPass;
     desktopEnv = de;
     useEfi = efi;
+    rootFilesystem = rootFs;
 }
 
-bool SystemWorker::runCommand(const QString &cmd) {
-    QProcess proc;
-    proc.start("/bin/bash", {"-c", cmd});
-    proc.waitForFinished(-1);
-    QString out = QString::fromUtf8(proc.readAllStandardOutput()).trimmed();
-    QString err = QString::fromUtf8(proc.readAllStandardError()).trimmed();
-    if (!out.isEmpty())
-        emit logMessage(out);
-    if (proc.exitCode() != 0) {
-        emit errorOccurred(err.isEmpty() ? QString("Failed: %1").arg(cmd)
-                                         : QString("%1\n%2").arg(cmd, err));
+void SystemWorker::setUserBatchFile(const QString &path) {
+    userBatchFile = path;
+}
+
+void SystemWorker::setTargetRoot(const QString &root) {
+    targetRoot = root;
+}
+
+void SystemWorker::setSharedSource(const std::shared_ptr<SharedInstallSource> &s) {
+    source = s;
+}
+
+void SystemWorker::setMetricsTarget(const QString &target) {
+    metricsTarget = target;
+}
+
+void SystemWorker::setInitramfsProfile(const InitramfsProfile &profile) {
+    initramfs = profile;
+}
+
+void SystemWorker::setMemory(const QString &mode, qint64 swapMiB) {
+    memoryMode = mode;
+    swapfileMiB = swapMiB;
+}
+
+void SystemWorker::setGovernor(const QString &name) {
+    governor = name;
+}
+
+void SystemWorker::setBootloader(const QString &name, const QStringList &devices) {
+    bootloader = name;
+    osProberDevices = devices;
+}
+
+bool SystemWorker::runCommand(const QStringList &argv) {
+    ProcessSpec spec;
+    spec.argv = CommandRunner::privileged(argv);
+    return runSpec(spec);
+}
+
+// Runs argv inside the target root. Anything sensitive the child needs goes
+// through stdin so it never shows up in argv or the log.
+bool SystemWorker::runChroot(const QStringList &argv, const QByteArray &stdinData) {
+    ProcessSpec spec;
+    spec.argv = argv;
+    spec.chrootDir = targetRoot;
+    spec.env = CommandRunner::chrootEnvironment();
+    spec.stdinData = stdinData;
+    return runSpec(spec);
+}
+
+namespace {
+
+// How long a program may run, how long it may stay silent, and how often it
+// is tried. A step over either limit is presumed hung (pacman-key waiting
+// for entropy, grub-install on a dead disk). pacman prints little while it
+// downloads, hence its long silence; only the network steps are retried.
+struct StepBudget {
+    int timeoutMs;
+    int stallMs;
+    int attempts;
+};
+
+const int Minute = 60 * 1000;
+const int RetryBackoffMs = 15 * 1000;
+
+StepBudget budgetFor(const QString &program) {
+    static const QMap<QString, StepBudget> budgets = {
+        {"pacman-key", {10 * Minute, 3 * Minute, 1}},
+        {"pacman", {90 * Minute, 15 * Minute, 3}},
+        {"wget", {30 * Minute, 5 * Minute, 3}},
+        {"unsquashfs", {60 * Minute, 10 * Minute, 1}},
+        {"mkinitcpio", {20 * Minute, 10 * Minute, 1}},
+        {"grub-install", {10 * Minute, 5 * Minute, 1}},
+        {"grub-mkconfig", {10 * Minute, 5 * Minute, 1}},
+    };
+    return budgets.value(program, {30 * Minute, 10 * Minute, 1});
+}
+
+} // namespace
+
+bool SystemWorker::runSpec(const ProcessSpec &command) {
+    // Output is forwarded line by line while the command runs; only a short
+    // tail is kept around for the error message.
+    CommandRunner runner([this](const QString &line, bool) {
+        if (line.trimmed().isEmpty())
+            return;
+        emit logMessage(line);
+        trackProgress(line);
+    });
+    ProcessSpec spec = command;
+    const QString program = spec.argv.value(spec.argv.value(0) == "sudo" ? 1 : 0).section('/', -1);
+    const StepBudget budget = budgetFor(program);
+    spec.timeoutMs = budget.timeoutMs;
+    spec.stallMs = budget.stallMs;
+
+    CommandResult result;
+    for (int attempt = 1;; ++attempt) {
+        result = runner.run(spec);
+        if (!result.watchdog.isEmpty() && !result.canceled) {
+            emit logMessage(QString("Watchdog stopped %1: %2").arg(spec.displayString(), result.watchdog));
+            for (const QString &line : std::as_const(result.processDump))
+                emit logMessage("  " + line);
+        }
+        if (result.ok() || result.canceled || attempt >= budget.attempts)
+            break;
+        // 15 s, 30 s, ... between attempts
+        int delayMs = RetryBackoffMs << (attempt - 1);
+        emit logMessage(QString("%1 failed, retrying in %2 s (attempt %3 of %4)")
+                            .arg(program).arg(delayMs / 1000).arg(attempt + 1).arg(budget.attempts));
+        MetricsExporter::instance(metricsTarget).addRetry(program);
+        if (!CommandRunner::sleepUnlessCanceled(delayMs)) {
+            result.canceled = true;
+            break;
+        }
+        // A pacman that was killed leaves its database lock behind
+        if (program == "pacman")
+            QFile::remove(targetRoot + "/var/lib/pacman/db.lck");
+    }
+
+    // Only report resource usage for steps long enough to matter
+    if (result.elapsedMs >= 1000)
+        emit logMessage(QString("(%1)").arg(result.usageSummary()));
+
+    if (result.canceled) {
+        stepFailed = true;
+        emit errorOccurred("Installation canceled");
+        return false;
+    }
+    if (!result.ok()) {
+        stepFailed = true;
+        QString cmd = spec.displayString();
+        if (!result.watchdog.isEmpty())
+            cmd += " (" + result.watchdog + ")";
+        QString tail = QString::fromLocal8Bit(result.tail.right(2048)).trimmed();
+        emit errorOccurred(tail.isEmpty() ? QString("Failed: %1").arg(cmd)
+                                          : QString("%1\n%2").arg(cmd, tail));
         return false;
     }
     return true;
 }
 
+// pacman inside the target. With a shared source the packages are fetched
+// into the shared cache first, under the download lock, so targets that
+// reach the same step together download each package once; the install
+// itself then runs from the cache without holding the lock.
+bool SystemWorker::runPacman(const QStringList &args) {
+    if (!source)
+        return runChroot(QStringList{"pacman"} + args);
+    {
+        QMutexLocker lock(&source->downloadLock());
+        PackageCacheState before = scanPackageCache();
+        bool ok = runChroot(QStringList{"pacman"} + args + QStringList{"--downloadonly"});
+        PackageCacheState after = scanPackageCache();
+        downloaded.files += qMax(0, after.files - before.files);
+        downloaded.bytes += qMax<qint64>(0, after.bytes - before.bytes);
+        if (!ok)
+            return false;
+    }
+    // The sync databases were refreshed by the download run
+    QStringList install = args;
+    install[0].remove('y');
+    return runChroot(QStringList{"pacman"} + install);
+}
+
+SystemWorker::PackageCacheState SystemWorker::scanPackageCache() const {
+    PackageCacheState state;
+    QDirIterator it(targetRoot + "/var/cache/pacman/pkg", {"*.pkg.tar.*"}, QDir::Files);
+    while (it.hasNext()) {
+        it.next();
+        if (it.fileName().endsWith(".sig"))
+            continue;
+        ++state.files;
+        state.bytes += it.fileInfo().size();
+    }
+    return state;
+}
+
+// A shared cache grows with every target's downloads; only what this
+// target fetched itself is its own
+SystemWorker::PackageCacheState SystemWorker::packageCacheState() const {
+    return source ? downloaded : scanPackageCache();
+}
+
+// Host of the first mirror pacman will use in the target
+static QString mirrorHost(const QString &root) {
+    QFile f(root + "/etc/pacman.d/mirrorlist");
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text))
+        return "unknown";
+    for (const QByteArray &raw : f.readAll().split('\n')) {
+        QString line = QString::fromUtf8(raw).trimmed();
+        if (line.startsWith("Server"))
+            return QUrl(line.section('=', 1).trimmed()).host();
+    }
+    return "unknown";
+}
+
+// A pacman phase's packages are cache hits unless a new package file
+// appeared in the cache; the growth of the cache is what was downloaded.
+void SystemWorker::accountPackageCache(const PackageCacheState &before) {
+    MetricsExporter &metrics = MetricsExporter::instance(metricsTarget);
+    if (!metrics.isEnabled() || !progress || progress->totalUnits() <= 0)
+        return;
+    PackageCacheState after = packageCacheState();
+    int packages = static_cast<int>(progress->totalUnits());
+    int downloaded = qBound(0, after.files - before.files, packages);
+    metrics.setPackageCount(progress->currentPhase(), packages);
+    metrics.countCache("pacman", true, packages - downloaded);
+    metrics.countCache("pacman", false, downloaded);
+    metrics.addDownloadBytes(mirrorHost(targetRoot), after.bytes - before.bytes);
+}
+
+// Logs and exports what the Initramfs step built, and leaves the same in
+// the target next to the boot times the installed system records
+void SystemWorker::reportInitramfs(const QString &dir, const QStringList &filter, double seconds) {
+    QMap<QString, qint64> sizes;
+    QStringList lines{"profile: " + initramfs.describe(),
+                      QString("build: %1 s").arg(seconds, 0, 'f', 1)};
+    for (const QFileInfo &image : QDir(dir).entryInfoList(filter, QDir::Files)) {
+        sizes.insert(image.fileName(), image.size());
+        lines << QString("%1: %2 KiB").arg(image.fileName()).arg(image.size() / 1024);
+    }
+    emit logMessage("Initramfs " + lines.join(", "));
+    MetricsExporter::instance(metricsTarget).setInitramfs(sizes, seconds);
+    ConfigEditor config(targetRoot);
+    if (!config.writeFile("/var/log/archhelp/initramfs.txt", (lines.join('\n') + '\n').toUtf8()))
+        emit logMessage(config.errorString());
+}
+
+void SystemWorker::exportMetrics(bool completed) {
+    MetricsExporter &metrics = MetricsExporter::instance(metricsTarget);
+    if (!metrics.isEnabled() || !progress)
+        return;
+    for (const QString &phase : progress->phases()) {
+        double seconds = progress->phaseSeconds(phase);
+        if (seconds >= 0)
+            metrics.setPhaseDuration(phase, seconds);
+    }
+    double extractSeconds = progress->phaseSeconds("Extract rootfs");
+    if (extractSeconds > 0)
+        metrics.setExtraction(static_cast<qint64>(progress->phaseUnits("Extract rootfs")), extractSeconds);
+    metrics.setOutcome(completed, progress->currentPhase());
+    if (!metrics.write())
+        emit logMessage("Could not write install metrics");
+}
+
+// Picks progress out of command output: pacman's "(n/total) installing"
+// lines and the percentage unsquashfs redraws.
+void SystemWorker::trackProgress(const QString &line) {
+    if (!progress)
+        return;
+    static const QRegularExpression pacmanStep("^\\(\\s*(\\d+)/(\\d+)\\) (installing|upgrading|reinstalling) ");
+    static const QRegularExpression percent("\\s(\\d{1,3})%$");
+    QRegularExpressionMatch m = pacmanStep.match(line);
+    if (m.hasMatch()) {
+        // Packages are the work units of pacman phases
+        progress->setTotalUnits(m.captured(2).toDouble());
+        progress->advance(m.captured(1).toDouble());
+    } else if (progress->currentPhase() == "Extract rootfs" && (m = percent.match(line)).hasMatch()) {
+        progress->advance(m.captured(1).toDouble() / 100.0 * progress->totalUnits());
+    } else {
+        return;
+    }
+    reportProgress();
+}
+
+void SystemWorker::reportProgress(bool force) {
+    if (!progress)
+        return;
+    // Output can arrive thousands of lines a second; the bar does not need that
+    if (!force && progressThrottle.isValid() && progressThrottle.elapsed() < 250)
+        return;
+    progressThrottle.start();
+    emit progressChanged(qRound(progress->fraction() * 1000), progress->etaSeconds());
+}
+
 void SystemWorker::run() {
     emit logMessage("\xF0\x9F\x9A\x80 Starting system installation...");
 
-    QString isoPath = "/mnt/archlinux.iso";
-    if (!QFile::exists(isoPath)) {
-        QString tmpIso = QDir::tempPath() + "/archlinux.iso";
+    // Trade durability for speed while the rootfs is written; the profile
+    // is reverted before fstab is generated or if we return early.
+    InstallMountProfile mountProfile(targetRoot, [this](const QString &msg) { emit logMessage(msg); });
+
+    std::unique_ptr<FilesystemStrategy> fs = FilesystemStrategy::create(rootFilesystem);
+    if (!fs) {
+        emit errorOccurred("Unsupported root filesystem: " + rootFilesystem);
+        return;
+    }
+    std::unique_ptr<BootloaderStrategy> boot = BootloaderStrategy::create(bootloader, osProberDevices);
+    if (!boot) {
+        emit errorOccurred("Unsupported bootloader: " + bootloader);
+        return;
+    }
+    if (!useEfi && !boot->supportsBios()) {
+        emit errorOccurred(bootloader + " needs a UEFI install");
+        return;
+    }
+    QString rootDevice;
+    for (const MountEntry &e : MountManager::mountsFor(targetRoot))
+        if (e.mountPoint == targetRoot)
+            rootDevice = e.source;
+    BootTarget bootTarget;
+    bootTarget.drive = drive;
+    bootTarget.efi = useEfi;
+    bootTarget.rootFsType = fs->name();
+    // fstab needs it as well, so an unidentifiable root fails here already
+    SuperblockInfo rootInfo;
+    if (!SuperblockInfo::probe(rootDevice, &rootInfo)) {
+        emit errorOccurred("Cannot identify the root filesystem mounted on " + targetRoot);
+        return;
+    }
+    bootTarget.rootUuid = rootInfo.uuid;
+    const qint64 writtenAtStart = FilesystemStrategy::bytesWritten(rootDevice);
+
+    // Rough durations for a host without history, in seconds
+    progress.reset(new ProgressModel({{"Copy ISO", 10},
+                                      {"Extract rootfs", 120},
+                                      {"Keyring", 60},
+                                      {"Performance baseline", 10},
+                                      {"Base packages", 240},
+                                      {"Initramfs", 60},
+                                      {"Locale and time", 15},
+                                      {"Storage tuning", 2},
+                                      {"Memory", 20},
+                                      {"Bootloader", 60},
+                                      {"System update", 60},
+                                      {"Accounts", 2},
+                                      {"Desktop", 600},
+                                      {"Flush and remount", 20},
+                                      {"fstab", 1}}));
+    progress->loadHistory();
+
+    MetricsExporter &metrics = MetricsExporter::instance(metricsTarget);
+    metrics.setInfo("drive", drive);
+    metrics.setInfo("rootfs", rootFilesystem);
+    metrics.setInfo("desktop", desktopEnv);
+    metrics.setInfo("boot", useEfi ? "uefi" : "bios");
+    metrics.setInfo("bootloader", boot->name());
+    metrics.setInfo("initramfs", initramfs.name);
+    // Written on every way out of run(), failures included
+    bool completed = false;
+    auto metricsGuard = qScopeGuard([this, &completed]() { exportMetrics(completed); });
+
+    TraceSpan install("install", "System installation");
+    install.setDetail("/dev/" + drive);
+    TraceSpan step("step", "Copy ISO");
+    PackageCacheState cacheAtStep;
+    auto beginStep = [this, &step, &cacheAtStep](const QString &name) {
+        accountPackageCache(cacheAtStep);
+        if (MetricsExporter::instance(metricsTarget).isEnabled())
+            cacheAtStep = packageCacheState();
+        step.next(name);
+        progress->begin(name);
+        reportProgress(true);
+    };
+    // Steps an earlier, failed run on this target completed are skipped when
+    // their inputs are unchanged and their result is still in place; the
+    // install resumes at the first step that has to run again
+    InstallJournal journal(targetRoot);
+    if (!journal.load())
+        emit logMessage(journal.errorString() + "; starting from the beginning");
+    auto needed = [this, &journal](const QString &id, const QStringList &inputs,
+                                   const std::function<bool()> &verify) {
+        QByteArray hash = InstallJournal::hashInputs(inputs);
+        if (journal.isComplete(id, hash) && verify()) {
+            journal.skip();
+            emit logMessage(id + " already done, skipped");
+            return false;
+        }
+        if (!journal.begin(id, hash))
+            emit logMessage(journal.errorString());
+        stepFailed = false;
+        return true;
+    };
+    // A step is journaled as done only when nothing in it failed, so a
+    // rerun repeats it; a canceled run records nothing more
+    auto completeStep = [this, &journal]() {
+        if (!stepFailed && !CommandRunner::isCanceled() && !journal.complete())
+            emit logMessage(journal.errorString());
+    };
+    auto exists = [this](const QString &path) { return QFileInfo::exists(targetRoot + path); };
+
+    progress->begin("Copy ISO");
+    // With a shared source the ISO is already mounted for all targets
+    QString isoPath = targetRoot + "/archlinux.iso";
+    QString tmpIso = QDir::tempPath() + "/archlinux.iso";
+    QFileInfo iso(source ? source->isoPath() : QFile::exists(isoPath) ? isoPath : tmpIso);
+    bool extract = needed("Extract rootfs",
+                          {iso.exists() ? iso.fileName() : QString(), QString::number(iso.size())},
+                          [&exists]() { return exists("/usr/bin/pacman"); });
+    if (extract && !source && !QFile::exists(isoPath)) {
         if (QFile::exists(tmpIso)) {
-            if (!runCommand(QString("sudo cp %1 %2").arg(tmpIso, isoPath)))
+            if (!runCommand({"cp", tmpIso, isoPath}))
                 return;
         } else {
             emit errorOccurred("Arch Linux ISO not found");
@@ -52,111 +448,362 @@ void SystemWorker::run() {
         }
     }
 
-    QDir().mkdir("/mnt/archiso");
-    QDir().mkdir("/mnt/rootfs");
+    beginStep("Extract rootfs");
+    if (extract) {
+        QString squashfsPath;
+        if (source) {
+            squashfsPath = source->squashfsPath();
+        } else {
+            QDir().mkdir(targetRoot + "/archiso");
+            QDir().mkdir(targetRoot + "/rootfs");
+            // Still mounted when an earlier run failed during extraction
+            MountManager::unmountAll(targetRoot + "/archiso", QString(),
+                                     [this](const QString &msg) { emit logMessage(msg); });
+            if (!runCommand({"mount", "-o", "loop,ro", isoPath, targetRoot + "/archiso"}))
+                return;
+            squashfsPath = targetRoot + "/archiso/arch/x86_64/airootfs.sfs";
+        }
 
-    if (!runCommand(QString("sudo mount -o loop %1 /mnt/archiso").arg(isoPath)))
-        return;
+        step.setBytes(QFileInfo(squashfsPath).size());
+        progress->setTotalUnits(QFileInfo(squashfsPath).size());
+        if (!runCommand({"unsquashfs", "-f", "-d", targetRoot, squashfsPath}))
+            return;
 
-    QString squashfsPath = "/mnt/archiso/arch/x86_64/airootfs.sfs";
-    if (!runCommand(QString("sudo unsquashfs -f -d /mnt %1").arg(squashfsPath)))
-        return;
+        emit logMessage("ISO mounted and rootfs extracted");
+        if (!source)
+            MountManager::unmountAll(targetRoot + "/archiso", QString(),
+                                     [this](const QString &msg) { emit logMessage(msg); });
 
-    emit logMessage("ISO mounted and rootfs extracted");
-    runCommand("sudo umount -Rfl /mnt/archiso");
+        if (!QFile::exists(targetRoot + "/usr/bin/pacman")) {
+            QString bootstrapUrl = "https://mirrors.edge.kernel.org/archlinux/iso/latest/archlinux-bootstrap-x86_64.tar.gz";
+            // One tarball per target; concurrent installs must not share it
+            QString tarball = QString("%1/arch-bootstrap-%2.tar.gz").arg(QDir::tempPath(), drive);
+            if (!runCommand({"wget", "-O", tarball, bootstrapUrl}))
+                return;
+            metrics.addDownloadBytes(QUrl(bootstrapUrl).host(), QFileInfo(tarball).size());
+            if (!runCommand({"tar", "-xzf", tarball, "-C", targetRoot, "--strip-components=1"}))
+                return;
+        }
+    }
+    completeStep();
 
-    runCommand("sudo rm -f /mnt/etc/resolv.conf");
-    runCommand("sudo cp /etc/resolv.conf /mnt/etc/resolv.conf");
+    QFile::remove(targetRoot + "/etc/resolv.conf");
+    QFile::copy("/etc/resolv.conf", targetRoot + "/etc/resolv.conf");
 
-    if (!QFile::exists("/mnt/usr/bin/pacman")) {
-        QString bootstrapUrl = "https://mirrors.edge.kernel.org/archlinux/iso/latest/archlinux-bootstrap-x86_64.tar.gz";
-        if (!runCommand(QString("sudo wget -O /tmp/arch-bootstrap.tar.gz %1").arg(bootstrapUrl)))
-            return;
-        if (!runCommand("sudo tar -xzf /tmp/arch-bootstrap.tar.gz -C /mnt --strip-components=1"))
-            return;
+    // API filesystems for everything run inside the target from here on
+    ChrootSession chroot(targetRoot, [this](const QString &msg) { emit logMessage(msg); });
+    if (!chroot.isValid()) {
+        emit errorOccurred("Could not prepare the chroot at " + targetRoot);
+        return;
     }
-
-    runCommand("sudo arch-chroot /mnt pacman-key --init");
-    runCommand("sudo arch-chroot /mnt pacman-key --populate archlinux");
-    runCommand("sudo arch-chroot /mnt pacman -Sy --noconfirm archlinux-keyring");
-
-    // Remove leftover firmware files from the live ISO to avoid conflicts
-    runCommand("sudo rm -rf /mnt/usr/lib/firmware/nvidia");
-
-    emit logMessage("Installing base, linux, linux-firmware…");
-    // Reinstall the kernel even if the ISO's rootfs already contains the
-    // package so /boot/vmlinuz-linux is ensured to exist
-    if (!runCommand("sudo arch-chroot /mnt pacman -Sy --noconfirm base linux linux-firmware"))
-        return;
-
-    // Ensure mkinitcpio presets do not reference the live ISO configuration
-    QString presetContent =
-        "# mkinitcpio preset file for the 'linux' package\n"
-        "ALL_config=\"/etc/mkinitcpio.conf\"\n"
-        "ALL_kver=\"/boot/vmlinuz-linux\"\n"
-        "\n"
-        "PRESETS=(\n"
-        "  default\n"
-        "  fallback\n"
-        ")\n"
-        "\n"
-        "default_image=\"/boot/initramfs-linux.img\"\n"
-        "fallback_image=\"/boot/initramfs-linux-fallback.img\"\n"
-        "fallback_options=\"-S autodetect\"\n";
-    QFile presetFile("/tmp/linux.preset");
-    if (presetFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        presetFile.write(presetContent.toUtf8());
-        presetFile.close();
-    }
-    runCommand("sudo cp /tmp/linux.preset /mnt/etc/mkinitcpio.d/linux.preset");
-
-    runCommand("sudo arch-chroot /mnt systemctl enable systemd-timesyncd.service");
-    runCommand("sudo arch-chroot /mnt rm -f /etc/mkinitcpio.conf.d/archiso.conf");
-    runCommand("sudo arch-chroot /mnt sed -i 's/archiso[^ ]* *//g' /etc/mkinitcpio.conf");
-    runCommand("sudo arch-chroot /mnt rm -f /boot/initramfs-linux*");
-    runCommand("sudo arch-chroot /mnt mkinitcpio -P");
-
-    runCommand("sudo arch-chroot /mnt bash -c 'echo archlinux > /etc/hostname'");
-    runCommand("sudo arch-chroot /mnt sed -i 's/^#en_US.UTF-8/en_US.UTF-8/' /etc/locale.gen");
-    runCommand("sudo arch-chroot /mnt locale-gen");
-    runCommand("sudo arch-chroot /mnt bash -c 'echo LANG=en_US.UTF-8 > /etc/locale.conf'");
-    runCommand("sudo arch-chroot /mnt ln -sf /usr/share/zoneinfo/UTC /etc/localtime");
-    runCommand("sudo arch-chroot /mnt hwclock --systohc");
-    runCommand("sudo arch-chroot /mnt mkdir -p /boot/grub");
-
-    emit logMessage("Installing GRUB…");
-    if (!runCommand("sudo arch-chroot /mnt pacman -Sy --noconfirm grub os-prober --needed"))
-        return;
-    runCommand("sudo arch-chroot /mnt sed -i '/2025-05-01-10-09-37-00/d' /etc/default/grub");
-    runCommand("sudo arch-chroot /mnt bash -c \"echo 'GRUB_DISABLE_LINUX_UUID=false' >> /etc/default/grub\"");
-
-    QString grubCmd;
-    if (useEfi) {
-        grubCmd = "sudo arch-chroot /mnt grub-install --target=x86_64-efi --efi-directory=/boot --bootloader-id=GRUB";
-    } else {
-        grubCmd = QString("sudo arch-chroot /mnt grub-install --target=i386-pc /dev/%1").arg(drive);
+    if (source && !source->attachPackageCache(targetRoot, [this](const QString &msg) { emit logMessage(msg); })) {
+        emit errorOccurred("Could not attach the shared package cache");
+        return;
     }
+    auto cacheGuard = qScopeGuard([this]() {
+        if (source)
+            source->detachPackageCache(targetRoot, [this](const QString &msg) { emit logMessage(msg); });
+    });
+
+    // Config files are edited in place; a failed edit is reported but, like
+    // the commands around it, does not stop the install. Every edit below
+    // leaves the file as it found it when run a second time.
+    ConfigEditor config(targetRoot);
+    auto checkEdit = [this, &config](bool ok) {
+        if (!ok) {
+            stepFailed = true;
+            emit errorOccurred(config.errorString());
+        }
+    };
 
-    emit logMessage(grubCmd);
-
+    beginStep("Keyring");
+    if (needed("Keyring", {}, [&exists]() { return exists("/etc/pacman.d/gnupg/trustdb.gpg"); })) {
+        // A keyring cached for the version the mirror offers is copied in and
+        // only its master key generated anew. Its --noscriptlet install skips
+        // the populate the package runs on upgrade; the copy is populated
+        // from that same version.
+        auto log = [this](const QString &msg) { emit logMessage(msg); };
+        KeyringCache keyrings;
+        runChroot({"pacman", "-Sy"});
+        const QString version = KeyringCache::availableVersion(targetRoot);
+        const bool cached = keyrings.contains(version);
+        bool restored = cached && keyrings.restore(version, targetRoot, log)
+                        && runPacman({"-S", "--needed", "--noconfirm", "--noscriptlet", "archlinux-keyring"})
+                        && KeyringCache::renewMasterKey(targetRoot, log);
+        metrics.countCache("keyring", restored, 1);
+        if (restored) {
+            emit logMessage("Keyring " + version + " restored from cache");
+        } else {
+            if (cached) {
+                emit logMessage("Cached keyring unusable, initializing a new one");
+                QDir(targetRoot + "/etc/pacman.d/gnupg").removeRecursively();
+            }
+            runChroot({"pacman-key", "--init"});
+            runChroot({"pacman-key", "--populate", "archlinux"});
+            runPacman({"-Sy", "--noconfirm", "archlinux-keyring"});
+            keyrings.store(KeyringCache::installedVersion(targetRoot), targetRoot, log);
+        }
 
+        // Remove leftover firmware files from the live ISO to avoid conflicts
+        QDir(targetRoot + "/usr/lib/firmware/nvidia").removeRecursively();
+    }
+    completeStep();
+
+    // Before the big downloads, which pacman then runs in parallel; the
+    // microcode goes in with the kernel so the Initramfs step finds it
+    beginStep("Performance baseline");
+    const PerfBaseline baseline(governor);
+    metrics.setInfo("cpu", baseline.vendor());
+    if (needed("Performance baseline", baseline.report(),
+               [&exists]() { return exists(PerfBaseline::makepkgPath()); })) {
+        for (const QString &line : baseline.report())
+            emit logMessage("Performance: " + line);
+        checkEdit(config.setValue("/etc/pacman.conf", "ParallelDownloads",
+                                  QString::number(baseline.parallelDownloads()), "options"));
+        checkEdit(config.writeFile(PerfBaseline::makepkgPath(), baseline.makepkgConfig()));
+        if (!baseline.packages().isEmpty()
+            && !runPacman(QStringList{"-Sy", "--noconfirm", "--needed"} + baseline.packages()))
+            return;
+        if (!baseline.tmpfilesConfig().isEmpty())
+            checkEdit(config.writeFile(PerfBaseline::tmpfilesPath(), baseline.tmpfilesConfig()));
+        for (const QString &unit : baseline.unitsToEnable())
+            runChroot({"systemctl", "enable", unit});
+        checkEdit(config.writeFile("/var/log/archhelp/performance.txt",
+                                   (baseline.report().join('\n') + '\n').toUtf8()));
+    }
+    completeStep();
+
+    beginStep("Base packages");
+    QStringList basePackages = QStringList{"base", "linux", "linux-firmware"} + fs->packages();
+    if (!baseline.microcodePackage().isEmpty())
+        basePackages << baseline.microcodePackage();
+    if (needed("Base packages", basePackages, [&exists]() { return exists("/boot/vmlinuz-linux"); })) {
+        emit logMessage("Installing base, linux, linux-firmware…");
+        // Reinstall the kernel even if the ISO's rootfs already contains the
+        // package so /boot/vmlinuz-linux is ensured to exist
+        if (!runPacman(QStringList{"-Sy", "--noconfirm"} + basePackages))
+            return;
+    }
+    completeStep();
+
+    beginStep("Initramfs");
+    if (needed("Initramfs", {fs->name(), boot->name(), initramfs.describe(), baseline.microcodePackage()},
+               [&exists, &boot]() { return exists(boot->initramfsImage()); })) {
+        // Ensure mkinitcpio presets do not reference the live ISO configuration
+        checkEdit(config.writeFile("/etc/mkinitcpio.d/linux.preset",
+                                   boot->mkinitcpioPreset(initramfs.fallback).toUtf8()));
+        checkEdit(boot->prepareInitramfs(config, bootTarget));
+        const QFileInfo image(targetRoot + boot->initramfsImage());
+        QDir().mkpath(image.absolutePath());
+
+        runChroot({"systemctl", "enable", "systemd-timesyncd.service"});
+        QFile::remove(targetRoot + "/etc/mkinitcpio.conf.d/archiso.conf");
+        checkEdit(config.replaceInLines("/etc/mkinitcpio.conf", QRegularExpression("archiso\\S* *"), QString()) >= 0);
+        for (const QString &hook : fs->initcpioHooksToDrop())
+            checkEdit(config.replaceInLines("/etc/mkinitcpio.conf",
+                                            QRegularExpression(QString("^(HOOKS=.*) %1\\b").arg(hook)),
+                                            "\\1") >= 0);
+        if (initramfs.systemdHooks)
+            checkEdit(config.setValue("/etc/mkinitcpio.conf", "HOOKS",
+                                      "(" + initramfs.systemdHookSet(fs->initcpioHooksToDrop()).join(' ') + ")"));
+        // The hook puts the microcode in front of the image, which covers
+        // UKIs as well as GRUB; mkinitcpio.conf files older than it lack it
+        if (!config.contains("/etc/mkinitcpio.conf", QRegularExpression("^HOOKS=.*\\bmicrocode\\b")))
+            checkEdit(config.replaceInLines("/etc/mkinitcpio.conf",
+                                            QRegularExpression("^(HOOKS=.*\\bautodetect)\\b"), "\\1 microcode",
+                                            true) >= 0);
+        if (!initramfs.compression.isEmpty()) {
+            // Modules are decompressed while building, so booting only
+            // decompresses the image as a whole
+            checkEdit(config.setValues("/etc/mkinitcpio.conf",
+                                       {{"COMPRESSION", "\"" + initramfs.compression + "\""},
+                                        {"COMPRESSION_OPTIONS", "(" + initramfs.compressionOptions().join(' ') + ")"},
+                                        {"MODULES_DECOMPRESS", "\"yes\""}}));
+        }
+        // Prepended once; a rerun finds the modules already in front
+        QStringList moduleList = fs->initcpioModules();
+        if (initramfs.storageModules)
+            moduleList += storageDriverModules(rootDevice);
+        QString modules = moduleList.join(' ');
+        if (!modules.isEmpty()
+            && !config.contains("/etc/mkinitcpio.conf",
+                                QRegularExpression("^MODULES=\\(" + QRegularExpression::escape(modules) + "\\b")))
+            checkEdit(config.replaceInLines("/etc/mkinitcpio.conf", QRegularExpression("^MODULES=\\("),
+                                            QString("MODULES=(%1 ").arg(modules), true) >= 0);
+        // initramfs-linux* or arch-linux*, the fallback of an earlier profile included
+        const QStringList imageFilter{image.completeBaseName() + "*"};
+        for (const QString &old : image.dir().entryList(imageFilter, QDir::Files))
+            QFile::remove(image.dir().filePath(old));
+        QElapsedTimer buildTimer;
+        buildTimer.start();
+        runChroot({"mkinitcpio", "-P"});
+        reportInitramfs(image.dir().absolutePath(), imageFilter, buildTimer.elapsed() / 1000.0);
+    }
+    completeStep();
+
+    beginStep("Locale and time");
+    if (needed("Locale and time", {"archlinux", "en_US.UTF-8", "UTC"},
+               [&exists]() { return exists("/etc/locale.conf"); })) {
+        checkEdit(config.writeFile("/etc/hostname", "archlinux\n"));
+        // Uncommented by an earlier run counts as done
+        if (!config.contains("/etc/locale.gen", QRegularExpression("^en_US\\.UTF-8")))
+            checkEdit(config.replaceInLines("/etc/locale.gen", QRegularExpression("^#(en_US\\.UTF-8)"), "\\1",
+                                            true) >= 0);
+        runChroot({"locale-gen"});
+        checkEdit(config.setValue("/etc/locale.conf", "LANG", "en_US.UTF-8"));
+        checkEdit(config.symlink("/usr/share/zoneinfo/UTC", "/etc/localtime"));
+        runChroot({"hwclock", "--systohc"});
+    }
+    completeStep();
+
+    // Scheduler, read-ahead, TRIM and mount options for the disk the root is
+    // on; fstab picks up the same mount options when it is generated
+    beginStep("Storage tuning");
+    const StorageTuning tuning(rootDevice, fs->name());
+    metrics.setInfo("storage", tuning.deviceClass());
+    if (needed("Storage tuning", {tuning.report()},
+               [&exists, &tuning]() { return tuning.udevRules().isEmpty() || exists(StorageTuning::rulesPath()); })) {
+        for (const StorageDecision &d : tuning.decisions())
+            emit logMessage(QString("Storage: %1 = %2 (%3)").arg(d.setting, d.value, d.reason));
+        if (!tuning.udevRules().isEmpty())
+            checkEdit(config.writeFile(StorageTuning::rulesPath(), tuning.udevRules()));
+        for (const QString &unit : tuning.unitsToEnable())
+            runChroot({"systemctl", "enable", unit});
+        checkEdit(config.writeFile("/var/log/archhelp/storage.txt", tuning.report().toUtf8()));
+    }
+    completeStep();
+
+    // Swap for the installed system. zram is set up at boot by
+    // zram-generator; the swap file is allocated now and listed in fstab,
+    // but never switched on for the host.
+    beginStep("Memory");
+    const MemoryConfig memory(memoryMode, MemoryConfig::totalRam(), swapfileMiB);
+    const QString swapfile = fs->swapfilePath();
+    QStringList swapKinds;
+    if (memory.zram())
+        swapKinds << "zram";
+    if (memory.swapfileMiB() > 0)
+        swapKinds << "swapfile";
+    metrics.setInfo("memory", swapKinds.isEmpty() ? QString("none") : swapKinds.join('+'));
+    auto memoryReady = [&exists, &memory, &swapfile]() {
+        return (!memory.zram() || exists(MemoryConfig::zramGeneratorPath()))
+               && (memory.swapfileMiB() == 0 || exists(swapfile));
+    };
+    if (needed("Memory", memory.report(), memoryReady)) {
+        for (const QString &line : memory.report())
+            emit logMessage("Memory: " + line);
+        if (memory.zram()) {
+            if (!runPacman({"-Sy", "--noconfirm", "--needed", "zram-generator"}))
+                return;
+            checkEdit(config.writeFile(MemoryConfig::zramGeneratorPath(), memory.zramGeneratorConfig()));
+        }
+        if (memory.swapfileMiB() > 0) {
+            // Whatever an earlier attempt left is made again from scratch
+            MountManager::swapOffDevice(QString(), targetRoot + swapfile,
+                                        [this](const QString &msg) { emit logMessage(msg); });
+            QFile::remove(targetRoot + swapfile);
+            // The desktop still has to fit next to it
+            const qint64 needMiB = memory.swapfileMiB() + 8192;
+            if (QStorageInfo(targetRoot).bytesAvailable() / 1048576 < needMiB) {
+                emit logMessage(QString("Less than %1 MiB free on the root, no swap file").arg(needMiB));
+            } else {
+                const bool directoryExists = QFileInfo::exists(targetRoot + QFileInfo(swapfile).path());
+                for (const QStringList &command : fs->swapfileCommands(memory.swapfileMiB(), directoryExists)) {
+                    if (!runChroot(command)) {
+                        QFile::remove(targetRoot + swapfile);
+                        break;
+                    }
+                }
+            }
+        }
+        if (!memory.sysctlConfig().isEmpty())
+            checkEdit(config.writeFile(MemoryConfig::sysctlPath(), memory.sysctlConfig()));
+        checkEdit(config.writeFile("/var/log/archhelp/memory.txt", (memory.report().join('\n') + '\n').toUtf8()));
+    }
+    completeStep();
+
+    beginStep("Bootloader");
+    if (needed("Bootloader", QStringList{useEfi ? "uefi" : "bios", drive, boot->name()} + osProberDevices,
+               [&exists, &boot]() { return exists(boot->installedMarker()); })) {
+        emit logMessage("Installing " + boot->name() + "…");
+        if (!boot->packages().isEmpty()
+            && !runPacman(QStringList{"-Sy", "--noconfirm", "--needed"} + boot->packages()))
+            return;
+        checkEdit(boot->configure(config, bootTarget));
+        for (const QStringList &command : boot->installCommands(bootTarget)) {
+            emit logMessage(command.join(' '));
+            if (!runChroot(command))
+                return;
+        }
 
+        // The installed system records its own boot time once it has
+        // settled, so bootloaders can be compared on real hardware
+        checkEdit(config.writeFile("/etc/systemd/system/archhelp-boot-time.service",
+                                   "[Unit]\n"
+                                   "Description=Record how long the last boot took\n"
+                                   "\n"
+                                   "[Service]\n"
+                                   "Type=oneshot\n"
+                                   "ExecStart=/bin/sh -c 'mkdir -p /var/log/archhelp && "
+                                   "{ systemd-analyze time; systemd-analyze blame | head -n 20; } "
+                                   "> /var/log/archhelp/boot-time.txt'\n"
+                                   "ExecStart=/bin/sh -c '[ -e /var/log/archhelp/first-boot-time.txt ] || "
+                                   "cp /var/log/archhelp/boot-time.txt /var/log/archhelp/first-boot-time.txt'\n"));
+        checkEdit(config.writeFile("/etc/systemd/system/archhelp-boot-time.timer",
+                                   "[Unit]\n"
+                                   "Description=Record the boot time once the boot has finished\n"
+                                   "\n"
+                                   "[Timer]\n"
+                                   "OnBootSec=2min\n"
+                                   "\n"
+                                   "[Install]\n"
+                                   "WantedBy=timers.target\n"));
+        runChroot({"systemctl", "enable", "archhelp-boot-time.timer"});
+    }
+    completeStep();
 
-    if (!runCommand(grubCmd))
-        return;
-    if (!runCommand("sudo arch-chroot /mnt grub-mkconfig -o /boot/grub/grub.cfg"))
-        return;
-    if (!runCommand("sudo arch-chroot /mnt pacman -Syu --noconfirm"))
+    // Not journaled: nothing on disk tells whether it ran, and on an up to
+    // date system it only refreshes the databases
+    beginStep("System update");
+    if (!runPacman({"-Syu", "--noconfirm"}))
         return;
     emit logMessage("System packages updated");
 
+    // Not journaled: it takes a second, rewriting the accounts is harmless,
+    // and its inputs are passwords, which have no business in the journal
+    beginStep("Accounts");
     emit logMessage("Adding user and configuring system.");
     emit logMessage("This will take a few…");
-    runCommand(QString("sudo arch-chroot /mnt useradd -m -G wheel %1").arg(username));
-    runCommand(QString("sudo arch-chroot /mnt bash -c \"echo '%1:%2' | chpasswd\"" ).arg(username, password));
-    runCommand(QString("sudo arch-chroot /mnt bash -c \"echo 'root:%1' | chpasswd\"" ).arg(rootPassword));
-    runCommand("sudo arch-chroot /mnt sed -i 's/^# %wheel ALL=(ALL:ALL) ALL/%wheel ALL=(ALL:ALL) ALL/' /etc/sudoers");
+    AccountManager accounts(targetRoot);
+    UserAccount user;
+    user.name = username;
+    user.password = password;
+    user.groups = {"wheel"};
+    QList<UserAccount> users{user};
+    if (!userBatchFile.isEmpty()) {
+        QString batchError;
+        QList<UserAccount> batch = AccountManager::parseBatchFile(userBatchFile, &batchError);
+        if (!batchError.isEmpty())
+            emit errorOccurred(batchError);
+        users += batch;
+    }
+    bool accountsOk = accounts.load();
+    for (const UserAccount &u : std::as_const(users)) {
+        accountsOk = accountsOk && accounts.addUser(u);
+        if (accountsOk)
+            emit logMessage("Added user " + u.name);
+    }
+    if (!accountsOk || !accounts.setPassword("root", rootPassword) || !accounts.save()) {
+        emit errorOccurred(accounts.errorString());
+        return;
+    }
+    // Already enabled counts as success; anything else leaves wheel without sudo
+    static const QRegularExpression wheelRule("^%wheel ALL=\\(ALL:ALL\\) ALL$");
+    if (!config.contains("/etc/sudoers", wheelRule))
+        checkEdit(config.replaceInLines("/etc/sudoers", QRegularExpression("^# (%wheel ALL=\\(ALL:ALL\\) ALL)$"),
+                                        "\\1", true) >= 0);
 
+    beginStep("Desktop");
     QMap<QString, QStringList> desktopPackages = {
         {"GNOME", {"xorg", "gnome", "gdm"}},
         {"KDE Plasma", {"xorg", "plasma", "sddm", "kde-applications"}},
@@ -172,41 +819,89 @@ void SystemWorker::run() {
         return;
     }
 
-    QString pkgCmd = QString("sudo arch-chroot /mnt pacman -Sy --noconfirm %1").arg(desktopPackages.value(desktopEnv).join(' '));
-    if (!runCommand(pkgCmd))
-        return;
-
-
-        emit logMessage(pkgCmd);
-
-
-
-    QString dmService;
-    if (desktopEnv == "GNOME") dmService = "gdm.service";
-    else if (desktopEnv == "KDE Plasma" || desktopEnv == "LXQt") dmService = "sddm.service";
-    else dmService = "lightdm.service";
-
-    runCommand(QString("sudo arch-chroot /mnt systemctl enable %1").arg(dmService));
+    // systemctl enable links the display manager here
+    auto dmEnabled = [this]() {
+        return QFileInfo(targetRoot + "/etc/systemd/system/display-manager.service").isSymLink();
+    };
+    if (needed("Desktop", desktopPackages.value(desktopEnv), dmEnabled)) {
+        QStringList pkgArgs = QStringList{"-Sy", "--noconfirm"} + desktopPackages.value(desktopEnv);
+        emit logMessage("pacman " + pkgArgs.join(' '));
+        if (!runPacman(pkgArgs))
+            return;
 
-    // Configure the display manager theme so the login screen has sane colors
-    if (dmService == "lightdm.service") {
-        runCommand(
-            "sudo arch-chroot /mnt bash -c \"printf '[greeter]\\n"
-            "theme-name=Adwaita\\n"
-            "icon-theme-name=Adwaita\\n"
-            "background=#000000\\n' > /etc/lightdm/lightdm-gtk-greeter.conf\""
-        );
-    } else if (dmService == "sddm.service") {
-        runCommand(
-            "sudo arch-chroot /mnt bash -c \"mkdir -p /etc/sddm.conf.d && "
-            "printf '[Theme]\\nCurrent=breeze\\n' > /etc/sddm.conf.d/10-theme.conf\""
-        );
+        QString dmService;
+        if (desktopEnv == "GNOME") dmService = "gdm.service";
+        else if (desktopEnv == "KDE Plasma" || desktopEnv == "LXQt") dmService = "sddm.service";
+        else dmService = "lightdm.service";
+
+        runChroot({"systemctl", "enable", dmService});
+
+        // Configure the display manager theme so the login screen has sane colors
+        if (dmService == "lightdm.service") {
+            checkEdit(config.setValues("/etc/lightdm/lightdm-gtk-greeter.conf",
+                                       {{"theme-name", "Adwaita"},
+                                        {"icon-theme-name", "Adwaita"},
+                                        {"background", "#000000"}},
+                                       "greeter"));
+        } else if (dmService == "sddm.service") {
+            checkEdit(config.setValue("/etc/sddm.conf.d/10-theme.conf", "Current", "breeze", "Theme"));
+        }
+    }
+    completeStep();
+
+    beginStep("Flush and remount");
+    cacheGuard.dismiss();
+    if (source)
+        source->detachPackageCache(targetRoot, [this](const QString &msg) { emit logMessage(msg); });
+    chroot.release();
+    mountProfile.finish();
+
+    qint64 writtenAtEnd = FilesystemStrategy::bytesWritten(rootDevice);
+    if (writtenAtStart >= 0 && writtenAtEnd >= writtenAtStart)
+        emit logMessage(QString("%1 root on %2: %3 MiB written during install")
+                            .arg(fs->name(), rootDevice)
+                            .arg((writtenAtEnd - writtenAtStart) / 1048576));
+
+    // fstab comes from what is actually mounted under the root, read straight
+    // from the superblocks, so /boot and the ESP get entries as well. It is
+    // rendered whole each time, so a rerun replaces rather than appends.
+    beginStep("fstab");
+    FstabGenerator fstab(targetRoot);
+    if (!fstab.addMountedFilesystems()) {
+        emit errorOccurred(fstab.errorString());
+        return;
+    }
+    if (exists(swapfile))
+        fstab.addSwapFile(swapfile);
+    for (const FstabEntry &e : fstab.entries())
+        emit logMessage(QString("fstab: %1 on %2 (%3, %4)").arg(e.device, e.mountPoint, e.fsType, e.options));
+    if (!config.writeFile("/etc/fstab", fstab.render())) {
+        emit errorOccurred(config.errorString());
+        return;
     }
 
-    runCommand("sudo arch-chroot /mnt bash -c 'rm -f /etc/fstab'");
-    runCommand("sudo bash -c 'genfstab -U /mnt > /mnt/etc/fstab'");
-    runCommand("sudo bash -c \"awk '!/^#|^$/{print; exit} 1' /mnt/etc/fstab > /mnt/etc/fstab.clean && mv /mnt/etc/fstab.clean /mnt/etc/fstab\"");
+    // The installed system has no use for the journal; a new install over
+    // it starts from the beginning
+    if (!journal.remove())
+        emit logMessage(journal.errorString());
+
+    step.end();
+    install.end();
+    progress->finish();
+    // Skipped steps took no time, and drives installed side by side share
+    // the disk, the download and one history file; either would skew the
+    // estimates of a single install
+    if (journal.skippedSteps() == 0 && !source)
+        progress->saveHistory();
+    emit progressChanged(1000, 0);
+    Tracer &tracer = Tracer::instance();
+    if (tracer.isEnabled()) {
+        emit logMessage(tracer.summary());
+        if (tracer.flush())
+            emit logMessage("Trace written to " + tracer.outputPath());
+    }
 
+    completed = true;
     emit logMessage("\xE2\x9C\x85 All tasks completed");
     emit finished();
 }
@@ -1,9 +1,16 @@
 #ifndef SYSTEMWORKER_H
 #define SYSTEMWORKER_H
 
+#include "commandrunner.h"
+#include "initramfsprofile.h"
+#include "progressmodel.h"
+#include <QElapsedTimer>
 #include <QObject>
 #include <QString>
 #include <QStringList>
+#include <memory>
+
+class SharedInstallSource;
 
 class SystemWorker : public QObject {
     Q_OBJECT
@@ -15,12 +22,31 @@ public:
                        const QString &password,
                        const QString &rootPassword,
                        const QString &desktopEnv,
-                       bool useEfi);
+                       bool useEfi,
+                       const QString &rootFs = "ext4");
+    // Extra accounts for lab images, see AccountManager::parseBatchFile
+    void setUserBatchFile(const QString &path);
+    // Installs into root instead of /mnt, so several targets can run at once
+    void setTargetRoot(const QString &root);
+    // ISO mount and package cache shared with the other targets; without one
+    // the worker copies and mounts the ISO itself
+    void setSharedSource(const std::shared_ptr<SharedInstallSource> &source);
+    // Metrics go to archhelp-<target>.prom/.json instead of archhelp.prom
+    void setMetricsTarget(const QString &target);
+    void setInitramfsProfile(const InitramfsProfile &profile);
+    // See MemoryConfig; swapMiB 0 sizes the swap file from the RAM
+    void setMemory(const QString &mode, qint64 swapMiB = 0);
+    // See PerfBaseline; "auto" unless set
+    void setGovernor(const QString &governor);
+    // See BootloaderStrategy; GRUB unless set
+    void setBootloader(const QString &name, const QStringList &osProberDevices = QStringList());
 
 signals:
     void logMessage(const QString &msg);
     void errorOccurred(const QString &msg);
     void finished();
+    // permille of the whole install and the predicted seconds left
+    void progressChanged(int permille, qint64 etaSeconds);
 
 public slots:
     void run();
@@ -32,8 +58,38 @@ private:
     QString rootPassword;
     QString desktopEnv;
     bool useEfi = false;
+    QString rootFilesystem = "ext4";
+    QString bootloader = "grub";
+    InitramfsProfile initramfs;
+    QString memoryMode = "auto";
+    qint64 swapfileMiB = 0;
+    QString governor = "auto";
+    QStringList osProberDevices;
+    QString userBatchFile;
+    QString targetRoot = "/mnt";
+    std::shared_ptr<SharedInstallSource> source;
+    QString metricsTarget;
+    std::unique_ptr<ProgressModel> progress;
+    QElapsedTimer progressThrottle;
+    bool stepFailed = false;  // a command or config edit of the current step failed
 
-    bool runCommand(const QString &cmd);
+    bool runCommand(const QStringList &argv);
+    bool runChroot(const QStringList &argv, const QByteArray &stdinData = QByteArray());
+    bool runSpec(const ProcessSpec &spec);
+    bool runPacman(const QStringList &args);
+    // Package files in the target's pacman cache
+    struct PackageCacheState {
+        int files = 0;
+        qint64 bytes = 0;
+    };
+    PackageCacheState scanPackageCache() const;
+    PackageCacheState packageCacheState() const;
+    PackageCacheState downloaded; // by this target into a shared cache
+    void accountPackageCache(const PackageCacheState &before);
+    void reportInitramfs(const QString &dir, const QStringList &filter, double seconds);
+    void exportMetrics(bool completed);
+    void trackProgress(const QString &line);
+    void reportProgress(bool force = false);
 };
 
 #endif // SYSTEMWORKER_H
@@ -0,0 +1,162 @@
+#include "tracer.h"
+#include <QCoreApplication>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStringList>
+#include <algorithm>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+Tracer &Tracer::instance()
+{
+    static Tracer tracer;
+    return tracer;
+}
+
+void Tracer::enable(const QString &outputPath)
+{
+    path = outputPath;
+    clock.start();
+    enabled.store(true, std::memory_order_relaxed);
+}
+
+qint64 Tracer::currentThreadId()
+{
+    return static_cast<qint64>(::syscall(SYS_gettid));
+}
+
+void Tracer::record(const TraceEvent &event)
+{
+    if (!isEnabled())
+        return;
+    QMutexLocker lock(&mutex);
+    recorded << event;
+}
+
+QList<TraceEvent> Tracer::events() const
+{
+    QMutexLocker lock(&mutex);
+    return recorded;
+}
+
+bool Tracer::writeChromeTrace(const QString &file) const
+{
+    QJsonArray out;
+    const qint64 pid = QCoreApplication::applicationPid();
+    for (const TraceEvent &e : events()) {
+        QJsonObject args;
+        if (!e.detail.isEmpty())
+            args["detail"] = e.detail;
+        if (e.bytes >= 0)
+            args["bytes"] = e.bytes;
+        if (e.hasExitCode)
+            args["exit"] = e.exitCode;
+        out.append(QJsonObject{{"name", e.name},
+                               {"cat", e.category},
+                               {"ph", "X"},
+                               {"ts", e.startUs},
+                               {"dur", e.durationUs},
+                               {"pid", pid},
+                               {"tid", e.tid},
+                               {"args", args}});
+    }
+
+    QSaveFile f(file);
+    if (!f.open(QIODevice::WriteOnly))
+        return false;
+    QJsonObject root{{"traceEvents", out}, {"displayTimeUnit", "ms"}};
+    f.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    return f.commit();
+}
+
+QString Tracer::summary(int top) const
+{
+    struct Total {
+        QString label;
+        int count = 0;
+        qint64 us = 0;
+        qint64 maxUs = 0;
+        qint64 bytes = 0;
+    };
+    QHash<QString, Total> totals;
+    qint64 first = -1, last = 0;
+    for (const TraceEvent &e : events()) {
+        QString key = e.category + ": " + e.name;
+        Total &t = totals[key];
+        t.label = key;
+        ++t.count;
+        t.us += e.durationUs;
+        t.maxUs = std::max(t.maxUs, e.durationUs);
+        if (e.bytes > 0)
+            t.bytes += e.bytes;
+        if (first < 0 || e.startUs < first)
+            first = e.startUs;
+        last = std::max(last, e.startUs + e.durationUs);
+    }
+    if (totals.isEmpty())
+        return QString();
+
+    QList<Total> sorted = totals.values();
+    std::sort(sorted.begin(), sorted.end(),
+              [](const Total &a, const Total &b) { return a.us > b.us; });
+    const qint64 wallUs = std::max<qint64>(1, last - first);
+
+    QStringList lines;
+    lines << QString("Top %1 of %2 traced operations, %3 s wall time:")
+                 .arg(std::min<int>(top, sorted.size())).arg(sorted.size())
+                 .arg(wallUs / 1e6, 0, 'f', 1);
+    lines << QString("%1 %2 %3 %4 %5  %6")
+                 .arg("total s", 9).arg("%", 5).arg("calls", 6).arg("max s", 8).arg("MiB", 8)
+                 .arg("operation");
+    for (int i = 0; i < sorted.size() && i < top; ++i) {
+        const Total &t = sorted.at(i);
+        lines << QString("%1 %2 %3 %4 %5  %6")
+                     .arg(t.us / 1e6, 9, 'f', 2)
+                     .arg(100.0 * t.us / wallUs, 5, 'f', 1)
+                     .arg(t.count, 6)
+                     .arg(t.maxUs / 1e6, 8, 'f', 2)
+                     .arg(t.bytes / 1048576.0, 8, 'f', 1)
+                     .arg(t.label);
+    }
+    return lines.join('\n');
+}
+
+TraceSpan::TraceSpan(const QString &category, const QString &name)
+{
+    Tracer &tracer = Tracer::instance();
+    if (!tracer.isEnabled())
+        return;
+    active = true;
+    event.category = category;
+    event.name = name;
+    event.tid = Tracer::currentThreadId();
+    event.startUs = tracer.nowUs();
+}
+
+void TraceSpan::end()
+{
+    if (!active)
+        return;
+    active = false;
+    Tracer &tracer = Tracer::instance();
+    event.durationUs = tracer.nowUs() - event.startUs;
+    tracer.record(event);
+}
+
+void TraceSpan::next(const QString &name)
+{
+    if (!Tracer::instance().isEnabled())
+        return;
+    QString category = event.category;
+    end();
+    event = TraceEvent();
+    active = true;
+    event.category = category;
+    event.name = name;
+    event.tid = Tracer::currentThreadId();
+    event.startUs = Tracer::instance().nowUs();
+}
@@ -0,0 +1,77 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <atomic>
+
+struct TraceEvent {
+    QString category;     // "step", "process", "format", "download", ...
+    QString name;
+    QString detail;
+    qint64 startUs = 0;   // monotonic, relative to when tracing was enabled
+    qint64 durationUs = 0;
+    qint64 tid = 0;
+    qint64 bytes = -1;    // bytes processed, -1 when not meaningful
+    int exitCode = 0;
+    bool hasExitCode = false;
+};
+
+// Collects timed spans from every thread of the installer. Tracing is off
+// unless enabled (ARCHHELP_TRACE=<file>, see main.cpp); while off a span
+// costs one relaxed atomic load. The result can be written as a Chrome
+// trace-event file (chrome://tracing, Perfetto) and summarised as a table
+// of the steps that took longest.
+class Tracer {
+public:
+    static Tracer &instance();
+
+    void enable(const QString &outputPath);
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+    QString outputPath() const { return path; }
+
+    qint64 nowUs() const { return clock.nsecsElapsed() / 1000; }
+    static qint64 currentThreadId();
+
+    void record(const TraceEvent &event);
+    QList<TraceEvent> events() const;
+
+    bool writeChromeTrace(const QString &file) const;
+    bool flush() const { return path.isEmpty() || writeChromeTrace(path); }
+    QString summary(int top = 10) const;
+
+private:
+    Tracer() = default;
+
+    std::atomic<bool> enabled{false};
+    QString path;
+    QElapsedTimer clock;
+    mutable QMutex mutex;
+    QList<TraceEvent> recorded;
+};
+
+// Records one span from construction to destruction (or end()). next()
+// closes the current span and opens another, for long functions made of
+// sequential phases.
+class TraceSpan {
+public:
+    TraceSpan(const QString &category, const QString &name);
+    ~TraceSpan() { end(); }
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+    void setBytes(qint64 bytes) { event.bytes = bytes; }
+    void setExitCode(int code) { event.exitCode = code; event.hasExitCode = true; }
+    void setDetail(const QString &detail) { event.detail = detail; }
+
+    void next(const QString &name);
+    void end();
+
+private:
+    TraceEvent event;
+    bool active = false;
+};
+
+#endif // TRACER_H